@@ -0,0 +1,569 @@
+/*
+ * Copyright (C) 2022 Purism SPC
+ *
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+#define G_LOG_DOMAIN "phoc-client-stats"
+
+#include "config.h"
+#include "client-stats.h"
+#include "server.h"
+
+#include <drm_fourcc.h>
+#include <wlr/types/wlr_buffer.h>
+#include <wlr/types/wlr_compositor.h>
+
+/* Interval (in seconds) for dumping the statistics */
+#define PHOC_CLIENT_STATS_DUMP_INTERVAL 10
+
+/**
+ * PhocClientStats:
+ *
+ * Tracks resource usage per client: commits, attached buffer memory,
+ * damage, thumbnail requests and time spent in request handlers. With
+ * `verbose` set the statistics are periodically dumped to the log.
+ *
+ * Also enforces the (optional) budgets from the `[budget]` section of
+ * the config file.
+ */
+struct _PhocClientStats {
+  GObject                     parent;
+
+  gboolean                    verbose;
+  GHashTable                 *clients;
+  struct wl_listener          new_surface;
+  struct wl_protocol_logger  *logger;
+  guint                       dump_id;
+  gint64                      last_dump;
+
+  /* The client whose request is currently being handled */
+  struct wl_client           *dispatch_client;
+  gint64                      dispatch_start;
+
+  /* Budgets, 0 means unlimited */
+  guint                       thumbnail_rate;
+  guint                       background_frame_rate;
+};
+
+G_DEFINE_TYPE (PhocClientStats, phoc_client_stats, G_TYPE_OBJECT)
+
+enum {
+  PROP_0,
+  PROP_VERBOSE,
+  PROP_LAST_PROP
+};
+static GParamSpec *props[PROP_LAST_PROP];
+
+typedef struct _PhocClientStatsClient {
+  PhocClientStats     *stats;
+  struct wl_client    *wl_client;
+  struct wl_listener   destroy;
+  struct wl_list       surfaces; /* PhocClientStatsSurface::link */
+  PhocClientStatsInfo  info;
+
+  /* Budget tracking */
+  gint64               thumbnail_window_start;
+  guint                thumbnail_window_count;
+  gint64               last_background_frame;
+} PhocClientStatsClient;
+
+typedef struct _PhocClientStatsSurface {
+  PhocClientStatsClient *client;
+  struct wlr_surface    *wlr_surface;
+  struct wl_list         link;
+  struct wl_listener     commit;
+  struct wl_listener     destroy;
+  gsize                  bytes;
+  gboolean               is_shm;
+} PhocClientStatsSurface;
+
+
+static void
+surface_free (PhocClientStatsSurface *surface)
+{
+  wl_list_remove (&surface->link);
+  wl_list_remove (&surface->commit.link);
+  wl_list_remove (&surface->destroy.link);
+  g_free (surface);
+}
+
+
+static void
+client_handle_destroy (struct wl_listener *listener, void *data)
+{
+  PhocClientStatsClient *client = wl_container_of (listener, client, destroy);
+
+  g_hash_table_remove (client->stats->clients, client->wl_client);
+}
+
+
+static void
+client_free (PhocClientStatsClient *client)
+{
+  PhocClientStatsSurface *surface, *tmp;
+
+  /* The client's surfaces get destroyed after the client itself */
+  wl_list_for_each_safe (surface, tmp, &client->surfaces, link)
+    surface_free (surface);
+
+  if (client->stats->dispatch_client == client->wl_client)
+    client->stats->dispatch_client = NULL;
+
+  wl_list_remove (&client->destroy.link);
+  g_free (client);
+}
+
+
+static PhocClientStatsClient *
+phoc_client_stats_lookup (PhocClientStats *self, struct wl_client *wl_client)
+{
+  PhocClientStatsClient *client;
+
+  client = g_hash_table_lookup (self->clients, wl_client);
+  if (client)
+    return client;
+
+  client = g_new0 (PhocClientStatsClient, 1);
+  client->stats = self;
+  client->wl_client = wl_client;
+  wl_client_get_credentials (wl_client, &client->info.pid, NULL, NULL);
+  wl_list_init (&client->surfaces);
+
+  client->destroy.notify = client_handle_destroy;
+  wl_client_add_destroy_listener (wl_client, &client->destroy);
+
+  g_hash_table_insert (self->clients, wl_client, client);
+
+  return client;
+}
+
+
+static void
+surface_update_buffer (PhocClientStatsSurface *surface)
+{
+  struct wlr_client_buffer *buffer = surface->wlr_surface->buffer;
+  PhocClientStatsInfo *info = &surface->client->info;
+  gsize bytes = 0;
+  gboolean is_shm = FALSE;
+
+  if (buffer) {
+    /* Assume 32bpp, good enough for accounting */
+    bytes = (gsize)buffer->base.width * buffer->base.height * 4;
+    is_shm = buffer->shm_source_format != DRM_FORMAT_INVALID;
+  }
+
+  if (surface->is_shm)
+    info->shm_bytes -= surface->bytes;
+  else
+    info->dmabuf_bytes -= surface->bytes;
+
+  if (is_shm)
+    info->shm_bytes += bytes;
+  else
+    info->dmabuf_bytes += bytes;
+
+  surface->bytes = bytes;
+  surface->is_shm = is_shm;
+}
+
+
+static void
+surface_handle_commit (struct wl_listener *listener, void *data)
+{
+  PhocClientStatsSurface *surface = wl_container_of (listener, surface, commit);
+  struct wlr_surface *wlr_surface = surface->wlr_surface;
+  PhocClientStatsInfo *info = &surface->client->info;
+  int n_rects;
+  pixman_box32_t *rects;
+
+  info->commits++;
+
+  rects = pixman_region32_rectangles (&wlr_surface->buffer_damage, &n_rects);
+  for (int i = 0; i < n_rects; i++)
+    info->damaged_pixels += (guint64)(rects[i].x2 - rects[i].x1) * (rects[i].y2 - rects[i].y1);
+
+  if (wlr_surface->current.committed & WLR_SURFACE_STATE_BUFFER)
+    surface_update_buffer (surface);
+}
+
+
+static void
+surface_handle_destroy (struct wl_listener *listener, void *data)
+{
+  PhocClientStatsSurface *surface = wl_container_of (listener, surface, destroy);
+  PhocClientStatsInfo *info = &surface->client->info;
+
+  if (surface->is_shm)
+    info->shm_bytes -= surface->bytes;
+  else
+    info->dmabuf_bytes -= surface->bytes;
+
+  surface_free (surface);
+}
+
+
+static void
+handle_new_surface (struct wl_listener *listener, void *data)
+{
+  PhocClientStats *self = wl_container_of (listener, self, new_surface);
+  struct wlr_surface *wlr_surface = data;
+  PhocClientStatsSurface *surface = g_new0 (PhocClientStatsSurface, 1);
+
+  surface->client = phoc_client_stats_lookup (self, wl_resource_get_client (wlr_surface->resource));
+  surface->wlr_surface = wlr_surface;
+  surface->is_shm = TRUE;
+  wl_list_insert (&surface->client->surfaces, &surface->link);
+
+  surface->commit.notify = surface_handle_commit;
+  wl_signal_add (&wlr_surface->events.commit, &surface->commit);
+  surface->destroy.notify = surface_handle_destroy;
+  wl_signal_add (&wlr_surface->events.destroy, &surface->destroy);
+}
+
+
+static void
+phoc_client_stats_end_span (PhocClientStats *self, gint64 now)
+{
+  PhocClientStatsClient *client;
+
+  if (self->dispatch_client == NULL)
+    return;
+
+  client = g_hash_table_lookup (self->clients, self->dispatch_client);
+  if (client)
+    client->info.handler_time += now - self->dispatch_start;
+
+  self->dispatch_client = NULL;
+}
+
+
+static void
+protocol_logger_func (void                                   *user_data,
+                      enum wl_protocol_logger_type            direction,
+                      const struct wl_protocol_logger_message *message)
+{
+  PhocClientStats *self = PHOC_CLIENT_STATS (user_data);
+  gint64 now;
+
+  if (direction != WL_PROTOCOL_LOGGER_REQUEST)
+    return;
+
+  /* Requests are handled sequentially, so a request ends the previous one */
+  now = g_get_monotonic_time ();
+  phoc_client_stats_end_span (self, now);
+
+  self->dispatch_client = wl_resource_get_client (message->resource);
+  self->dispatch_start = now;
+  /* Make sure the client is tracked even without surfaces */
+  phoc_client_stats_lookup (self, self->dispatch_client);
+}
+
+
+static void
+on_render_start (PhocClientStats *self)
+{
+  /* Don't account rendering to the last client */
+  phoc_client_stats_end_span (self, g_get_monotonic_time ());
+}
+
+
+static void
+phoc_client_stats_dump (PhocClientStats *self)
+{
+  GHashTableIter iter;
+  PhocClientStatsClient *client;
+  gint64 now = g_get_monotonic_time ();
+  double elapsed = MAX (now - self->last_dump, 1) / (double)G_USEC_PER_SEC;
+
+  g_message ("Client statistics for the last %.1fs:", elapsed);
+
+  g_hash_table_iter_init (&iter, self->clients);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&client)) {
+    PhocClientStatsInfo *info = &client->info;
+
+    g_message ("  pid %5d: %6.1f commits/s, %8.0f damaged px/s, shm %6" G_GSIZE_FORMAT " KiB, "
+             "dmabuf %6" G_GSIZE_FORMAT " KiB, %" G_GUINT64_FORMAT " thumbnails, %.3f ms in handlers",
+             info->pid,
+             info->commits / elapsed,
+             info->damaged_pixels / elapsed,
+             info->shm_bytes / 1024,
+             info->dmabuf_bytes / 1024,
+             info->thumbnails,
+             info->handler_time / 1000.0);
+
+    info->commits = 0;
+    info->damaged_pixels = 0;
+    info->thumbnails = 0;
+    info->handler_time = 0;
+  }
+
+  self->last_dump = now;
+}
+
+
+static gboolean
+on_dump_timeout (gpointer data)
+{
+  PhocClientStats *self = PHOC_CLIENT_STATS (data);
+
+  phoc_client_stats_dump (self);
+
+  return G_SOURCE_CONTINUE;
+}
+
+
+static void
+phoc_client_stats_set_property (GObject      *object,
+                                guint         property_id,
+                                const GValue *value,
+                                GParamSpec   *pspec)
+{
+  PhocClientStats *self = PHOC_CLIENT_STATS (object);
+
+  switch (property_id) {
+  case PROP_VERBOSE:
+    self->verbose = g_value_get_boolean (value);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+    break;
+  }
+}
+
+
+static void
+phoc_client_stats_get_property (GObject    *object,
+                                guint       property_id,
+                                GValue     *value,
+                                GParamSpec *pspec)
+{
+  PhocClientStats *self = PHOC_CLIENT_STATS (object);
+
+  switch (property_id) {
+  case PROP_VERBOSE:
+    g_value_set_boolean (value, self->verbose);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+    break;
+  }
+}
+
+
+static void
+phoc_client_stats_constructed (GObject *object)
+{
+  PhocClientStats *self = PHOC_CLIENT_STATS (object);
+  PhocServer *server = phoc_server_get_default ();
+
+  G_OBJECT_CLASS (phoc_client_stats_parent_class)->constructed (object);
+
+  self->new_surface.notify = handle_new_surface;
+  wl_signal_add (&server->compositor->events.new_surface, &self->new_surface);
+
+  if (!self->verbose)
+    return;
+
+  /* The protocol logger is invoked for every message so only use it when needed */
+  self->logger = wl_display_add_protocol_logger (server->wl_display, protocol_logger_func, self);
+  g_signal_connect_object (phoc_server_get_renderer (server), "render-start",
+                           G_CALLBACK (on_render_start), self, G_CONNECT_SWAPPED);
+
+  self->last_dump = g_get_monotonic_time ();
+  self->dump_id = g_timeout_add_seconds (PHOC_CLIENT_STATS_DUMP_INTERVAL, on_dump_timeout, self);
+  g_source_set_name_by_id (self->dump_id, "[phoc] client stats dump");
+}
+
+
+static void
+phoc_client_stats_finalize (GObject *object)
+{
+  PhocClientStats *self = PHOC_CLIENT_STATS (object);
+
+  g_clear_handle_id (&self->dump_id, g_source_remove);
+  g_clear_pointer (&self->logger, wl_protocol_logger_destroy);
+  wl_list_remove (&self->new_surface.link);
+  g_hash_table_destroy (self->clients);
+
+  G_OBJECT_CLASS (phoc_client_stats_parent_class)->finalize (object);
+}
+
+
+static void
+phoc_client_stats_class_init (PhocClientStatsClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->constructed = phoc_client_stats_constructed;
+  object_class->finalize = phoc_client_stats_finalize;
+  object_class->set_property = phoc_client_stats_set_property;
+  object_class->get_property = phoc_client_stats_get_property;
+
+  /**
+   * PhocClientStats:verbose:
+   *
+   * Whether to track time spent in request handlers and
+   * dump the statistics to the log periodically.
+   */
+  props[PROP_VERBOSE] =
+    g_param_spec_boolean ("verbose", "", "",
+                          FALSE,
+                          G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS);
+
+  g_object_class_install_properties (object_class, PROP_LAST_PROP, props);
+}
+
+
+static void
+phoc_client_stats_init (PhocClientStats *self)
+{
+  self->clients = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+                                         NULL, (GDestroyNotify)client_free);
+}
+
+
+PhocClientStats *
+phoc_client_stats_new (gboolean verbose)
+{
+  return PHOC_CLIENT_STATS (g_object_new (PHOC_TYPE_CLIENT_STATS, "verbose", verbose, NULL));
+}
+
+/**
+ * phoc_client_stats_get_info:
+ * @self: The client stats
+ * @client: The client to get the statistics for
+ *
+ * Returns: (transfer none) (nullable): The client's statistics or %NULL
+ *   if nothing was recorded for @client yet.
+ */
+const PhocClientStatsInfo *
+phoc_client_stats_get_info (PhocClientStats *self, struct wl_client *client)
+{
+  PhocClientStatsClient *entry;
+
+  g_assert (PHOC_IS_CLIENT_STATS (self));
+
+  entry = g_hash_table_lookup (self->clients, client);
+
+  return entry ? &entry->info : NULL;
+}
+
+/**
+ * phoc_client_stats_end_dispatch:
+ * @self: The client stats
+ *
+ * Mark the end of a wayland event loop dispatch so the time spent
+ * until the next request isn't attributed to the last client.
+ */
+void
+phoc_client_stats_end_dispatch (PhocClientStats *self)
+{
+  g_assert (PHOC_IS_CLIENT_STATS (self));
+
+  if (self->dispatch_client)
+    phoc_client_stats_end_span (self, g_get_monotonic_time ());
+}
+
+/**
+ * phoc_client_stats_request_thumbnail:
+ * @self: The client stats
+ * @client: The client requesting the thumbnail
+ *
+ * Account a thumbnail request for @client.
+ *
+ * Returns: %FALSE if the request exceeds the client's thumbnail budget
+ *   and should be rejected.
+ */
+gboolean
+phoc_client_stats_request_thumbnail (PhocClientStats *self, struct wl_client *client)
+{
+  PhocClientStatsClient *entry;
+  gint64 now;
+
+  g_assert (PHOC_IS_CLIENT_STATS (self));
+
+  entry = phoc_client_stats_lookup (self, client);
+  entry->info.thumbnails++;
+
+  if (self->thumbnail_rate == 0)
+    return TRUE;
+
+  now = g_get_monotonic_time ();
+  if (now - entry->thumbnail_window_start >= G_USEC_PER_SEC) {
+    entry->thumbnail_window_start = now;
+    entry->thumbnail_window_count = 0;
+  }
+
+  if (entry->thumbnail_window_count >= self->thumbnail_rate) {
+    g_debug ("Thumbnail budget of client %d exceeded", entry->info.pid);
+    return FALSE;
+  }
+
+  entry->thumbnail_window_count++;
+  return TRUE;
+}
+
+/**
+ * phoc_client_stats_allow_background_frame:
+ * @self: The client stats
+ * @client: The client owning a surface that isn't visible
+ * @retry_ms: (out) (optional): Return location for the time until the
+ *   next frame callback fits the budget
+ *
+ * Check whether a frame callback for a surface that isn't visible
+ * should be sent to @client now. Callers must not drop callbacks that
+ * aren't allowed but send them after @retry_ms as otherwise clients
+ * blocked on them stall.
+ *
+ * Returns: %FALSE if this would exceed the client's background frame
+ *   callback budget.
+ */
+gboolean
+phoc_client_stats_allow_background_frame (PhocClientStats  *self,
+                                          struct wl_client *client,
+                                          guint            *retry_ms)
+{
+  PhocClientStatsClient *entry;
+  gint64 now, interval;
+
+  g_assert (PHOC_IS_CLIENT_STATS (self));
+
+  if (retry_ms)
+    *retry_ms = 0;
+
+  if (self->background_frame_rate == 0)
+    return TRUE;
+
+  entry = phoc_client_stats_lookup (self, client);
+  now = g_get_monotonic_time ();
+  interval = G_USEC_PER_SEC / self->background_frame_rate;
+  if (now - entry->last_background_frame < interval) {
+    if (retry_ms)
+      *retry_ms = MAX (1, (entry->last_background_frame + interval - now + 999) / 1000);
+    return FALSE;
+  }
+
+  entry->last_background_frame = now;
+  return TRUE;
+}
+
+/**
+ * phoc_client_stats_set_budgets:
+ * @self: The client stats
+ * @thumbnail_rate: Max thumbnail requests per second and client, 0 for unlimited
+ * @background_frame_rate: Max frame callbacks per second for clients
+ *   that aren't visible, 0 for unlimited
+ *
+ * Set the per client budgets.
+ */
+void
+phoc_client_stats_set_budgets (PhocClientStats *self,
+                               guint            thumbnail_rate,
+                               guint            background_frame_rate)
+{
+  g_assert (PHOC_IS_CLIENT_STATS (self));
+
+  self->thumbnail_rate = thumbnail_rate;
+  self->background_frame_rate = background_frame_rate;
+}
@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2022 Purism SPC
+ *
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+#pragma once
+
+#include <glib-object.h>
+#include <wayland-server-core.h>
+#include <sys/types.h>
+
+G_BEGIN_DECLS
+
+#define PHOC_TYPE_CLIENT_STATS (phoc_client_stats_get_type ())
+
+G_DECLARE_FINAL_TYPE (PhocClientStats, phoc_client_stats, PHOC, CLIENT_STATS, GObject)
+
+/**
+ * PhocClientStatsInfo:
+ * @pid: The client's process id
+ * @commits: Number of surface commits
+ * @shm_bytes: Memory of currently attached shm buffers
+ * @dmabuf_bytes: Memory of currently attached dmabufs
+ * @damaged_pixels: Number of damaged buffer pixels
+ * @thumbnails: Number of thumbnail requests
+ * @handler_time: Time (in µs) spent handling the client's requests
+ *
+ * Resource usage of a single client. Counters are reset on every
+ * periodic dump, memory usage reflects the current state.
+ */
+typedef struct _PhocClientStatsInfo {
+  pid_t   pid;
+  guint64 commits;
+  gsize   shm_bytes;
+  gsize   dmabuf_bytes;
+  guint64 damaged_pixels;
+  guint64 thumbnails;
+  gint64  handler_time;
+} PhocClientStatsInfo;
+
+PhocClientStats           *phoc_client_stats_new (gboolean verbose);
+const PhocClientStatsInfo *phoc_client_stats_get_info (PhocClientStats  *self,
+                                                       struct wl_client *client);
+void                       phoc_client_stats_end_dispatch (PhocClientStats *self);
+gboolean                   phoc_client_stats_request_thumbnail (PhocClientStats  *self,
+                                                                struct wl_client *client);
+gboolean                   phoc_client_stats_allow_background_frame (PhocClientStats  *self,
+                                                                     struct wl_client *client,
+                                                                     guint            *retry_ms);
+void                       phoc_client_stats_set_budgets (PhocClientStats *self,
+                                                          guint            thumbnail_rate,
+                                                          guint            background_frame_rate);
+
+G_END_DECLS
@@ -10,6 +10,7 @@
 #include "server.h"
 #include "gesture.h"
 #include "gesture-drag.h"
+#include "touch-resampler.h"
 
 #define _XOPEN_SOURCE 700
 #include <assert.h>
@@ -26,6 +27,9 @@
 #include "view.h"
 #include "xcursor.h"
 
+/* How far (in µs) in the past resampled touch positions are sampled at */
+#define PHOC_TOUCH_RESAMPLE_LATENCY_US (5 * 1000)
+
 enum {
   PROP_0,
   PROP_SEAT,
@@ -38,6 +42,15 @@ typedef struct _PhocCursorPrivate {
   PhocDraggableLayerSurface *drag_surface;
 
   GSList *gestures;
+
+  /* Touch resampling, resamplers are NULL when disabled */
+  PhocTouchResampler *drag_resampler;
+  PhocGesture        *drag_gesture;
+  gboolean            drag_pending;
+  PhocTouchResampler *move_resampler;
+  gboolean            move_pending;
+  double              move_x, move_y;
+  guint32             move_time_msec;
 } PhocCursorPrivate;
 
 
@@ -49,6 +62,7 @@ static void handle_pointer_button (struct wl_listener *listener, void *data);
 static void handle_pointer_axis (struct wl_listener *listener, void *data);
 static void handle_pointer_frame (struct wl_listener *listener, void *data);
 static void handle_touch_frame (struct wl_listener *listener, void *data);
+static void on_render_start (PhocCursor *self, PhocOutput *output);
 
 static void
 phoc_cursor_set_property (GObject      *object,
@@ -350,10 +364,13 @@ static void
 phoc_cursor_constructed (GObject *object)
 {
   PhocCursor *self = PHOC_CURSOR (object);
+  PhocCursorPrivate *priv = phoc_cursor_get_instance_private (self);
+  PhocServer *server = phoc_server_get_default ();
   struct wlr_cursor *wlr_cursor = self->cursor;
 
   g_assert (self->cursor);
-  self->xcursor_manager = wlr_xcursor_manager_create (NULL, PHOC_XCURSOR_SIZE);
+  /* Shared so themes are only loaded once per scale */
+  self->xcursor_manager = server->desktop->xcursor_manager;
   g_assert (self->xcursor_manager);
 
   wl_signal_add (&wlr_cursor->events.motion, &self->motion);
@@ -375,6 +392,13 @@ phoc_cursor_constructed (GObject *object)
                  &self->touch_frame);
   self->touch_frame.notify = handle_touch_frame;
 
+  if (server->config->touch.resample) {
+    priv->drag_resampler = phoc_touch_resampler_new (server->config->touch.max_prediction);
+    priv->move_resampler = phoc_touch_resampler_new (server->config->touch.max_prediction);
+    g_signal_connect_object (phoc_server_get_renderer (server), "render-start",
+                             G_CALLBACK (on_render_start), self, G_CONNECT_SWAPPED);
+  }
+
   G_OBJECT_CLASS (phoc_cursor_parent_class)->constructed (object);
 }
 
@@ -393,6 +417,8 @@ phoc_cursor_finalize (GObject *object)
   PhocCursorPrivate *priv = phoc_cursor_get_instance_private (self);
 
   g_clear_pointer (&priv->gestures, free_gestures);
+  g_clear_pointer (&priv->drag_resampler, phoc_touch_resampler_free);
+  g_clear_pointer (&priv->move_resampler, phoc_touch_resampler_free);
 
   wl_list_remove (&self->motion.link);
   wl_list_remove (&self->motion_absolute.link);
@@ -416,7 +442,6 @@ phoc_cursor_finalize (GObject *object)
   wl_list_remove (&self->request_set_cursor.link);
   wl_list_remove (&self->focus_change.link);
 
-  g_clear_pointer (&self->xcursor_manager, wlr_xcursor_manager_destroy);
   g_clear_pointer (&self->cursor, wlr_cursor_destroy);
 
   G_OBJECT_CLASS (phoc_cursor_parent_class)->finalize (object);
@@ -469,22 +494,20 @@ on_drag_begin (PhocGesture *gesture, double lx, double ly, PhocCursor *self)
   } else {
     priv->drag_surface = drag_surface;
   }
+
+  if (priv->drag_resampler) {
+    phoc_touch_resampler_reset (priv->drag_resampler);
+    priv->drag_pending = FALSE;
+  }
 }
 
 
 static void
-on_drag_update (PhocGesture *gesture, double off_x, double off_y, PhocCursor *self)
+drag_surface_update (PhocCursor *self, PhocGesture *gesture, double off_x, double off_y)
 {
-  PhocCursorPrivate *priv;
+  PhocCursorPrivate *priv = phoc_cursor_get_instance_private (self);
   PhocDraggableSurfaceState state;
 
-  g_assert (PHOC_IS_GESTURE (gesture));
-  g_assert (PHOC_IS_CURSOR (self));
-  priv = phoc_cursor_get_instance_private (self);
-
-  if (!priv->drag_surface)
-    return;
-
   state = phoc_draggable_layer_surface_drag_update (priv->drag_surface, off_x, off_y);
   switch (state) {
   case PHOC_DRAGGABLE_SURFACE_STATE_DRAGGING:
@@ -501,6 +524,33 @@ on_drag_update (PhocGesture *gesture, double off_x, double off_y, PhocCursor *se
 }
 
 
+static void
+on_drag_update (PhocGesture *gesture, double off_x, double off_y, PhocCursor *self)
+{
+  PhocCursorPrivate *priv;
+  struct wlr_output *wlr_output;
+
+  g_assert (PHOC_IS_GESTURE (gesture));
+  g_assert (PHOC_IS_CURSOR (self));
+  priv = phoc_cursor_get_instance_private (self);
+
+  if (!priv->drag_surface)
+    return;
+
+  wlr_output = priv->drag_surface->layer_surface->layer_surface->output;
+  if (!priv->drag_resampler || !wlr_output) {
+    drag_surface_update (self, gesture, off_x, off_y);
+    return;
+  }
+
+  /* Applied when the next frame gets rendered, see on_render_start () */
+  phoc_touch_resampler_add_sample (priv->drag_resampler, g_get_monotonic_time (), off_x, off_y);
+  priv->drag_gesture = gesture;
+  priv->drag_pending = TRUE;
+  wlr_output_schedule_frame (wlr_output);
+}
+
+
 static void
 on_drag_end (PhocGesture *gesture, double off_x, double off_y, PhocCursor *self)
 {
@@ -510,6 +560,7 @@ on_drag_end (PhocGesture *gesture, double off_x, double off_y, PhocCursor *self)
   g_assert (PHOC_IS_CURSOR (self));
   priv = phoc_cursor_get_instance_private (self);
 
+  priv->drag_pending = FALSE;
   if (!priv->drag_surface)
     return;
 
@@ -517,6 +568,43 @@ on_drag_end (PhocGesture *gesture, double off_x, double off_y, PhocCursor *self)
 }
 
 
+/*
+ * Apply resampled touch positions right before a frame gets rendered.
+ * Samples are timestamped on arrival and the position is interpolated
+ * a bit in the past so there's usually a sample on either side and the
+ * movement is smooth regardless of the digitizer's rate. Only the output
+ * showing the dragged surface or the touch point applies it.
+ */
+static void
+on_render_start (PhocCursor *self, PhocOutput *output)
+{
+  PhocCursorPrivate *priv = phoc_cursor_get_instance_private (self);
+  PhocDesktop *desktop = phoc_server_get_default ()->desktop;
+  gint64 target = g_get_monotonic_time () - PHOC_TOUCH_RESAMPLE_LATENCY_US;
+  double x, y;
+
+  if (priv->drag_pending &&
+      (!priv->drag_surface ||
+       priv->drag_surface->layer_surface->layer_surface->output == output->wlr_output)) {
+    priv->drag_pending = FALSE;
+    if (priv->drag_surface &&
+        phoc_touch_resampler_get_position (priv->drag_resampler, target, &x, &y)) {
+      drag_surface_update (self, priv->drag_gesture, x, y);
+    }
+  }
+
+  if (priv->move_pending &&
+      wlr_output_layout_output_at (desktop->layout, priv->move_x, priv->move_y) == output->wlr_output) {
+    priv->move_pending = FALSE;
+    if (self->mode == PHOC_CURSOR_MOVE &&
+        phoc_touch_resampler_get_position (priv->move_resampler, target, &x, &y)) {
+      wlr_cursor_warp (self->cursor, NULL, x, y);
+      phoc_cursor_update_position (self, priv->move_time_msec);
+    }
+  }
+}
+
+
 static void
 on_drag_cancel (PhocGesture *gesture, gpointer sequence, PhocCursor *self)
 {
@@ -721,14 +809,14 @@ handle_pointer_motion (struct wl_listener *listener, void *data)
   PhocCursor *self = wl_container_of (listener, self, motion);
   struct wlr_event_pointer_motion *event = data;
   PhocServer *server = phoc_server_get_default ();
-  PhocDesktop *desktop = server->desktop;
   double dx = event->delta_x;
   double dy = event->delta_y;
 
   double dx_unaccel = event->unaccel_dx;
   double dy_unaccel = event->unaccel_dy;
 
-  wlr_idle_notify_activity (desktop->idle, self->seat->seat);
+  phoc_input_record_event (server->input, PHOC_INPUT_RECORD_POINTER_MOTION, event->device, event);
+  phoc_seat_notify_activity (self->seat);
 
   wlr_relative_pointer_manager_v1_send_relative_motion (
     server->desktop->relative_pointer_manager,
@@ -771,10 +859,11 @@ handle_pointer_motion_absolute (struct wl_listener *listener, void *data)
   PhocCursor *self = wl_container_of (listener, self, motion_absolute);
   struct wlr_event_pointer_motion_absolute *event = data;
   PhocServer *server = phoc_server_get_default ();
-  PhocDesktop *desktop = server->desktop;
   double lx, ly;
 
-  wlr_idle_notify_activity (desktop->idle, self->seat->seat);
+  phoc_input_record_event (server->input, PHOC_INPUT_RECORD_POINTER_MOTION_ABSOLUTE,
+                           event->device, event);
+  phoc_seat_notify_activity (self->seat);
   wlr_cursor_absolute_to_layout_coords (self->cursor, event->device, event->x,
                                         event->y, &lx, &ly);
 
@@ -807,11 +896,11 @@ handle_pointer_button (struct wl_listener *listener, void *data)
   PhocCursor *self = wl_container_of (listener, self, button);
   struct wlr_event_pointer_button *event = data;
   PhocServer *server = phoc_server_get_default ();
-  PhocDesktop *desktop = server->desktop;
   PhocEventType type;
   bool is_touch = event->device->type == WLR_INPUT_DEVICE_TOUCH;
 
-  wlr_idle_notify_activity (desktop->idle, self->seat->seat);
+  phoc_input_record_event (server->input, PHOC_INPUT_RECORD_POINTER_BUTTON, event->device, event);
+  phoc_seat_notify_activity (self->seat);
   g_debug ("%s %d is_touch: %d", __func__, __LINE__, is_touch);
   if (!is_touch) {
     type = event->state ? PHOC_EVENT_BUTTON_PRESS : PHOC_EVENT_BUTTON_RELEASE;
@@ -848,9 +937,9 @@ handle_pointer_axis (struct wl_listener *listener, void *data)
   PhocCursor *self = wl_container_of (listener, self, axis);
   struct wlr_event_pointer_axis *event = data;
   PhocServer *server = phoc_server_get_default ();
-  PhocDesktop *desktop = server->desktop;
 
-  wlr_idle_notify_activity (desktop->idle, self->seat->seat);
+  phoc_input_record_event (server->input, PHOC_INPUT_RECORD_POINTER_AXIS, event->device, event);
+  phoc_seat_notify_activity (self->seat);
   wlr_seat_pointer_notify_axis (self->seat->seat, event->time_msec,
                                 event->orientation, event->delta, event->delta_discrete, event->source);
 }
@@ -860,9 +949,9 @@ handle_pointer_frame (struct wl_listener *listener, void *data)
 {
   PhocCursor *self = wl_container_of (listener, self, frame);
   PhocServer *server = phoc_server_get_default ();
-  PhocDesktop *desktop = server->desktop;
 
-  wlr_idle_notify_activity (desktop->idle, self->seat->seat);
+  phoc_input_record_event (server->input, PHOC_INPUT_RECORD_POINTER_FRAME, NULL, NULL);
+  phoc_seat_notify_activity (self->seat);
   wlr_seat_pointer_notify_frame (self->seat->seat);
 }
 
@@ -870,11 +959,13 @@ void
 phoc_cursor_handle_touch_down (PhocCursor                  *self,
                                struct wlr_event_touch_down *event)
 {
+  PhocCursorPrivate *priv = phoc_cursor_get_instance_private (self);
   PhocServer *server = phoc_server_get_default ();
   PhocDesktop *desktop = server->desktop;
   PhocSeat *seat = self->seat;
   double lx, ly;
 
+  phoc_input_record_event (server->input, PHOC_INPUT_RECORD_TOUCH_DOWN, event->device, event);
   wlr_cursor_absolute_to_layout_coords (self->cursor, event->device,
                                         event->x, event->y, &lx, &ly);
 
@@ -884,6 +975,12 @@ phoc_cursor_handle_touch_down (PhocCursor                  *self,
     seat->touch_id = event->touch_id;
     seat->touch_x = lx;
     seat->touch_y = ly;
+
+    if (priv->move_resampler) {
+      phoc_touch_resampler_reset (priv->move_resampler);
+      phoc_touch_resampler_add_sample (priv->move_resampler, g_get_monotonic_time (), lx, ly);
+      priv->move_pending = FALSE;
+    }
   }
 
   double sx, sy;
@@ -933,9 +1030,12 @@ void
 phoc_cursor_handle_touch_up (PhocCursor                *self,
                              struct wlr_event_touch_up *event)
 {
+  PhocCursorPrivate *priv = phoc_cursor_get_instance_private (self);
   struct wlr_touch_point *point =
     wlr_seat_touch_get_point (self->seat->seat, event->touch_id);
 
+  phoc_input_record_event (phoc_server_get_default ()->input, PHOC_INPUT_RECORD_TOUCH_UP,
+                           event->device, event);
   if (self->seat->touch_id == event->touch_id)
     self->seat->touch_id = -1;
 
@@ -946,6 +1046,13 @@ phoc_cursor_handle_touch_up (PhocCursor                *self,
   if (!point)
     return;
 
+  /* Finish the move where the finger got lifted */
+  if (priv->move_pending && self->mode == PHOC_CURSOR_MOVE) {
+    wlr_cursor_warp (self->cursor, NULL, priv->move_x, priv->move_y);
+    phoc_cursor_update_position (self, event->time_msec);
+  }
+  priv->move_pending = FALSE;
+
   if (self->mode != PHOC_CURSOR_PASSTHROUGH) {
     self->mode = PHOC_CURSOR_PASSTHROUGH;
     phoc_cursor_update_focus (self);
@@ -959,11 +1066,14 @@ void
 phoc_cursor_handle_touch_motion (PhocCursor                    *self,
                                  struct wlr_event_touch_motion *event)
 {
+  PhocCursorPrivate *priv = phoc_cursor_get_instance_private (self);
   PhocServer *server = phoc_server_get_default ();
   PhocDesktop *desktop = server->desktop;
   struct wlr_touch_point *point =
     wlr_seat_touch_get_point (self->seat->seat, event->touch_id);
 
+  phoc_input_record_event (server->input, PHOC_INPUT_RECORD_TOUCH_MOTION, event->device, event);
+
   double lx, ly;
   wlr_cursor_absolute_to_layout_coords (self->cursor, event->device,
                                         event->x, event->y, &lx, &ly);
@@ -1047,7 +1157,15 @@ phoc_cursor_handle_touch_motion (PhocCursor                    *self,
     self->seat->touch_x = lx;
     self->seat->touch_y = ly;
 
-    if (self->mode != PHOC_CURSOR_PASSTHROUGH) {
+    if (self->mode == PHOC_CURSOR_MOVE && priv->move_resampler) {
+      /* Applied when the next frame gets rendered, see on_render_start () */
+      phoc_touch_resampler_add_sample (priv->move_resampler, g_get_monotonic_time (), lx, ly);
+      priv->move_x = lx;
+      priv->move_y = ly;
+      priv->move_time_msec = event->time_msec;
+      priv->move_pending = TRUE;
+      wlr_output_schedule_frame (wlr_output);
+    } else if (self->mode != PHOC_CURSOR_PASSTHROUGH) {
       wlr_cursor_warp (self->cursor, NULL, lx, ly);
       phoc_cursor_update_position (self, event->time_msec);
     }
@@ -1061,6 +1179,8 @@ handle_touch_frame (struct wl_listener *listener, void *data)
   PhocCursor *self = PHOC_CURSOR (wl_container_of (listener, self, touch_frame));
   struct wlr_seat *wlr_seat = self->seat->seat;
 
+  phoc_input_record_event (phoc_server_get_default ()->input, PHOC_INPUT_RECORD_TOUCH_FRAME,
+                           NULL, NULL);
   wlr_seat_touch_notify_frame(wlr_seat);
 }
 
@@ -1132,6 +1252,7 @@ phoc_cursor_handle_request_set_cursor (PhocCursor
   wlr_cursor_set_surface (self->cursor, event->surface, event->hotspot_x,
                           event->hotspot_y);
   self->cursor_client = event->seat_client->client;
+  self->image_name = NULL;
 }
 
 void
@@ -49,7 +49,8 @@ typedef struct _PhocCursor {
   PhocCursorMode                    mode;
 
   // state from input (review if this is necessary)
-  struct wlr_xcursor_manager       *xcursor_manager;
+  struct wlr_xcursor_manager       *xcursor_manager; // owned by the desktop
+  const char                       *image_name;      // xcursor currently shown, if any
   struct wl_client                 *cursor_client;
   int                               offs_x, offs_y;
   int                               view_x, view_y, view_width, view_height;
@@ -4,9 +4,14 @@
 
 #define _POSIX_C_SOURCE 200112L
 #include <assert.h>
+#include <errno.h>
 #include <math.h>
+#include <signal.h>
 #include <stdlib.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include <time.h>
+#include <unistd.h>
 #include <wlr/config.h>
 #include <wlr/types/wlr_compositor.h>
 #include <wlr/types/wlr_cursor.h>
@@ -49,6 +54,10 @@
 
 #include "xdg-surface.h"
 
+#ifdef PHOC_XWAYLAND
+#include <xcb/res.h>
+#endif
+
 /**
  * PhocDesktop:
  *
@@ -472,10 +481,200 @@ static const char *atom_map[XWAYLAND_ATOM_LAST] = {
 	"_NET_WM_WINDOW_TYPE_DIALOG"
 };
 
+static void
+phoc_desktop_xwayland_set_cursor (PhocDesktop *self)
+{
+  struct wlr_xcursor *xcursor;
+
+  if (!wlr_xcursor_manager_load (self->xcursor_manager, 1))
+    g_critical ("Cannot load XWayland XCursor theme");
+
+  xcursor = wlr_xcursor_manager_get_xcursor (self->xcursor_manager, PHOC_XCURSOR_DEFAULT, 1);
+  if (xcursor != NULL) {
+    struct wlr_xcursor_image *image = xcursor->images[0];
+    wlr_xwayland_set_cursor (self->xwayland, image->buffer,
+                             image->width * 4, image->width, image->height, image->hotspot_x,
+                             image->hotspot_y);
+  }
+}
+
+#define PHOC_XWAYLAND_PREWARM_DELAY 3 /* s */
+
+/* Whether the Xwayland server is running (rather than waiting for a client) */
+static gboolean
+xwayland_server_running (PhocDesktop *self)
+{
+  return self->xwayland->server && self->xwayland->server->pid != 0;
+}
+
+
+/*
+ * Count the X11 clients other than the window manager and ourselves.
+ * Not every client has a window (e.g. clipboard tools or settings
+ * daemons) so we can't go by the surfaces. Returns -1 on errors.
+ *
+ * This blocks on Xwayland so it must not run on the main loop: Xwayland
+ * might in turn be waiting for us.
+ */
+static int
+xwayland_count_clients (void)
+{
+  const xcb_setup_t *setup;
+  xcb_connection_t *xcb_conn;
+  xcb_get_selection_owner_reply_t *owner;
+  xcb_res_query_clients_reply_t *reply;
+  xcb_res_client_iterator_t iter;
+  xcb_atom_t wm_s0;
+  xcb_intern_atom_reply_t *atom;
+  uint32_t mask, wm_base = 0;
+  int n = 0;
+
+  xcb_conn = xcb_connect (NULL, NULL);
+  if (xcb_connection_has_error (xcb_conn)) {
+    xcb_disconnect (xcb_conn);
+    return -1;
+  }
+
+  setup = xcb_get_setup (xcb_conn);
+  mask = setup->resource_id_mask;
+
+  /* The window manager is the one owning WM_S0 */
+  atom = xcb_intern_atom_reply (xcb_conn, xcb_intern_atom (xcb_conn, 1, strlen ("WM_S0"), "WM_S0"),
+                                NULL);
+  wm_s0 = atom ? atom->atom : XCB_ATOM_NONE;
+  free (atom);
+  if (wm_s0 != XCB_ATOM_NONE) {
+    owner = xcb_get_selection_owner_reply (xcb_conn, xcb_get_selection_owner (xcb_conn, wm_s0),
+                                           NULL);
+    if (owner)
+      wm_base = owner->owner & ~mask;
+    free (owner);
+  }
+
+  reply = xcb_res_query_clients_reply (xcb_conn, xcb_res_query_clients (xcb_conn), NULL);
+  if (reply == NULL) {
+    xcb_disconnect (xcb_conn);
+    return -1;
+  }
+
+  for (iter = xcb_res_query_clients_clients_iterator (reply); iter.rem; xcb_res_client_next (&iter)) {
+    uint32_t base = iter.data->resource_base & ~mask;
+
+    if (base != setup->resource_id_base && base != wm_base)
+      n++;
+  }
+
+  free (reply);
+  xcb_disconnect (xcb_conn);
+  return n;
+}
+
+
+static void
+xwayland_count_clients_thread (GTask        *task,
+                               gpointer      source_object,
+                               gpointer      task_data,
+                               GCancellable *cancellable)
+{
+  g_task_return_int (task, xwayland_count_clients ());
+}
+
+
+static void xwayland_update_idle_timeout (PhocDesktop *self);
+
+static void
+on_xwayland_clients_counted (GObject *source_object, GAsyncResult *res, gpointer data)
+{
+  g_autoptr (GError) err = NULL;
+  PhocDesktop *self;
+  pid_t pid;
+  gssize n_clients;
+
+  n_clients = g_task_propagate_int (G_TASK (res), &err);
+  /* The desktop is gone */
+  if (g_error_matches (err, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    return;
+
+  self = PHOC_DESKTOP (data);
+  pid = GPOINTER_TO_INT (g_task_get_task_data (G_TASK (res)));
+  g_clear_object (&self->xwayland_idle_cancel);
+
+  /* An X11 window showed up or the server got restarted in the meantime */
+  if (self->n_xwayland_surfaces || !xwayland_server_running (self) ||
+      self->xwayland->server->pid != pid) {
+    xwayland_update_idle_timeout (self);
+    return;
+  }
+
+  if (n_clients != 0) {
+    g_debug ("Not stopping Xwayland, %" G_GSSIZE_FORMAT " clients connected", n_clients);
+    /* Check again later */
+    xwayland_update_idle_timeout (self);
+    return;
+  }
+
+  /* wlroots starts listening on the X11 socket again once the server is gone */
+  g_message ("Stopping idle Xwayland");
+  kill (pid, SIGTERM);
+}
+
+
+static gboolean
+on_xwayland_idle_timeout (gpointer data)
+{
+  PhocDesktop *self = PHOC_DESKTOP (data);
+  g_autoptr (GTask) task = NULL;
+
+  self->xwayland_idle_id = 0;
+  if (self->n_xwayland_surfaces || !xwayland_server_running (self))
+    return G_SOURCE_REMOVE;
+
+  self->xwayland_idle_cancel = g_cancellable_new ();
+  task = g_task_new (NULL, self->xwayland_idle_cancel, on_xwayland_clients_counted, self);
+  g_task_set_source_tag (task, on_xwayland_idle_timeout);
+  g_task_set_task_data (task, GINT_TO_POINTER (self->xwayland->server->pid), NULL);
+  g_task_run_in_thread (task, xwayland_count_clients_thread);
+
+  return G_SOURCE_REMOVE;
+}
+
+
+static void
+xwayland_update_idle_timeout (PhocDesktop *self)
+{
+  guint timeout = self->config->xwayland_idle_timeout;
+
+  /* A non-lazy Xwayland would be restarted right away */
+  if (!timeout || !self->config->xwayland_lazy)
+    return;
+
+  /* Shutting down */
+  if (self->xwayland == NULL)
+    return;
+
+  if (self->n_xwayland_surfaces || !xwayland_server_running (self)) {
+    g_clear_handle_id (&self->xwayland_idle_id, g_source_remove);
+    return;
+  }
+
+  /* Already armed or counting clients */
+  if (self->xwayland_idle_id || self->xwayland_idle_cancel)
+    return;
+
+  self->xwayland_idle_id = g_timeout_add_seconds (timeout, on_xwayland_idle_timeout, self);
+  g_source_set_name_by_id (self->xwayland_idle_id, "[phoc] xwayland idle");
+}
+
+
 static
 void handle_xwayland_ready(struct wl_listener *listener, void *data) {
   PhocDesktop *desktop = wl_container_of (
         listener, desktop, xwayland_ready);
+  gint64 ts = g_get_monotonic_time ();
+
+  phoc_desktop_xwayland_set_cursor (desktop);
+  PHOC_LOG_PHASE (ts, "xwayland cursor");
+
   xcb_connection_t *xcb_conn = xcb_connect (NULL, NULL);
 
   int err = xcb_connection_has_error (xcb_conn);
@@ -506,6 +705,137 @@ void handle_xwayland_ready(struct wl_listener *listener, void *data) {
   }
 
   xcb_disconnect (xcb_conn);
+  PHOC_LOG_PHASE (ts, "xwayland atoms");
+
+  xwayland_update_idle_timeout (desktop);
+}
+
+typedef struct {
+  PhocDesktop        *desktop;
+  struct wl_listener  destroy;
+} PhocXWaylandSurfaceRef;
+
+
+static void
+handle_xwayland_surface_destroy (struct wl_listener *listener, void *data)
+{
+  PhocXWaylandSurfaceRef *ref = wl_container_of (listener, ref, destroy);
+  PhocDesktop *self = ref->desktop;
+
+  wl_list_remove (&ref->destroy.link);
+  g_free (ref);
+
+  g_assert (self->n_xwayland_surfaces > 0);
+  self->n_xwayland_surfaces--;
+  xwayland_update_idle_timeout (self);
+}
+
+
+static void
+handle_xwayland_new_surface (struct wl_listener *listener, void *data)
+{
+  PhocDesktop *self = wl_container_of (listener, self, xwayland_new_surface);
+  struct wlr_xwayland_surface *surface = data;
+  PhocXWaylandSurfaceRef *ref = g_new0 (PhocXWaylandSurfaceRef, 1);
+
+  ref->desktop = self;
+  ref->destroy.notify = handle_xwayland_surface_destroy;
+  wl_signal_add (&surface->events.destroy, &ref->destroy);
+
+  self->n_xwayland_surfaces++;
+  xwayland_update_idle_timeout (self);
+}
+
+
+static void
+xwayland_start_server (PhocDesktop *self)
+{
+  struct sockaddr_un addr = { .sun_family = AF_UNIX };
+  int fd;
+
+  /* A lazy Xwayland gets started on the first connection to its socket */
+  fd = socket (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+  if (fd < 0) {
+    g_warning ("Failed to create socket: %s", g_strerror (errno));
+    return;
+  }
+
+  snprintf (addr.sun_path, sizeof (addr.sun_path), "/tmp/.X11-unix/X%d",
+            self->xwayland->server->display);
+  if (connect (fd, (struct sockaddr *)&addr, sizeof (addr)) < 0 &&
+      errno != EINPROGRESS && errno != EAGAIN) {
+    g_warning ("Failed to start Xwayland: %s", g_strerror (errno));
+  }
+  close (fd);
+}
+
+
+static gboolean
+on_xwayland_prewarm (gpointer data)
+{
+  PhocDesktop *self = PHOC_DESKTOP (data);
+  gint64 idle = (g_get_monotonic_time () - self->last_input_activity) / G_USEC_PER_SEC;
+
+  self->xwayland_prewarm_id = 0;
+
+  /* Input since the timer got armed, wait for the remaining time */
+  if (idle < PHOC_XWAYLAND_PREWARM_DELAY) {
+    self->xwayland_prewarm_id = g_timeout_add_seconds_full (G_PRIORITY_LOW,
+                                                            PHOC_XWAYLAND_PREWARM_DELAY - idle,
+                                                            on_xwayland_prewarm, self, NULL);
+    g_source_set_name_by_id (self->xwayland_prewarm_id, "[phoc] xwayland prewarm");
+    return G_SOURCE_REMOVE;
+  }
+
+  self->xwayland_prewarmed = TRUE;
+  if (xwayland_server_running (self))
+    return G_SOURCE_REMOVE;
+
+  g_debug ("Prewarming Xwayland");
+  xwayland_start_server (self);
+
+  return G_SOURCE_REMOVE;
+}
+
+
+static void
+handle_input_activity (struct wl_listener *listener, void *data)
+{
+  PhocDesktop *self = wl_container_of (listener, self, input_activity);
+
+  self->last_input_activity = g_get_monotonic_time ();
+}
+
+
+static void
+on_shell_state_changed (PhocDesktop *self, GParamSpec *pspec, PhocPhoshPrivate *phosh)
+{
+  PhocPhoshPrivateShellState state = phoc_phosh_private_get_shell_state (phosh);
+
+  /* Only prewarm once, an idle shutdown should stick */
+  if (state != PHOC_PHOSH_PRIVATE_SHELL_STATE_UP || self->xwayland_prewarmed ||
+      self->xwayland_prewarm_id)
+    return;
+
+  self->xwayland_prewarm_id = g_timeout_add_seconds_full (G_PRIORITY_LOW,
+                                                          PHOC_XWAYLAND_PREWARM_DELAY,
+                                                          on_xwayland_prewarm, self, NULL);
+  g_source_set_name_by_id (self->xwayland_prewarm_id, "[phoc] xwayland prewarm");
+}
+
+
+static void
+phoc_desktop_setup_xwayland_prewarm (PhocDesktop *self)
+{
+  if (!self->xwayland || !self->config->xwayland_prewarm)
+    return;
+
+  self->input_activity.notify = handle_input_activity;
+  wl_signal_add (&self->idle->events.activity_notify, &self->input_activity);
+
+  g_signal_connect_object (self->phosh, "notify::shell-state",
+                           G_CALLBACK (on_shell_state_changed),
+                           self, G_CONNECT_SWAPPED);
 }
 
 static
@@ -566,13 +896,9 @@ static void
 phoc_desktop_setup_xwayland (PhocDesktop *self)
 {
 #ifdef PHOC_XWAYLAND
-  const char *cursor_default = PHOC_XCURSOR_DEFAULT;
   PhocConfig *config = self->config;
   PhocServer *server = phoc_server_get_default ();
 
-  self->xcursor_manager = wlr_xcursor_manager_create(NULL, PHOC_XCURSOR_SIZE);
-  g_return_if_fail (self->xcursor_manager);
-
   if (config->xwayland) {
     self->xwayland = wlr_xwayland_create(server->wl_display,
 					 server->compositor, config->xwayland_lazy);
@@ -594,29 +920,80 @@ phoc_desktop_setup_xwayland (PhocDesktop *self)
 		  &self->xwayland_remove_startup_id);
     self->xwayland_remove_startup_id.notify = handle_xwayland_remove_startup_id;
 
-    g_setenv ("DISPLAY", self->xwayland->display_name, true);
-
-    if (!wlr_xcursor_manager_load(self->xcursor_manager, 1))
-      g_critical ("Cannot load XWayland XCursor theme");
+    wl_signal_add (&self->xwayland->events.new_surface, &self->xwayland_new_surface);
+    self->xwayland_new_surface.notify = handle_xwayland_new_surface;
 
-    struct wlr_xcursor *xcursor = wlr_xcursor_manager_get_xcursor(
-								  self->xcursor_manager, cursor_default, 1);
-    if (xcursor != NULL) {
-      struct wlr_xcursor_image *image = xcursor->images[0];
-      wlr_xwayland_set_cursor(self->xwayland, image->buffer,
-			      image->width * 4, image->width, image->height, image->hotspot_x,
-			      image->hotspot_y);
-    }
+    g_setenv ("DISPLAY", self->xwayland->display_name, true);
+    /* The cursor theme is only loaded once Xwayland is ready */
   }
 #endif
 }
 
 
+static void
+phoc_desktop_create_deferred_globals (PhocDesktop *self)
+{
+  PhocServer *server = phoc_server_get_default ();
+  struct wlr_xdg_foreign_registry *foreign_registry;
+  gint64 ts = g_get_monotonic_time ();
+
+  g_debug ("Creating deferred globals");
+
+  phoc_desktop_get_tablet_manager (self);
+  PHOC_LOG_PHASE (ts, "tablet-v2");
+
+  self->gamma_control_manager_v1 = wlr_gamma_control_manager_v1_create(server->wl_display);
+  PHOC_LOG_PHASE (ts, "gamma-control");
+
+  self->export_dmabuf_manager_v1 =
+    wlr_export_dmabuf_manager_v1_create(server->wl_display);
+  PHOC_LOG_PHASE (ts, "export-dmabuf");
+
+  foreign_registry = wlr_xdg_foreign_registry_create(server->wl_display);
+  wlr_xdg_foreign_v1_create(server->wl_display, foreign_registry);
+  wlr_xdg_foreign_v2_create(server->wl_display, foreign_registry);
+  PHOC_LOG_PHASE (ts, "xdg-foreign");
+
+  wlr_data_control_manager_v1_create(server->wl_display);
+  PHOC_LOG_PHASE (ts, "data-control");
+}
+
+
+static gboolean
+create_deferred_globals_cb (gpointer data)
+{
+  PhocDesktop *self = PHOC_DESKTOP (data);
+  PhocServer *server = phoc_server_get_default ();
+
+  self->deferred_globals_id = 0;
+  g_clear_signal_handler (&self->first_frame_id, phoc_server_get_renderer (server));
+
+  phoc_desktop_create_deferred_globals (self);
+
+  return G_SOURCE_REMOVE;
+}
+
+
+static void
+on_first_frame (PhocDesktop *self, PhocOutput *output, PhocRenderer *renderer)
+{
+  g_assert (PHOC_IS_DESKTOP (self));
+
+  g_clear_signal_handler (&self->first_frame_id, renderer);
+
+  /* Don't delay the current frame, create the globals once we're idle */
+  g_clear_handle_id (&self->deferred_globals_id, g_source_remove);
+  self->deferred_globals_id = g_idle_add (create_deferred_globals_cb, self);
+  g_source_set_name_by_id (self->deferred_globals_id, "[phoc] create deferred globals");
+}
+
+
 static void
 phoc_desktop_constructed (GObject *object)
 {
   PhocDesktop *self = PHOC_DESKTOP (object);
   PhocServer *server = phoc_server_get_default ();
+  gint64 ts = g_get_monotonic_time ();
 
   G_OBJECT_CLASS (phoc_desktop_parent_class)->constructed (object);
 
@@ -630,30 +1007,31 @@ phoc_desktop_constructed (GObject *object)
   wlr_xdg_output_manager_v1_create(server->wl_display, self->layout);
   self->layout_change.notify = handle_layout_change;
   wl_signal_add(&self->layout->events.change, &self->layout_change);
+  PHOC_LOG_PHASE (ts, "xdg-output");
 
   self->xdg_shell = wlr_xdg_shell_create(server->wl_display);
   wl_signal_add(&self->xdg_shell->events.new_surface,
 		&self->xdg_shell_surface);
   self->xdg_shell_surface.notify = handle_xdg_shell_surface;
+  PHOC_LOG_PHASE (ts, "xdg-shell");
 
   self->layer_shell = wlr_layer_shell_v1_create(server->wl_display);
   wl_signal_add(&self->layer_shell->events.new_surface,
 		&self->layer_shell_surface);
   self->layer_shell_surface.notify = handle_layer_shell_surface;
   self->layer_shell_effects = phoc_layer_shell_effects_new ();
-
-  self->tablet_v2 = wlr_tablet_v2_create(server->wl_display);
+  PHOC_LOG_PHASE (ts, "layer-shell");
 
   char cursor_size_fmt[16];
   snprintf(cursor_size_fmt, sizeof(cursor_size_fmt),
 	   "%d", PHOC_XCURSOR_SIZE);
   g_setenv("XCURSOR_SIZE", cursor_size_fmt, 1);
+  self->xcursor_manager = wlr_xcursor_manager_create (NULL, PHOC_XCURSOR_SIZE);
+  g_assert (self->xcursor_manager);
 
   phoc_desktop_setup_xwayland (self);
+  PHOC_LOG_PHASE (ts, "xwayland");
 
-  self->gamma_control_manager_v1 = wlr_gamma_control_manager_v1_create(server->wl_display);
-  self->export_dmabuf_manager_v1 =
-    wlr_export_dmabuf_manager_v1_create(server->wl_display);
   self->server_decoration_manager =
     wlr_server_decoration_manager_create(server->wl_display);
   wlr_server_decoration_manager_set_default_mode(self->server_decoration_manager,
@@ -669,14 +1047,20 @@ phoc_desktop_constructed (GObject *object)
   self->input_inhibit_deactivate.notify = input_inhibit_deactivate;
   wl_signal_add(&self->input_inhibit->events.deactivate,
 		&self->input_inhibit_deactivate);
+  PHOC_LOG_PHASE (ts, "decoration, idle, selection, inhibit");
 
   self->input_method =
     wlr_input_method_manager_v2_create(server->wl_display);
 
   self->text_input = wlr_text_input_manager_v3_create(server->wl_display);
+  PHOC_LOG_PHASE (ts, "input-method, text-input");
 
   self->gtk_shell = phoc_gtk_shell_create(self, server->wl_display);
   self->phosh = phoc_phosh_private_new ();
+#ifdef PHOC_XWAYLAND
+  phoc_desktop_setup_xwayland_prewarm (self);
+#endif
+  PHOC_LOG_PHASE (ts, "gtk-shell, phosh-private");
 
   self->xdg_activation_v1 = wlr_xdg_activation_v1_create (server->wl_display);
   self->xdg_activation_v1_request_activate.notify = phoc_xdg_activation_v1_handle_request_activate;
@@ -693,6 +1077,7 @@ phoc_desktop_constructed (GObject *object)
   wl_signal_add(&self->virtual_pointer->events.new_virtual_pointer,
 		&self->virtual_pointer_new);
   self->virtual_pointer_new.notify = phoc_handle_virtual_pointer;
+  PHOC_LOG_PHASE (ts, "xdg-activation, virtual-keyboard, virtual-pointer");
 
   self->screencopy = wlr_screencopy_manager_v1_create(server->wl_display);
 
@@ -702,11 +1087,8 @@ phoc_desktop_constructed (GObject *object)
 		&self->xdg_toplevel_decoration);
   self->xdg_toplevel_decoration.notify = handle_xdg_toplevel_decoration;
   wlr_viewporter_create(server->wl_display);
-
-  struct wlr_xdg_foreign_registry *foreign_registry =
-                wlr_xdg_foreign_registry_create(server->wl_display);
-  wlr_xdg_foreign_v1_create(server->wl_display, foreign_registry);
-  wlr_xdg_foreign_v2_create(server->wl_display, foreign_registry);
+  self->fractional_scale_manager = phoc_fractional_scale_manager_new ();
+  PHOC_LOG_PHASE (ts, "screencopy, xdg-decoration, viewporter, fractional-scale");
 
   self->pointer_constraints =
     wlr_pointer_constraints_v1_create(server->wl_display);
@@ -722,6 +1104,7 @@ phoc_desktop_constructed (GObject *object)
     wlr_relative_pointer_manager_v1_create(server->wl_display);
   self->pointer_gestures =
     wlr_pointer_gestures_v1_create(server->wl_display);
+  PHOC_LOG_PHASE (ts, "pointer, presentation, foreign-toplevel");
 
   self->output_manager_v1 =
     wlr_output_manager_v1_create(server->wl_display);
@@ -738,8 +1121,19 @@ phoc_desktop_constructed (GObject *object)
     phoc_output_handle_output_power_manager_set_mode;
   wl_signal_add(&self->output_power_manager_v1->events.set_mode,
 		&self->output_power_manager_set_mode);
-
-  wlr_data_control_manager_v1_create(server->wl_display);
+  PHOC_LOG_PHASE (ts, "output-management, output-power");
+
+  /* Globals that are rarely used get created once the first frame is
+   * out (or on demand) so the shell shows up as early as possible */
+  self->first_frame_id = g_signal_connect_object (phoc_server_get_renderer (server),
+                                                  "render-end",
+                                                  G_CALLBACK (on_first_frame),
+                                                  self,
+                                                  G_CONNECT_SWAPPED);
+  self->deferred_globals_id = g_timeout_add (PHOC_DEFERRED_GLOBALS_TIMEOUT,
+                                             create_deferred_globals_cb,
+                                             self);
+  g_source_set_name_by_id (self->deferred_globals_id, "[phoc] create deferred globals");
 
   self->settings = g_settings_new ("sm.puri.phoc");
   g_signal_connect_swapped(self->settings, "changed::auto-maximize",
@@ -748,6 +1142,7 @@ phoc_desktop_constructed (GObject *object)
   g_signal_connect_swapped(self->settings, "changed::scale-to-fit",
 			   G_CALLBACK (scale_to_fit_changed_cb), self);
   scale_to_fit_changed_cb(self, "scale-to-fit", self->settings);
+  PHOC_LOG_PHASE (ts, "settings");
 }
 
 
@@ -772,23 +1167,32 @@ phoc_desktop_finalize (GObject *object)
   wl_list_remove (&self->output_power_manager_set_mode.link);
   wl_list_remove (&self->xdg_activation_v1_request_activate.link);
 
+  g_clear_handle_id (&self->deferred_globals_id, g_source_remove);
+
 #ifdef PHOC_XWAYLAND
   /* Disconnect XWayland listener before shutting it down */
   if (self->xwayland) {
     wl_list_remove (&self->xwayland_surface.link);
     wl_list_remove (&self->xwayland_ready.link);
     wl_list_remove (&self->xwayland_remove_startup_id.link);
+    wl_list_remove (&self->xwayland_new_surface.link);
   }
+  wl_list_remove (&self->input_activity.link);
+  g_clear_handle_id (&self->xwayland_prewarm_id, g_source_remove);
+  g_clear_handle_id (&self->xwayland_idle_id, g_source_remove);
+  g_cancellable_cancel (self->xwayland_idle_cancel);
+  g_clear_object (&self->xwayland_idle_cancel);
 
-  g_clear_pointer (&self->xcursor_manager, wlr_xcursor_manager_destroy);
   // We need to shutdown Xwayland before disconnecting all clients, otherwise
   // wlroots will restart it automatically.
   g_clear_pointer (&self->xwayland, wlr_xwayland_destroy);
 #endif
+  g_clear_pointer (&self->xcursor_manager, wlr_xcursor_manager_destroy);
 
   g_clear_object (&self->phosh);
   g_clear_pointer (&self->gtk_shell, phoc_gtk_shell_destroy);
   g_clear_object (&self->layer_shell_effects);
+  g_clear_object (&self->fractional_scale_manager);
   g_clear_pointer (&self->layout, wlr_output_layout_destroy);
 
   g_hash_table_remove_all (self->input_output_map);
@@ -829,6 +1233,9 @@ phoc_desktop_init (PhocDesktop *self)
                                                   g_str_equal,
                                                   g_free,
                                                   NULL);
+#ifdef PHOC_XWAYLAND
+  wl_list_init (&self->input_activity.link);
+#endif
 }
 
 
@@ -862,10 +1269,8 @@ phoc_desktop_toggle_output_blank (PhocDesktop *self)
   wl_list_for_each(output, &self->outputs, link) {
     if (!wlr_output_layout_get (self->layout, output->wlr_output))
       continue;
-    wlr_output_enable (output->wlr_output, enable);
-    wlr_output_commit (output->wlr_output);
-    if (enable)
-      phoc_output_damage_whole(output);
+    if (!phoc_output_set_blank (output, !enable))
+      g_warning ("Failed to %s %s", enable ? "unblank" : "blank", output->wlr_output->name);
   }
 }
 
@@ -916,8 +1321,15 @@ phoc_desktop_get_auto_maximize (PhocDesktop *self)
 void
 phoc_desktop_set_scale_to_fit (PhocDesktop *self, gboolean enable)
 {
+    PhocView *view;
+
     g_debug ("scale to fit: %d", enable);
+    if (self->scale_to_fit == enable)
+      return;
+
     self->scale_to_fit = enable;
+    wl_list_for_each (view, &self->views, link)
+      view_update_scale (view);
 }
 
 gboolean
@@ -1024,6 +1436,28 @@ phoc_desktop_get_builtin_output (PhocDesktop *self)
   return NULL;
 }
 
+/**
+ * phoc_desktop_get_tablet_manager:
+ * @self: The desktop
+ *
+ * Get the tablet manager. The global is created on first use so
+ * it doesn't slow down startup when there's no tablet.
+ *
+ * Returns: (transfer none): The tablet manager
+ */
+struct wlr_tablet_manager_v2 *
+phoc_desktop_get_tablet_manager (PhocDesktop *self)
+{
+  PhocServer *server = phoc_server_get_default ();
+
+  g_assert (PHOC_IS_DESKTOP (self));
+
+  if (G_UNLIKELY (self->tablet_v2 == NULL))
+    self->tablet_v2 = wlr_tablet_v2_create (server->wl_display);
+
+  return self->tablet_v2;
+}
+
 /**
  * phoc_desktop_get_draggable_layer_surface:
  * @self: The `PhocDesktop` to look the surface up for
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "config.h"
+#include "fractional-scale.h"
 #include "gtk-shell.h"
 #include "layer-shell-effects.h"
 #include "phosh-private.h"
@@ -41,6 +42,9 @@
 
 #define PHOC_TYPE_DESKTOP (phoc_desktop_get_type())
 
+/* Fallback (in ms) for creating deferred globals when no frame gets rendered */
+#define PHOC_DEFERRED_GLOBALS_TIMEOUT 2000
+
 G_DECLARE_FINAL_TYPE (PhocDesktop, phoc_desktop, PHOC, DESKTOP, GObject);
 
 struct _PhocDesktop {
@@ -92,15 +96,31 @@ struct _PhocDesktop {
 	struct wl_listener output_power_manager_set_mode;
 	struct wl_listener xdg_activation_v1_request_activate;
 
-#ifdef PHOC_XWAYLAND
+	/* Cursor images shared by all seats and Xwayland */
 	struct wlr_xcursor_manager *xcursor_manager;
+
+#ifdef PHOC_XWAYLAND
 	struct wlr_xwayland *xwayland;
 	struct wl_listener xwayland_surface;
 	struct wl_listener xwayland_ready;
 	struct wl_listener xwayland_remove_startup_id;
 	xcb_atom_t xwayland_atoms[XWAYLAND_ATOM_LAST];
+
+	/* Background start and idle shutdown of lazy Xwayland */
+	struct wl_listener xwayland_new_surface;
+	struct wl_listener input_activity;
+	gint64 last_input_activity;
+	guint n_xwayland_surfaces;
+	guint xwayland_prewarm_id;
+	guint xwayland_idle_id;
+	GCancellable *xwayland_idle_cancel;
+	gboolean xwayland_prewarmed;
 #endif
 
+	/* Globals created after the first frame */
+	guint deferred_globals_id;
+	gulong first_frame_id;
+
 	GSettings *settings;
 	gboolean maximize, scale_to_fit;
 	GHashTable *input_output_map;
@@ -110,6 +130,7 @@ struct _PhocDesktop {
 	PhocGtkShell *gtk_shell;
         /* Protocols that should go upstream */
 	PhocLayerShellEffects *layer_shell_effects;
+	PhocFractionalScaleManager *fractional_scale_manager;
 };
 
 PhocDesktop *phoc_desktop_new (PhocConfig *config);
@@ -123,6 +144,7 @@ PhocOutput  *phoc_desktop_find_output (PhocDesktop *self,
                                        const char  *model,
                                        const char  *serial);
 PhocOutput *phoc_desktop_get_builtin_output (PhocDesktop *self);
+struct wlr_tablet_manager_v2 *phoc_desktop_get_tablet_manager (PhocDesktop *self);
 
 struct wlr_surface *phoc_desktop_surface_at(PhocDesktop *desktop,
 		double lx, double ly, double *sx, double *sy,
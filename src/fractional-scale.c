@@ -0,0 +1,292 @@
+/*
+ * Copyright (C) 2022 Purism SPC
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "phoc-fractional-scale"
+
+#include "config.h"
+#include "fractional-scale.h"
+#include "server.h"
+
+#include <fractional-scale-v1-protocol.h>
+#include <math.h>
+#include <wlr/types/wlr_compositor.h>
+
+#define FRACTIONAL_SCALE_VERSION 1
+/* Scales are sent as numerator of a fraction with this denominator */
+#define FRACTIONAL_SCALE_DENOMINATOR 120
+
+/**
+ * PhocFractionalScaleManager:
+ *
+ * Implements wp_fractional_scale_manager_v1 so clients learn about
+ * the outputs' real (e.g. 1.75) scale instead of only the rounded up
+ * integer one. Combined with wp_viewporter they can then submit
+ * buffers that map 1:1 to output pixels instead of having the
+ * renderer downsample them on every frame.
+ */
+struct _PhocFractionalScaleManager {
+  GObject           parent;
+
+  struct wl_global *global;
+  /* wlr_surface → PhocFractionalScale */
+  GHashTable       *scales_by_surface;
+};
+
+G_DEFINE_TYPE (PhocFractionalScaleManager, phoc_fractional_scale_manager, G_TYPE_OBJECT)
+
+typedef struct _PhocFractionalScale {
+  struct wl_resource         *resource;
+  struct wlr_surface         *wlr_surface;
+  PhocFractionalScaleManager *manager;
+  /* Last sent scale, 0 if none was sent yet */
+  guint32                     scale;
+
+  struct wl_listener          surface_commit;
+  struct wl_listener          surface_destroy;
+} PhocFractionalScale;
+
+
+static void
+resource_handle_destroy (struct wl_client *client, struct wl_resource *resource)
+{
+  wl_resource_destroy (resource);
+}
+
+
+/* The largest scale of the outputs the surface is on */
+static guint32
+fractional_scale_compute (PhocFractionalScale *fractional_scale)
+{
+  struct wlr_surface_output *surface_output;
+  float scale = 0.0;
+
+  wl_list_for_each (surface_output, &fractional_scale->wlr_surface->current_outputs, link)
+    scale = MAX (scale, surface_output->output->scale);
+
+  return round (scale * FRACTIONAL_SCALE_DENOMINATOR);
+}
+
+
+static void
+fractional_scale_update (PhocFractionalScale *fractional_scale)
+{
+  guint32 scale = fractional_scale_compute (fractional_scale);
+
+  /* Not on any output yet */
+  if (scale == 0 || scale == fractional_scale->scale)
+    return;
+
+  g_debug ("Preferred scale of surface %p: %u/%d", fractional_scale->wlr_surface,
+           scale, FRACTIONAL_SCALE_DENOMINATOR);
+  fractional_scale->scale = scale;
+  wp_fractional_scale_v1_send_preferred_scale (fractional_scale->resource, scale);
+}
+
+
+static void
+fractional_scale_destroy (PhocFractionalScale *fractional_scale)
+{
+  if (fractional_scale == NULL)
+    return;
+
+  wl_list_remove (&fractional_scale->surface_commit.link);
+  wl_list_remove (&fractional_scale->surface_destroy.link);
+  g_hash_table_remove (fractional_scale->manager->scales_by_surface,
+                       fractional_scale->wlr_surface);
+
+  wl_resource_set_user_data (fractional_scale->resource, NULL);
+  g_free (fractional_scale);
+}
+
+
+static void
+fractional_scale_handle_resource_destroy (struct wl_resource *resource)
+{
+  fractional_scale_destroy (wl_resource_get_user_data (resource));
+}
+
+
+static void
+fractional_scale_handle_surface_commit (struct wl_listener *listener, void *data)
+{
+  PhocFractionalScale *fractional_scale =
+    wl_container_of (listener, fractional_scale, surface_commit);
+
+  /* Surfaces usually enter outputs when they get mapped */
+  fractional_scale_update (fractional_scale);
+}
+
+
+static void
+fractional_scale_handle_surface_destroy (struct wl_listener *listener, void *data)
+{
+  PhocFractionalScale *fractional_scale =
+    wl_container_of (listener, fractional_scale, surface_destroy);
+
+  /* Keep the resource around but inert */
+  fractional_scale_destroy (fractional_scale);
+}
+
+
+static const struct wp_fractional_scale_v1_interface fractional_scale_impl = {
+  .destroy = resource_handle_destroy,
+};
+
+
+static void
+handle_get_fractional_scale (struct wl_client   *client,
+                             struct wl_resource *manager_resource,
+                             uint32_t            id,
+                             struct wl_resource *surface_resource)
+{
+  PhocFractionalScaleManager *self = wl_resource_get_user_data (manager_resource);
+  struct wlr_surface *wlr_surface = wlr_surface_from_resource (surface_resource);
+  PhocFractionalScale *fractional_scale;
+
+  g_assert (PHOC_IS_FRACTIONAL_SCALE_MANAGER (self));
+
+  if (g_hash_table_contains (self->scales_by_surface, wlr_surface)) {
+    wl_resource_post_error (manager_resource,
+                            WP_FRACTIONAL_SCALE_MANAGER_V1_ERROR_FRACTIONAL_SCALE_EXISTS,
+                            "wl_surface@%d already has a fractional scale object",
+                            wl_resource_get_id (surface_resource));
+    return;
+  }
+
+  fractional_scale = g_new0 (PhocFractionalScale, 1);
+  fractional_scale->resource = wl_resource_create (client, &wp_fractional_scale_v1_interface,
+                                                   wl_resource_get_version (manager_resource),
+                                                   id);
+  if (fractional_scale->resource == NULL) {
+    g_free (fractional_scale);
+    wl_client_post_no_memory (client);
+    return;
+  }
+
+  fractional_scale->wlr_surface = wlr_surface;
+  fractional_scale->manager = self;
+  wl_resource_set_implementation (fractional_scale->resource,
+                                  &fractional_scale_impl,
+                                  fractional_scale,
+                                  fractional_scale_handle_resource_destroy);
+
+  fractional_scale->surface_commit.notify = fractional_scale_handle_surface_commit;
+  wl_signal_add (&wlr_surface->events.commit, &fractional_scale->surface_commit);
+  fractional_scale->surface_destroy.notify = fractional_scale_handle_surface_destroy;
+  wl_signal_add (&wlr_surface->events.destroy, &fractional_scale->surface_destroy);
+
+  g_hash_table_insert (self->scales_by_surface, wlr_surface, fractional_scale);
+
+  fractional_scale_update (fractional_scale);
+}
+
+
+static const struct wp_fractional_scale_manager_v1_interface fractional_scale_manager_impl = {
+  .destroy = resource_handle_destroy,
+  .get_fractional_scale = handle_get_fractional_scale,
+};
+
+
+static void
+fractional_scale_manager_bind (struct wl_client *client, void *data, uint32_t version, uint32_t id)
+{
+  PhocFractionalScaleManager *self = PHOC_FRACTIONAL_SCALE_MANAGER (data);
+  struct wl_resource *resource;
+
+  resource = wl_resource_create (client, &wp_fractional_scale_manager_v1_interface, version, id);
+  if (resource == NULL) {
+    wl_client_post_no_memory (client);
+    return;
+  }
+
+  wl_resource_set_implementation (resource, &fractional_scale_manager_impl, self, NULL);
+}
+
+
+static void
+phoc_fractional_scale_manager_finalize (GObject *object)
+{
+  PhocFractionalScaleManager *self = PHOC_FRACTIONAL_SCALE_MANAGER (object);
+  GHashTableIter iter;
+  PhocFractionalScale *fractional_scale;
+
+  wl_global_destroy (self->global);
+
+  g_hash_table_iter_init (&iter, self->scales_by_surface);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&fractional_scale)) {
+    g_hash_table_iter_steal (&iter);
+    wl_list_remove (&fractional_scale->surface_commit.link);
+    wl_list_remove (&fractional_scale->surface_destroy.link);
+    wl_resource_set_user_data (fractional_scale->resource, NULL);
+    g_free (fractional_scale);
+  }
+  g_hash_table_destroy (self->scales_by_surface);
+
+  G_OBJECT_CLASS (phoc_fractional_scale_manager_parent_class)->finalize (object);
+}
+
+
+static void
+phoc_fractional_scale_manager_class_init (PhocFractionalScaleManagerClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = phoc_fractional_scale_manager_finalize;
+}
+
+
+static void
+phoc_fractional_scale_manager_init (PhocFractionalScaleManager *self)
+{
+  struct wl_display *display = phoc_server_get_default ()->wl_display;
+
+  self->scales_by_surface = g_hash_table_new (g_direct_hash, g_direct_equal);
+  self->global = wl_global_create (display, &wp_fractional_scale_manager_v1_interface,
+                                   FRACTIONAL_SCALE_VERSION, self, fractional_scale_manager_bind);
+}
+
+
+PhocFractionalScaleManager *
+phoc_fractional_scale_manager_new (void)
+{
+  return PHOC_FRACTIONAL_SCALE_MANAGER (g_object_new (PHOC_TYPE_FRACTIONAL_SCALE_MANAGER, NULL));
+}
+
+/**
+ * phoc_fractional_scale_manager_update_scales:
+ * @self: The fractional scale manager
+ *
+ * Sends the preferred scale to all surfaces where it changed, e.g.
+ * because an output's scale changed.
+ */
+void
+phoc_fractional_scale_manager_update_scales (PhocFractionalScaleManager *self)
+{
+  GHashTableIter iter;
+  PhocFractionalScale *fractional_scale;
+
+  g_assert (PHOC_IS_FRACTIONAL_SCALE_MANAGER (self));
+
+  g_hash_table_iter_init (&iter, self->scales_by_surface);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&fractional_scale))
+    fractional_scale_update (fractional_scale);
+}
+
+/**
+ * phoc_fractional_scale_manager_has_surface:
+ * @self: The fractional scale manager
+ * @surface: A surface
+ *
+ * Returns: %TRUE if the client uses fractional scaling for @surface
+ */
+gboolean
+phoc_fractional_scale_manager_has_surface (PhocFractionalScaleManager *self,
+                                           struct wlr_surface         *surface)
+{
+  g_assert (PHOC_IS_FRACTIONAL_SCALE_MANAGER (self));
+
+  return g_hash_table_contains (self->scales_by_surface, surface);
+}
@@ -0,0 +1,24 @@
+/*
+ * Copyright (C) 2022 Purism SPC
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <glib-object.h>
+#include <wlr/types/wlr_surface.h>
+
+G_BEGIN_DECLS
+
+#define PHOC_TYPE_FRACTIONAL_SCALE_MANAGER (phoc_fractional_scale_manager_get_type ())
+
+G_DECLARE_FINAL_TYPE (PhocFractionalScaleManager, phoc_fractional_scale_manager,
+                      PHOC, FRACTIONAL_SCALE_MANAGER, GObject)
+
+PhocFractionalScaleManager *phoc_fractional_scale_manager_new            (void);
+void                        phoc_fractional_scale_manager_update_scales  (PhocFractionalScaleManager *self);
+gboolean                    phoc_fractional_scale_manager_has_surface    (PhocFractionalScaleManager *self,
+                                                                          struct wlr_surface         *surface);
+
+G_END_DECLS
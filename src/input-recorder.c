@@ -0,0 +1,427 @@
+/*
+ * Copyright (C) 2022 Purism SPC
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "phoc-input-recorder"
+
+#include "config.h"
+
+#include "input-recorder.h"
+
+#include <gio/gio.h>
+#include <string.h>
+#include <wlr/types/wlr_keyboard.h>
+#include <wlr/types/wlr_pointer.h>
+#include <wlr/types/wlr_switch.h>
+#include <wlr/types/wlr_touch.h>
+
+/**
+ * PhocInputRecorder:
+ *
+ * Writes the input events entering the #PhocCursor and #PhocKeyboard
+ * handlers to a compact binary file so they can be fed back later
+ * via #PhocInputReplay, e.g. to profile a trace captured on a device
+ * on the headless backend.
+ *
+ * Devices are recorded the first time one of their events is seen
+ * and referenced by index afterwards. Frame events don't carry a
+ * device so they refer to the last pointer or touch device. A device
+ * showing up again after being destroyed (or a new one reusing its
+ * address) gets recorded anew.
+ *
+ * Tablet tool and pad events aren't recorded (and tablets hence not
+ * replayed) as their state (tools, proximity, axes) doesn't fit the
+ * per event records.
+ */
+
+struct _PhocInputRecorder {
+  GOutputStream *stream;
+  GHashTable    *devices;        /* struct wlr_input_device * -> PhocInputRecorderDevice */
+  guint          n_devices;
+  guint8         last_pointer;
+  guint8         last_touch;
+  guint32        last_time;
+  guint          n_events;
+  gboolean       failed;
+};
+
+typedef struct {
+  PhocInputRecorder       *recorder;
+  struct wlr_input_device *device;
+  guint8                   index;
+  struct wl_listener       destroy;
+} PhocInputRecorderDevice;
+
+
+static void
+recorder_device_free (PhocInputRecorderDevice *recorder_device)
+{
+  wl_list_remove (&recorder_device->destroy.link);
+  g_free (recorder_device);
+}
+
+
+static void
+handle_device_destroy (struct wl_listener *listener, void *data)
+{
+  PhocInputRecorderDevice *recorder_device = wl_container_of (listener, recorder_device, destroy);
+
+  g_hash_table_remove (recorder_device->recorder->devices, recorder_device->device);
+}
+
+
+static gboolean
+write_record (PhocInputRecorder *self,
+              guint32            time_msec,
+              guint8             type,
+              guint8             device,
+              gconstpointer      payload,
+              gsize              size)
+{
+  g_autoptr (GError) err = NULL;
+  PhocInputRecordHeader header = {
+    .time_msec = time_msec,
+    .type = type,
+    .device = device,
+    .size = size,
+  };
+
+  if (self->failed)
+    return FALSE;
+
+  if (!g_output_stream_write_all (self->stream, &header, sizeof (header), NULL, NULL, &err) ||
+      (size && !g_output_stream_write_all (self->stream, payload, size, NULL, NULL, &err))) {
+    g_warning ("Failed to record input, stopping: %s", err->message);
+    self->failed = TRUE;
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+
+static guint8
+lookup_device (PhocInputRecorder *self, struct wlr_input_device *device)
+{
+  g_autofree PhocInputRecordDevice *payload = NULL;
+  PhocInputRecorderDevice *recorder_device;
+  guint index;
+  gsize len;
+
+  if (device == NULL)
+    return PHOC_INPUT_RECORD_NO_DEVICE;
+
+  recorder_device = g_hash_table_lookup (self->devices, device);
+  if (recorder_device)
+    return recorder_device->index;
+
+  index = self->n_devices;
+  if (index >= PHOC_INPUT_RECORD_NO_DEVICE) {
+    g_warning_once ("Too many input devices, not recording %s", device->name);
+    return PHOC_INPUT_RECORD_NO_DEVICE;
+  }
+
+  len = device->name ? strlen (device->name) : 0;
+  payload = g_malloc0 (sizeof (PhocInputRecordDevice) + len);
+  payload->type = device->type;
+  memcpy (payload->name, device->name, len);
+
+  if (!write_record (self, self->last_time, PHOC_INPUT_RECORD_DEVICE, index,
+                     payload, sizeof (PhocInputRecordDevice) + len))
+    return PHOC_INPUT_RECORD_NO_DEVICE;
+
+  recorder_device = g_new0 (PhocInputRecorderDevice, 1);
+  recorder_device->recorder = self;
+  recorder_device->device = device;
+  recorder_device->index = index;
+  recorder_device->destroy.notify = handle_device_destroy;
+  wl_signal_add (&device->events.destroy, &recorder_device->destroy);
+  g_hash_table_insert (self->devices, device, recorder_device);
+  self->n_devices++;
+  g_debug ("Recording %s as device %u", device->name, index);
+
+  return index;
+}
+
+/**
+ * phoc_input_recorder_new:
+ * @path: The file to record to
+ * @error: Return location for an error
+ *
+ * Returns: A new recorder or %NULL if @path can't be written
+ */
+PhocInputRecorder *
+phoc_input_recorder_new (const char *path, GError **error)
+{
+  g_autoptr (GFile) file = g_file_new_for_path (path);
+  g_autoptr (GFileOutputStream) out = NULL;
+  guint32 version = PHOC_INPUT_RECORDING_VERSION;
+  PhocInputRecorder *self;
+  GOutputStream *stream;
+
+  out = g_file_replace (file, NULL, FALSE, G_FILE_CREATE_NONE, NULL, error);
+  if (out == NULL)
+    return NULL;
+
+  stream = g_buffered_output_stream_new (G_OUTPUT_STREAM (out));
+  if (!g_output_stream_write_all (stream, PHOC_INPUT_RECORDING_MAGIC,
+                                  sizeof (PHOC_INPUT_RECORDING_MAGIC), NULL, NULL, error) ||
+      !g_output_stream_write_all (stream, &version, sizeof (version), NULL, NULL, error)) {
+    g_object_unref (stream);
+    return NULL;
+  }
+
+  self = g_new0 (PhocInputRecorder, 1);
+  self->stream = stream;
+  self->devices = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL,
+                                         (GDestroyNotify) recorder_device_free);
+  self->last_pointer = PHOC_INPUT_RECORD_NO_DEVICE;
+  self->last_touch = PHOC_INPUT_RECORD_NO_DEVICE;
+
+  g_debug ("Recording input to %s", path);
+
+  return self;
+}
+
+
+void
+phoc_input_recorder_free (PhocInputRecorder *self)
+{
+  g_autoptr (GError) err = NULL;
+
+  if (!g_output_stream_close (self->stream, NULL, &err))
+    g_warning ("Failed to finish input recording: %s", err->message);
+
+  g_debug ("Recorded %u input events", self->n_events);
+
+  g_object_unref (self->stream);
+  g_hash_table_destroy (self->devices);
+  g_free (self);
+}
+
+/**
+ * phoc_input_recorder_record:
+ * @self: The recorder
+ * @type: The type of the event
+ * @device: (nullable): The device the event originates from, %NULL for frames
+ * @event: (nullable): The wlr event matching @type, %NULL for frames.
+ *   For %PHOC_INPUT_RECORD_MODIFIERS this is the keyboard's `struct wlr_keyboard_modifiers`.
+ *
+ * Records an input event.
+ */
+void
+phoc_input_recorder_record (PhocInputRecorder       *self,
+                            PhocInputRecordType      type,
+                            struct wlr_input_device *device,
+                            gconstpointer            event)
+{
+  union {
+    PhocInputRecordMotion         motion;
+    PhocInputRecordMotionAbsolute motion_absolute;
+    PhocInputRecordButton         button;
+    PhocInputRecordAxis           axis;
+    PhocInputRecordTouch          touch;
+    PhocInputRecordKey            key;
+    PhocInputRecordModifiers      modifiers;
+    PhocInputRecordGestureBegin   gesture_begin;
+    PhocInputRecordGestureUpdate  gesture_update;
+    PhocInputRecordGestureEnd     gesture_end;
+    PhocInputRecordSwitch         switch_toggle;
+  } payload;
+  guint32 time_msec = self->last_time;
+  guint8 index;
+  gsize size = 0;
+
+  g_return_if_fail (type > PHOC_INPUT_RECORD_DEVICE && type < PHOC_INPUT_RECORD_LAST);
+
+  index = lookup_device (self, device);
+  /* Clear the padding too so recordings are reproducible */
+  memset (&payload, 0, sizeof (payload));
+
+  switch (type) {
+  case PHOC_INPUT_RECORD_POINTER_MOTION: {
+    const struct wlr_event_pointer_motion *ev = event;
+
+    payload.motion.delta_x = ev->delta_x;
+    payload.motion.delta_y = ev->delta_y;
+    payload.motion.unaccel_dx = ev->unaccel_dx;
+    payload.motion.unaccel_dy = ev->unaccel_dy;
+    size = sizeof (payload.motion);
+    time_msec = ev->time_msec;
+    self->last_pointer = index;
+    break;
+  }
+  case PHOC_INPUT_RECORD_POINTER_MOTION_ABSOLUTE: {
+    const struct wlr_event_pointer_motion_absolute *ev = event;
+
+    payload.motion_absolute.x = ev->x;
+    payload.motion_absolute.y = ev->y;
+    size = sizeof (payload.motion_absolute);
+    time_msec = ev->time_msec;
+    self->last_pointer = index;
+    break;
+  }
+  case PHOC_INPUT_RECORD_POINTER_BUTTON: {
+    const struct wlr_event_pointer_button *ev = event;
+
+    payload.button.button = ev->button;
+    payload.button.state = ev->state;
+    size = sizeof (payload.button);
+    time_msec = ev->time_msec;
+    self->last_pointer = index;
+    break;
+  }
+  case PHOC_INPUT_RECORD_POINTER_AXIS: {
+    const struct wlr_event_pointer_axis *ev = event;
+
+    payload.axis.delta = ev->delta;
+    payload.axis.delta_discrete = ev->delta_discrete;
+    payload.axis.source = ev->source;
+    payload.axis.orientation = ev->orientation;
+    size = sizeof (payload.axis);
+    time_msec = ev->time_msec;
+    self->last_pointer = index;
+    break;
+  }
+  case PHOC_INPUT_RECORD_POINTER_FRAME:
+    index = self->last_pointer;
+    break;
+  case PHOC_INPUT_RECORD_TOUCH_DOWN: {
+    const struct wlr_event_touch_down *ev = event;
+
+    payload.touch.x = ev->x;
+    payload.touch.y = ev->y;
+    payload.touch.touch_id = ev->touch_id;
+    size = sizeof (payload.touch);
+    time_msec = ev->time_msec;
+    self->last_touch = index;
+    break;
+  }
+  case PHOC_INPUT_RECORD_TOUCH_MOTION: {
+    const struct wlr_event_touch_motion *ev = event;
+
+    payload.touch.x = ev->x;
+    payload.touch.y = ev->y;
+    payload.touch.touch_id = ev->touch_id;
+    size = sizeof (payload.touch);
+    time_msec = ev->time_msec;
+    self->last_touch = index;
+    break;
+  }
+  case PHOC_INPUT_RECORD_TOUCH_UP: {
+    const struct wlr_event_touch_up *ev = event;
+
+    payload.touch.touch_id = ev->touch_id;
+    size = sizeof (payload.touch);
+    time_msec = ev->time_msec;
+    self->last_touch = index;
+    break;
+  }
+  case PHOC_INPUT_RECORD_TOUCH_FRAME:
+    index = self->last_touch;
+    break;
+  case PHOC_INPUT_RECORD_KEY: {
+    const struct wlr_event_keyboard_key *ev = event;
+
+    payload.key.keycode = ev->keycode;
+    payload.key.state = ev->state;
+    size = sizeof (payload.key);
+    time_msec = ev->time_msec;
+    break;
+  }
+  case PHOC_INPUT_RECORD_MODIFIERS: {
+    const struct wlr_keyboard_modifiers *mods = event;
+
+    payload.modifiers.depressed = mods->depressed;
+    payload.modifiers.latched = mods->latched;
+    payload.modifiers.locked = mods->locked;
+    payload.modifiers.group = mods->group;
+    size = sizeof (payload.modifiers);
+    break;
+  }
+  case PHOC_INPUT_RECORD_SWIPE_BEGIN: {
+    const struct wlr_event_pointer_swipe_begin *ev = event;
+
+    payload.gesture_begin.fingers = ev->fingers;
+    size = sizeof (payload.gesture_begin);
+    time_msec = ev->time_msec;
+    break;
+  }
+  case PHOC_INPUT_RECORD_SWIPE_UPDATE: {
+    const struct wlr_event_pointer_swipe_update *ev = event;
+
+    payload.gesture_update.dx = ev->dx;
+    payload.gesture_update.dy = ev->dy;
+    payload.gesture_update.fingers = ev->fingers;
+    size = sizeof (payload.gesture_update);
+    time_msec = ev->time_msec;
+    break;
+  }
+  case PHOC_INPUT_RECORD_SWIPE_END: {
+    const struct wlr_event_pointer_swipe_end *ev = event;
+
+    payload.gesture_end.cancelled = ev->cancelled;
+    size = sizeof (payload.gesture_end);
+    time_msec = ev->time_msec;
+    break;
+  }
+  case PHOC_INPUT_RECORD_PINCH_BEGIN: {
+    const struct wlr_event_pointer_pinch_begin *ev = event;
+
+    payload.gesture_begin.fingers = ev->fingers;
+    size = sizeof (payload.gesture_begin);
+    time_msec = ev->time_msec;
+    break;
+  }
+  case PHOC_INPUT_RECORD_PINCH_UPDATE: {
+    const struct wlr_event_pointer_pinch_update *ev = event;
+
+    payload.gesture_update.dx = ev->dx;
+    payload.gesture_update.dy = ev->dy;
+    payload.gesture_update.scale = ev->scale;
+    payload.gesture_update.rotation = ev->rotation;
+    payload.gesture_update.fingers = ev->fingers;
+    size = sizeof (payload.gesture_update);
+    time_msec = ev->time_msec;
+    break;
+  }
+  case PHOC_INPUT_RECORD_PINCH_END: {
+    const struct wlr_event_pointer_pinch_end *ev = event;
+
+    payload.gesture_end.cancelled = ev->cancelled;
+    size = sizeof (payload.gesture_end);
+    time_msec = ev->time_msec;
+    break;
+  }
+  case PHOC_INPUT_RECORD_SWITCH_TOGGLE: {
+    const struct wlr_event_switch_toggle *ev = event;
+
+    payload.switch_toggle.switch_type = ev->switch_type;
+    payload.switch_toggle.switch_state = ev->switch_state;
+    size = sizeof (payload.switch_toggle);
+    time_msec = ev->time_msec;
+    break;
+  }
+  case PHOC_INPUT_RECORD_DEVICE:
+  case PHOC_INPUT_RECORD_LAST:
+  default:
+    g_assert_not_reached ();
+  }
+
+  if (index == PHOC_INPUT_RECORD_NO_DEVICE)
+    return;
+
+  if (write_record (self, time_msec, type, index, &payload, size)) {
+    self->last_time = time_msec;
+    self->n_events++;
+  }
+}
+
+
+guint
+phoc_input_recorder_get_n_events (PhocInputRecorder *self)
+{
+  return self->n_events;
+}
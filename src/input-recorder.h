@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2022 Purism SPC
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <glib.h>
+#include <wlr/types/wlr_input_device.h>
+
+G_BEGIN_DECLS
+
+#define PHOC_INPUT_RECORDING_MAGIC   "PHOCINP"
+#define PHOC_INPUT_RECORDING_VERSION 1
+
+/**
+ * PhocInputRecordType:
+ *
+ * The type of a record in an input recording. Apart from
+ * `PHOC_INPUT_RECORD_DEVICE` each record corresponds to an event
+ * entering a #PhocCursor or #PhocKeyboard handler.
+ */
+typedef enum {
+  PHOC_INPUT_RECORD_DEVICE = 0,
+  PHOC_INPUT_RECORD_POINTER_MOTION,
+  PHOC_INPUT_RECORD_POINTER_MOTION_ABSOLUTE,
+  PHOC_INPUT_RECORD_POINTER_BUTTON,
+  PHOC_INPUT_RECORD_POINTER_AXIS,
+  PHOC_INPUT_RECORD_POINTER_FRAME,
+  PHOC_INPUT_RECORD_TOUCH_DOWN,
+  PHOC_INPUT_RECORD_TOUCH_UP,
+  PHOC_INPUT_RECORD_TOUCH_MOTION,
+  PHOC_INPUT_RECORD_TOUCH_FRAME,
+  PHOC_INPUT_RECORD_KEY,
+  PHOC_INPUT_RECORD_MODIFIERS,
+  PHOC_INPUT_RECORD_SWIPE_BEGIN,
+  PHOC_INPUT_RECORD_SWIPE_UPDATE,
+  PHOC_INPUT_RECORD_SWIPE_END,
+  PHOC_INPUT_RECORD_PINCH_BEGIN,
+  PHOC_INPUT_RECORD_PINCH_UPDATE,
+  PHOC_INPUT_RECORD_PINCH_END,
+  PHOC_INPUT_RECORD_SWITCH_TOGGLE,
+  PHOC_INPUT_RECORD_LAST,
+} PhocInputRecordType;
+
+/*
+ * A recording starts with the magic and a version (guint32) followed
+ * by records. Each record is a header and a type specific payload.
+ * All values are in host byte order.
+ */
+typedef struct {
+  guint32 time_msec;   /* the event's time stamp */
+  guint8  type;        /* PhocInputRecordType */
+  guint8  device;      /* index of the device record */
+  guint16 size;        /* size of the payload */
+} PhocInputRecordHeader;
+
+#define PHOC_INPUT_RECORD_NO_DEVICE G_MAXUINT8
+
+/* Payloads, a device record carries its type and name */
+typedef struct {
+  guint32 type;        /* enum wlr_input_device_type */
+  char    name[];
+} PhocInputRecordDevice;
+
+typedef struct {
+  double  delta_x, delta_y;
+  double  unaccel_dx, unaccel_dy;
+} PhocInputRecordMotion;
+
+typedef struct {
+  double  x, y;
+} PhocInputRecordMotionAbsolute;
+
+typedef struct {
+  guint32 button;
+  guint32 state;
+} PhocInputRecordButton;
+
+typedef struct {
+  double  delta;
+  gint32  delta_discrete;
+  guint8  source;
+  guint8  orientation;
+} PhocInputRecordAxis;
+
+typedef struct {
+  double  x, y;
+  gint32  touch_id;
+} PhocInputRecordTouch;
+
+typedef struct {
+  guint32 keycode;
+  guint32 state;
+} PhocInputRecordKey;
+
+typedef struct {
+  guint32 depressed, latched, locked, group;
+} PhocInputRecordModifiers;
+
+/* Swipe and pinch gestures, swipes don't use scale and rotation */
+typedef struct {
+  guint32 fingers;
+} PhocInputRecordGestureBegin;
+
+typedef struct {
+  double  dx, dy;
+  double  scale, rotation;
+  guint32 fingers;
+} PhocInputRecordGestureUpdate;
+
+typedef struct {
+  guint32 cancelled;
+} PhocInputRecordGestureEnd;
+
+typedef struct {
+  guint32 switch_type;
+  guint32 switch_state;
+} PhocInputRecordSwitch;
+
+typedef struct _PhocInputRecorder PhocInputRecorder;
+
+PhocInputRecorder *phoc_input_recorder_new    (const char              *path,
+                                               GError                 **error);
+void               phoc_input_recorder_free   (PhocInputRecorder       *self);
+void               phoc_input_recorder_record (PhocInputRecorder       *self,
+                                               PhocInputRecordType      type,
+                                               struct wlr_input_device *device,
+                                               gconstpointer            event);
+guint              phoc_input_recorder_get_n_events (PhocInputRecorder *self);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (PhocInputRecorder, phoc_input_recorder_free)
+
+G_END_DECLS
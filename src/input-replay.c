@@ -0,0 +1,659 @@
+/*
+ * Copyright (C) 2022 Purism SPC
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "phoc-input-replay"
+
+#include "config.h"
+
+#include "input.h"
+#include "input-recorder.h"
+#include "input-replay.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wlr/interfaces/wlr_input_device.h>
+#include <wlr/interfaces/wlr_keyboard.h>
+#include <wlr/interfaces/wlr_pointer.h>
+#include <wlr/interfaces/wlr_switch.h>
+#include <wlr/interfaces/wlr_touch.h>
+
+/**
+ * PhocInputReplay:
+ *
+ * Feeds a recording made by #PhocInputRecorder back through the
+ * #PhocCursor and #PhocKeyboard handlers. For each recorded device a
+ * virtual one is added to the seat and the recorded events are
+ * emitted on it with their original time stamps so gestures behave
+ * the same. Meant to be used with the headless backend to profile
+ * real world input traces.
+ *
+ * Events are replayed at the recorded pace scaled by the given speed.
+ * A speed of `0` replays as fast as possible while still letting the
+ * main loop run (and hence render) between frames.
+ */
+
+enum {
+  DONE,
+  N_SIGNALS
+};
+static guint signals[N_SIGNALS] = { 0 };
+
+struct _PhocInputReplay {
+  GObject    parent;
+
+  GBytes    *data;
+  gsize      offset;
+  GPtrArray *devices;      /* struct wlr_input_device * by index */
+  PhocSeat  *seat;
+
+  double     speed;
+  gint64     start;        /* µs */
+  guint32    first_time;   /* ms */
+  guint      source_id;
+  guint      n_events;
+  gboolean   done;
+};
+
+G_DEFINE_TYPE (PhocInputReplay, phoc_input_replay, G_TYPE_OBJECT)
+
+static gboolean replay_dispatch (gpointer data);
+
+
+static gboolean
+payload_size_valid (PhocInputRecordType type, gsize size)
+{
+  switch (type) {
+  case PHOC_INPUT_RECORD_DEVICE:
+    return size >= sizeof (PhocInputRecordDevice);
+  case PHOC_INPUT_RECORD_POINTER_MOTION:
+    return size == sizeof (PhocInputRecordMotion);
+  case PHOC_INPUT_RECORD_POINTER_MOTION_ABSOLUTE:
+    return size == sizeof (PhocInputRecordMotionAbsolute);
+  case PHOC_INPUT_RECORD_POINTER_BUTTON:
+    return size == sizeof (PhocInputRecordButton);
+  case PHOC_INPUT_RECORD_POINTER_AXIS:
+    return size == sizeof (PhocInputRecordAxis);
+  case PHOC_INPUT_RECORD_TOUCH_DOWN:
+  case PHOC_INPUT_RECORD_TOUCH_UP:
+  case PHOC_INPUT_RECORD_TOUCH_MOTION:
+    return size == sizeof (PhocInputRecordTouch);
+  case PHOC_INPUT_RECORD_KEY:
+    return size == sizeof (PhocInputRecordKey);
+  case PHOC_INPUT_RECORD_MODIFIERS:
+    return size == sizeof (PhocInputRecordModifiers);
+  case PHOC_INPUT_RECORD_SWIPE_BEGIN:
+  case PHOC_INPUT_RECORD_PINCH_BEGIN:
+    return size == sizeof (PhocInputRecordGestureBegin);
+  case PHOC_INPUT_RECORD_SWIPE_UPDATE:
+  case PHOC_INPUT_RECORD_PINCH_UPDATE:
+    return size == sizeof (PhocInputRecordGestureUpdate);
+  case PHOC_INPUT_RECORD_SWIPE_END:
+  case PHOC_INPUT_RECORD_PINCH_END:
+    return size == sizeof (PhocInputRecordGestureEnd);
+  case PHOC_INPUT_RECORD_SWITCH_TOGGLE:
+    return size == sizeof (PhocInputRecordSwitch);
+  case PHOC_INPUT_RECORD_POINTER_FRAME:
+  case PHOC_INPUT_RECORD_TOUCH_FRAME:
+    return size == 0;
+  case PHOC_INPUT_RECORD_LAST:
+  default:
+    return FALSE;
+  }
+}
+
+
+static gboolean
+validate_recording (GBytes *data, gsize *offset, GError **error)
+{
+  gsize len, pos = sizeof (PHOC_INPUT_RECORDING_MAGIC) + sizeof (guint32);
+  const guint8 *bytes = g_bytes_get_data (data, &len);
+  guint32 version;
+
+  if (len < pos || memcmp (bytes, PHOC_INPUT_RECORDING_MAGIC, sizeof (PHOC_INPUT_RECORDING_MAGIC))) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Not an input recording");
+    return FALSE;
+  }
+
+  memcpy (&version, bytes + sizeof (PHOC_INPUT_RECORDING_MAGIC), sizeof (version));
+  if (version != PHOC_INPUT_RECORDING_VERSION) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                 "Unsupported input recording version %u", version);
+    return FALSE;
+  }
+  *offset = pos;
+
+  while (pos < len) {
+    PhocInputRecordHeader header;
+
+    if (len - pos < sizeof (header)) {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Truncated record at %zu", pos);
+      return FALSE;
+    }
+    memcpy (&header, bytes + pos, sizeof (header));
+    pos += sizeof (header);
+
+    if (len - pos < header.size || !payload_size_valid (header.type, header.size)) {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Invalid record at %zu",
+                   pos - sizeof (header));
+      return FALSE;
+    }
+    pos += header.size;
+  }
+
+  return TRUE;
+}
+
+
+static struct wlr_input_device *
+create_device (enum wlr_input_device_type type, const char *name)
+{
+  struct wlr_input_device *device;
+
+  /* wlroots frees these so allocate them the way it expects */
+  device = calloc (1, sizeof (*device));
+  wlr_input_device_init (device, type, NULL, name, 0, 0);
+
+  switch (type) {
+  case WLR_INPUT_DEVICE_KEYBOARD:
+    device->keyboard = calloc (1, sizeof (*device->keyboard));
+    wlr_keyboard_init (device->keyboard, NULL);
+    break;
+  case WLR_INPUT_DEVICE_POINTER:
+    device->pointer = calloc (1, sizeof (*device->pointer));
+    wlr_pointer_init (device->pointer, NULL);
+    break;
+  case WLR_INPUT_DEVICE_TOUCH:
+    device->touch = calloc (1, sizeof (*device->touch));
+    wlr_touch_init (device->touch, NULL);
+    break;
+  case WLR_INPUT_DEVICE_SWITCH:
+    device->switch_device = calloc (1, sizeof (*device->switch_device));
+    wlr_switch_init (device->switch_device, NULL);
+    break;
+  default:
+    g_warning ("Can't replay %s devices, skipping %s",
+               phoc_input_get_device_type (type), name);
+    wlr_input_device_destroy (device);
+    return NULL;
+  }
+
+  return device;
+}
+
+
+static void
+replay_device (PhocInputReplay *self, guint8 index, const guint8 *payload, gsize size)
+{
+  g_autofree char *name = NULL;
+  struct wlr_input_device *device;
+  guint32 type;
+
+  memcpy (&type, payload, sizeof (type));
+  name = g_strndup ((const char *)payload + offsetof (PhocInputRecordDevice, name),
+                    size - sizeof (PhocInputRecordDevice));
+
+  if (index != self->devices->len) {
+    g_warning ("Unexpected device index %u, expected %u", index, self->devices->len);
+    index = self->devices->len;
+  }
+
+  device = create_device (type, name);
+  g_ptr_array_add (self->devices, device);
+  if (device == NULL)
+    return;
+
+  g_debug ("Replaying %s as device %u", name, index);
+  phoc_seat_add_device (self->seat, device);
+}
+
+
+static void
+replay_event (PhocInputReplay             *self,
+              const PhocInputRecordHeader *header,
+              const guint8                *data)
+{
+  struct wlr_input_device *device = NULL;
+  union {
+    PhocInputRecordMotion         motion;
+    PhocInputRecordMotionAbsolute motion_absolute;
+    PhocInputRecordButton         button;
+    PhocInputRecordAxis           axis;
+    PhocInputRecordTouch          touch;
+    PhocInputRecordKey            key;
+    PhocInputRecordModifiers      modifiers;
+    PhocInputRecordGestureBegin   gesture_begin;
+    PhocInputRecordGestureUpdate  gesture_update;
+    PhocInputRecordGestureEnd     gesture_end;
+    PhocInputRecordSwitch         switch_toggle;
+  } aligned;
+  gconstpointer payload = &aligned;
+
+  if (header->type == PHOC_INPUT_RECORD_DEVICE) {
+    replay_device (self, header->device, data, header->size);
+    return;
+  }
+
+  /* Records aren't aligned in the file, sizes got validated on load */
+  g_assert (header->size <= sizeof (aligned));
+  memcpy (&aligned, data, header->size);
+
+  if (header->device < self->devices->len)
+    device = g_ptr_array_index (self->devices, header->device);
+  if (device == NULL)
+    return;
+
+  switch (header->type) {
+  case PHOC_INPUT_RECORD_POINTER_MOTION: {
+    const PhocInputRecordMotion *motion = payload;
+    struct wlr_event_pointer_motion event = {
+      .device = device,
+      .time_msec = header->time_msec,
+      .delta_x = motion->delta_x,
+      .delta_y = motion->delta_y,
+      .unaccel_dx = motion->unaccel_dx,
+      .unaccel_dy = motion->unaccel_dy,
+    };
+
+    g_return_if_fail (device->type == WLR_INPUT_DEVICE_POINTER);
+    wl_signal_emit (&device->pointer->events.motion, &event);
+    break;
+  }
+  case PHOC_INPUT_RECORD_POINTER_MOTION_ABSOLUTE: {
+    const PhocInputRecordMotionAbsolute *motion = payload;
+    struct wlr_event_pointer_motion_absolute event = {
+      .device = device,
+      .time_msec = header->time_msec,
+      .x = motion->x,
+      .y = motion->y,
+    };
+
+    g_return_if_fail (device->type == WLR_INPUT_DEVICE_POINTER);
+    wl_signal_emit (&device->pointer->events.motion_absolute, &event);
+    break;
+  }
+  case PHOC_INPUT_RECORD_POINTER_BUTTON: {
+    const PhocInputRecordButton *button = payload;
+    struct wlr_event_pointer_button event = {
+      .device = device,
+      .time_msec = header->time_msec,
+      .button = button->button,
+      .state = button->state,
+    };
+
+    g_return_if_fail (device->type == WLR_INPUT_DEVICE_POINTER);
+    wl_signal_emit (&device->pointer->events.button, &event);
+    break;
+  }
+  case PHOC_INPUT_RECORD_POINTER_AXIS: {
+    const PhocInputRecordAxis *axis = payload;
+    struct wlr_event_pointer_axis event = {
+      .device = device,
+      .time_msec = header->time_msec,
+      .source = axis->source,
+      .orientation = axis->orientation,
+      .delta = axis->delta,
+      .delta_discrete = axis->delta_discrete,
+    };
+
+    g_return_if_fail (device->type == WLR_INPUT_DEVICE_POINTER);
+    wl_signal_emit (&device->pointer->events.axis, &event);
+    break;
+  }
+  case PHOC_INPUT_RECORD_POINTER_FRAME:
+    g_return_if_fail (device->type == WLR_INPUT_DEVICE_POINTER);
+    wl_signal_emit (&device->pointer->events.frame, device->pointer);
+    break;
+  case PHOC_INPUT_RECORD_TOUCH_DOWN: {
+    const PhocInputRecordTouch *touch = payload;
+    struct wlr_event_touch_down event = {
+      .device = device,
+      .time_msec = header->time_msec,
+      .touch_id = touch->touch_id,
+      .x = touch->x,
+      .y = touch->y,
+    };
+
+    g_return_if_fail (device->type == WLR_INPUT_DEVICE_TOUCH);
+    wl_signal_emit (&device->touch->events.down, &event);
+    break;
+  }
+  case PHOC_INPUT_RECORD_TOUCH_MOTION: {
+    const PhocInputRecordTouch *touch = payload;
+    struct wlr_event_touch_motion event = {
+      .device = device,
+      .time_msec = header->time_msec,
+      .touch_id = touch->touch_id,
+      .x = touch->x,
+      .y = touch->y,
+    };
+
+    g_return_if_fail (device->type == WLR_INPUT_DEVICE_TOUCH);
+    wl_signal_emit (&device->touch->events.motion, &event);
+    break;
+  }
+  case PHOC_INPUT_RECORD_TOUCH_UP: {
+    const PhocInputRecordTouch *touch = payload;
+    struct wlr_event_touch_up event = {
+      .device = device,
+      .time_msec = header->time_msec,
+      .touch_id = touch->touch_id,
+    };
+
+    g_return_if_fail (device->type == WLR_INPUT_DEVICE_TOUCH);
+    wl_signal_emit (&device->touch->events.up, &event);
+    break;
+  }
+  case PHOC_INPUT_RECORD_TOUCH_FRAME:
+    g_return_if_fail (device->type == WLR_INPUT_DEVICE_TOUCH);
+    wl_signal_emit (&device->touch->events.frame, NULL);
+    break;
+  case PHOC_INPUT_RECORD_KEY: {
+    const PhocInputRecordKey *key = payload;
+    struct wlr_event_keyboard_key event = {
+      .time_msec = header->time_msec,
+      .keycode = key->keycode,
+      .update_state = true,
+      .state = key->state,
+    };
+
+    g_return_if_fail (device->type == WLR_INPUT_DEVICE_KEYBOARD);
+    wlr_keyboard_notify_key (device->keyboard, &event);
+    break;
+  }
+  case PHOC_INPUT_RECORD_MODIFIERS: {
+    const PhocInputRecordModifiers *mods = payload;
+
+    g_return_if_fail (device->type == WLR_INPUT_DEVICE_KEYBOARD);
+    /* Usually a no-op since the keys already updated the state */
+    wlr_keyboard_notify_modifiers (device->keyboard, mods->depressed, mods->latched,
+                                   mods->locked, mods->group);
+    break;
+  }
+  case PHOC_INPUT_RECORD_SWIPE_BEGIN: {
+    const PhocInputRecordGestureBegin *begin = payload;
+    struct wlr_event_pointer_swipe_begin event = {
+      .device = device,
+      .time_msec = header->time_msec,
+      .fingers = begin->fingers,
+    };
+
+    g_return_if_fail (device->type == WLR_INPUT_DEVICE_POINTER);
+    wl_signal_emit (&device->pointer->events.swipe_begin, &event);
+    break;
+  }
+  case PHOC_INPUT_RECORD_SWIPE_UPDATE: {
+    const PhocInputRecordGestureUpdate *update = payload;
+    struct wlr_event_pointer_swipe_update event = {
+      .device = device,
+      .time_msec = header->time_msec,
+      .fingers = update->fingers,
+      .dx = update->dx,
+      .dy = update->dy,
+    };
+
+    g_return_if_fail (device->type == WLR_INPUT_DEVICE_POINTER);
+    wl_signal_emit (&device->pointer->events.swipe_update, &event);
+    break;
+  }
+  case PHOC_INPUT_RECORD_SWIPE_END: {
+    const PhocInputRecordGestureEnd *end = payload;
+    struct wlr_event_pointer_swipe_end event = {
+      .device = device,
+      .time_msec = header->time_msec,
+      .cancelled = end->cancelled,
+    };
+
+    g_return_if_fail (device->type == WLR_INPUT_DEVICE_POINTER);
+    wl_signal_emit (&device->pointer->events.swipe_end, &event);
+    break;
+  }
+  case PHOC_INPUT_RECORD_PINCH_BEGIN: {
+    const PhocInputRecordGestureBegin *begin = payload;
+    struct wlr_event_pointer_pinch_begin event = {
+      .device = device,
+      .time_msec = header->time_msec,
+      .fingers = begin->fingers,
+    };
+
+    g_return_if_fail (device->type == WLR_INPUT_DEVICE_POINTER);
+    wl_signal_emit (&device->pointer->events.pinch_begin, &event);
+    break;
+  }
+  case PHOC_INPUT_RECORD_PINCH_UPDATE: {
+    const PhocInputRecordGestureUpdate *update = payload;
+    struct wlr_event_pointer_pinch_update event = {
+      .device = device,
+      .time_msec = header->time_msec,
+      .fingers = update->fingers,
+      .dx = update->dx,
+      .dy = update->dy,
+      .scale = update->scale,
+      .rotation = update->rotation,
+    };
+
+    g_return_if_fail (device->type == WLR_INPUT_DEVICE_POINTER);
+    wl_signal_emit (&device->pointer->events.pinch_update, &event);
+    break;
+  }
+  case PHOC_INPUT_RECORD_PINCH_END: {
+    const PhocInputRecordGestureEnd *end = payload;
+    struct wlr_event_pointer_pinch_end event = {
+      .device = device,
+      .time_msec = header->time_msec,
+      .cancelled = end->cancelled,
+    };
+
+    g_return_if_fail (device->type == WLR_INPUT_DEVICE_POINTER);
+    wl_signal_emit (&device->pointer->events.pinch_end, &event);
+    break;
+  }
+  case PHOC_INPUT_RECORD_SWITCH_TOGGLE: {
+    const PhocInputRecordSwitch *toggle = payload;
+    struct wlr_event_switch_toggle event = {
+      .device = device,
+      .time_msec = header->time_msec,
+      .switch_type = toggle->switch_type,
+      .switch_state = toggle->switch_state,
+    };
+
+    g_return_if_fail (device->type == WLR_INPUT_DEVICE_SWITCH);
+    wl_signal_emit (&device->switch_device->events.toggle, &event);
+    break;
+  }
+  case PHOC_INPUT_RECORD_DEVICE:
+  case PHOC_INPUT_RECORD_LAST:
+  default:
+    g_assert_not_reached ();
+  }
+
+  self->n_events++;
+}
+
+
+static void
+replay_schedule (PhocInputReplay *self, gint64 delay)
+{
+  if (delay <= 0)
+    self->source_id = g_idle_add (replay_dispatch, self);
+  else
+    self->source_id = g_timeout_add ((delay + 999) / 1000, replay_dispatch, self);
+  g_source_set_name_by_id (self->source_id, "[phoc] input replay");
+}
+
+
+static gboolean
+replay_dispatch (gpointer data)
+{
+  PhocInputReplay *self = PHOC_INPUT_REPLAY (data);
+  gsize len;
+  const guint8 *bytes = g_bytes_get_data (self->data, &len);
+
+  self->source_id = 0;
+
+  while (self->offset < len) {
+    PhocInputRecordHeader header;
+
+    memcpy (&header, bytes + self->offset, sizeof (header));
+
+    if (self->speed > 0) {
+      gint64 due = self->start + (gint64)(guint32)(header.time_msec - self->first_time) * 1000 / self->speed;
+      gint64 now = g_get_monotonic_time ();
+
+      if (due > now) {
+        replay_schedule (self, due - now);
+        return G_SOURCE_REMOVE;
+      }
+    }
+
+    self->offset += sizeof (header) + header.size;
+    replay_event (self, &header, bytes + self->offset - header.size);
+
+    /* Let the main loop catch up after each frame */
+    if (self->speed <= 0 && (header.type == PHOC_INPUT_RECORD_POINTER_FRAME ||
+                             header.type == PHOC_INPUT_RECORD_TOUCH_FRAME)) {
+      replay_schedule (self, 0);
+      return G_SOURCE_REMOVE;
+    }
+  }
+
+  g_debug ("Replayed %u input events in %" G_GINT64_FORMAT " ms", self->n_events,
+           (g_get_monotonic_time () - self->start) / 1000);
+  self->done = TRUE;
+  g_signal_emit (self, signals[DONE], 0);
+
+  return G_SOURCE_REMOVE;
+}
+
+
+static void
+destroy_device (gpointer data)
+{
+  struct wlr_input_device *device = data;
+
+  if (device)
+    wlr_input_device_destroy (device);
+}
+
+
+static void
+phoc_input_replay_finalize (GObject *object)
+{
+  PhocInputReplay *self = PHOC_INPUT_REPLAY (object);
+
+  g_clear_handle_id (&self->source_id, g_source_remove);
+  g_clear_pointer (&self->devices, g_ptr_array_unref);
+  g_clear_pointer (&self->data, g_bytes_unref);
+  g_clear_object (&self->seat);
+
+  G_OBJECT_CLASS (phoc_input_replay_parent_class)->finalize (object);
+}
+
+
+static void
+phoc_input_replay_class_init (PhocInputReplayClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = phoc_input_replay_finalize;
+
+  /**
+   * PhocInputReplay::done:
+   *
+   * Emitted once all events got replayed.
+   */
+  signals[DONE] = g_signal_new ("done",
+                                G_TYPE_FROM_CLASS (klass),
+                                G_SIGNAL_RUN_LAST,
+                                0, NULL, NULL, NULL,
+                                G_TYPE_NONE, 0);
+}
+
+
+static void
+phoc_input_replay_init (PhocInputReplay *self)
+{
+  self->devices = g_ptr_array_new_with_free_func (destroy_device);
+}
+
+/**
+ * phoc_input_replay_new:
+ * @path: The recording to replay
+ * @error: Return location for an error
+ *
+ * Loads and validates a recording made by #PhocInputRecorder.
+ *
+ * Returns: A new replay or %NULL if @path isn't a valid recording
+ */
+PhocInputReplay *
+phoc_input_replay_new (const char *path, GError **error)
+{
+  g_autoptr (PhocInputReplay) self = g_object_new (PHOC_TYPE_INPUT_REPLAY, NULL);
+  g_autoptr (GMappedFile) file = NULL;
+
+  file = g_mapped_file_new (path, FALSE, error);
+  if (file == NULL)
+    return NULL;
+
+  self->data = g_mapped_file_get_bytes (file);
+  if (!validate_recording (self->data, &self->offset, error))
+    return NULL;
+
+  return g_steal_pointer (&self);
+}
+
+/**
+ * phoc_input_replay_start:
+ * @self: The replay
+ * @seat: The seat to add the replayed devices to
+ * @speed: Factor to speed up the replay by, `1` to use the recorded
+ *   pace, `0` to replay as fast as possible
+ *
+ * Starts replaying the recording. #PhocInputReplay::done is emitted
+ * once all events got replayed.
+ */
+void
+phoc_input_replay_start (PhocInputReplay *self, PhocSeat *seat, double speed)
+{
+  gsize len;
+  const guint8 *bytes;
+
+  g_return_if_fail (PHOC_IS_INPUT_REPLAY (self));
+  g_return_if_fail (PHOC_IS_SEAT (seat));
+  g_return_if_fail (self->seat == NULL);
+
+  self->seat = g_object_ref (seat);
+  self->speed = speed;
+  self->start = g_get_monotonic_time ();
+
+  bytes = g_bytes_get_data (self->data, &len);
+  if (self->offset < len) {
+    PhocInputRecordHeader header;
+
+    memcpy (&header, bytes + self->offset, sizeof (header));
+    self->first_time = header.time_msec;
+  }
+
+  replay_schedule (self, 0);
+}
+
+
+gboolean
+phoc_input_replay_is_done (PhocInputReplay *self)
+{
+  g_return_val_if_fail (PHOC_IS_INPUT_REPLAY (self), FALSE);
+
+  return self->done;
+}
+
+
+guint
+phoc_input_replay_get_n_events (PhocInputReplay *self)
+{
+  g_return_val_if_fail (PHOC_IS_INPUT_REPLAY (self), 0);
+
+  return self->n_events;
+}
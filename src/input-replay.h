@@ -0,0 +1,27 @@
+/*
+ * Copyright (C) 2022 Purism SPC
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include "seat.h"
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+#define PHOC_TYPE_INPUT_REPLAY (phoc_input_replay_get_type ())
+
+G_DECLARE_FINAL_TYPE (PhocInputReplay, phoc_input_replay, PHOC, INPUT_REPLAY, GObject)
+
+PhocInputReplay *phoc_input_replay_new          (const char      *path,
+                                                 GError         **error);
+void             phoc_input_replay_start        (PhocInputReplay *self,
+                                                 PhocSeat        *seat,
+                                                 double           speed);
+gboolean         phoc_input_replay_is_done      (PhocInputReplay *self);
+guint            phoc_input_replay_get_n_events (PhocInputReplay *self);
+
+G_END_DECLS
@@ -22,6 +22,8 @@ struct _PhocInput {
 
   struct wl_listener   new_input;
   GSList              *seats; // PhocSeat
+
+  PhocInputRecorder   *recorder;
 };
 
 G_DEFINE_TYPE (PhocInput, phoc_input, G_TYPE_OBJECT);
@@ -119,6 +121,7 @@ phoc_input_finalize (GObject *object)
 {
   PhocInput *self = PHOC_INPUT (object);
 
+  g_clear_pointer (&self->recorder, phoc_input_recorder_free);
   g_clear_slist (&self->seats, g_object_unref);
 
   G_OBJECT_CLASS (phoc_input_parent_class)->finalize (object);
@@ -246,3 +249,57 @@ phoc_input_get_last_active_seat (PhocInput *self)
   }
   return seat;
 }
+
+/**
+ * phoc_input_start_recording:
+ * @self: The input
+ * @path: The file to record to
+ * @error: Return location for an error
+ *
+ * Starts recording all input events entering the cursor and keyboard
+ * handlers to @path, see #PhocInputRecorder. A running recording is
+ * finished first.
+ *
+ * Returns: %TRUE if recording started
+ */
+gboolean
+phoc_input_start_recording (PhocInput *self, const char *path, GError **error)
+{
+  g_assert (PHOC_IS_INPUT (self));
+
+  phoc_input_stop_recording (self);
+  self->recorder = phoc_input_recorder_new (path, error);
+
+  return self->recorder != NULL;
+}
+
+
+void
+phoc_input_stop_recording (PhocInput *self)
+{
+  g_assert (PHOC_IS_INPUT (self));
+
+  g_clear_pointer (&self->recorder, phoc_input_recorder_free);
+}
+
+/**
+ * phoc_input_record_event:
+ * @self: The input
+ * @type: The type of the event
+ * @device: (nullable): The device the event originates from
+ * @event: (nullable): The event
+ *
+ * Records an input event if a recording is running. See
+ * phoc_input_recorder_record() for the arguments.
+ */
+void
+phoc_input_record_event (PhocInput               *self,
+                         PhocInputRecordType      type,
+                         struct wlr_input_device *device,
+                         gconstpointer            event)
+{
+  if (G_LIKELY (self->recorder == NULL))
+    return;
+
+  phoc_input_recorder_record (self->recorder, type, device, event);
+}
@@ -4,6 +4,7 @@
 #include <wlr/types/wlr_cursor.h>
 #include <wlr/types/wlr_input_device.h>
 #include <wlr/types/wlr_seat.h>
+#include "input-recorder.h"
 #include "settings.h"
 #include "seat.h"
 #include "view.h"
@@ -24,5 +25,13 @@ PhocSeat          *phoc_input_seat_from_wlr_seat (PhocInput       *self,
                                                   struct wlr_seat *seat);
 GSList *           phoc_input_get_seats          (PhocInput *self);
 PhocSeat          *phoc_input_get_last_active_seat (PhocInput *self);
+gboolean           phoc_input_start_recording    (PhocInput         *self,
+                                                  const char        *path,
+                                                  GError           **error);
+void               phoc_input_stop_recording     (PhocInput         *self);
+void               phoc_input_record_event       (PhocInput               *self,
+                                                  PhocInputRecordType      type,
+                                                  struct wlr_input_device *device,
+                                                  gconstpointer            event);
 
 G_END_DECLS
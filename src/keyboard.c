@@ -58,6 +58,163 @@ enum {
 };
 static guint signals [N_SIGNALS];
 
+/*
+ * Compiling a keymap is expensive so compiled keymaps are shared
+ * between all keyboards, keyed by layout, variant and options.
+ */
+typedef struct _PhocKeymapCache {
+  struct xkb_context *context;
+  GHashTable         *keymaps;
+  GQueue             *pending;
+  guint               prefetch_id;
+  guint               n_users;
+} PhocKeymapCache;
+
+static PhocKeymapCache keymap_cache;
+
+
+/* Marks unset names in cache keys as libxkbcommon handles NULL and "" differently */
+#define KEYMAP_CACHE_UNSET "\x01"
+
+static char *
+keymap_cache_key (const char *layout, const char *variant, const char *options)
+{
+  return g_strdup_printf ("%s|%s|%s",
+                          layout ?: KEYMAP_CACHE_UNSET,
+                          variant ?: KEYMAP_CACHE_UNSET,
+                          options ?: KEYMAP_CACHE_UNSET);
+}
+
+
+static const char *
+keymap_cache_key_name (const char *name)
+{
+  return g_str_equal (name, KEYMAP_CACHE_UNSET) ? NULL : name;
+}
+
+
+static void
+keymap_cache_ref (void)
+{
+  if (keymap_cache.n_users++ > 0)
+    return;
+
+  keymap_cache.context = xkb_context_new (XKB_CONTEXT_NO_FLAGS);
+  if (keymap_cache.context == NULL)
+    g_warning ("Cannot create XKB context");
+
+  keymap_cache.keymaps = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                                (GDestroyNotify)xkb_keymap_unref);
+  keymap_cache.pending = g_queue_new ();
+}
+
+
+static void
+keymap_cache_unref (void)
+{
+  g_assert (keymap_cache.n_users > 0);
+
+  if (--keymap_cache.n_users > 0)
+    return;
+
+  g_clear_handle_id (&keymap_cache.prefetch_id, g_source_remove);
+  g_queue_free_full (keymap_cache.pending, g_free);
+  keymap_cache.pending = NULL;
+  g_clear_pointer (&keymap_cache.keymaps, g_hash_table_destroy);
+  g_clear_pointer (&keymap_cache.context, xkb_context_unref);
+}
+
+/*
+ * Returns: (transfer full): The keymap for the given cache key, either
+ * from the cache or freshly compiled.
+ */
+static struct xkb_keymap *
+keymap_cache_get_by_key (const char *key)
+{
+  struct xkb_rule_names rules = { 0 };
+  g_auto (GStrv) names = NULL;
+  struct xkb_keymap *keymap;
+  gint64 start;
+
+  if (keymap_cache.context == NULL)
+    return NULL;
+
+  keymap = g_hash_table_lookup (keymap_cache.keymaps, key);
+  if (keymap)
+    return xkb_keymap_ref (keymap);
+
+  /* Unset names pick up the defaults (e.g. XKB_DEFAULT_OPTIONS), empty ones don't */
+  names = g_strsplit (key, "|", 3);
+  g_assert (g_strv_length (names) == 3);
+  rules.layout = keymap_cache_key_name (names[0]);
+  rules.variant = keymap_cache_key_name (names[1]);
+  rules.options = keymap_cache_key_name (names[2]);
+
+  start = g_get_monotonic_time ();
+  keymap = xkb_keymap_new_from_names (keymap_cache.context, &rules, XKB_KEYMAP_COMPILE_NO_FLAGS);
+  if (keymap == NULL)
+    return NULL;
+
+  g_debug ("Compiled keymap '%s' in %.3f ms", key, (g_get_monotonic_time () - start) / 1000.0);
+  g_hash_table_insert (keymap_cache.keymaps, g_strdup (key), xkb_keymap_ref (keymap));
+
+  return keymap;
+}
+
+
+static struct xkb_keymap *
+keymap_cache_get (const char *layout, const char *variant, const char *options)
+{
+  g_autofree char *key = keymap_cache_key (layout, variant, options);
+
+  return keymap_cache_get_by_key (key);
+}
+
+
+static gboolean
+keymap_cache_prefetch_cb (gpointer unused)
+{
+  g_autofree char *key = g_queue_pop_head (keymap_cache.pending);
+  struct xkb_keymap *keymap;
+
+  /* One keymap per main loop iteration to not block input processing */
+  if (key) {
+    keymap = keymap_cache_get_by_key (key);
+    g_clear_pointer (&keymap, xkb_keymap_unref);
+  }
+
+  if (g_queue_is_empty (keymap_cache.pending)) {
+    keymap_cache.prefetch_id = 0;
+    return G_SOURCE_REMOVE;
+  }
+
+  return G_SOURCE_CONTINUE;
+}
+
+/*
+ * Queue the keymap for compilation when the main loop is idle
+ * so it's ready when switching layouts.
+ */
+static void
+keymap_cache_prefetch (const char *layout, const char *variant, const char *options)
+{
+  g_autofree char *key = keymap_cache_key (layout, variant, options);
+
+  if (keymap_cache.context == NULL)
+    return;
+
+  if (g_hash_table_contains (keymap_cache.keymaps, key) ||
+      g_queue_find_custom (keymap_cache.pending, key, (GCompareFunc)g_strcmp0))
+    return;
+
+  g_queue_push_tail (keymap_cache.pending, g_steal_pointer (&key));
+
+  if (keymap_cache.prefetch_id == 0) {
+    keymap_cache.prefetch_id = g_idle_add (keymap_cache_prefetch_cb, NULL);
+    g_source_set_name_by_id (keymap_cache.prefetch_id, "[phoc] keymap prefetch");
+  }
+}
+
 
 static ssize_t
 pressed_keysyms_index(const xkb_keysym_t *pressed_keysyms,
@@ -348,65 +505,75 @@ phoc_keyboard_handle_modifiers(PhocKeyboard *self)
 
 
 static void
-set_fallback_keymap (PhocKeyboard *self)
+phoc_keyboard_set_keymap (PhocKeyboard *self, struct xkb_keymap *keymap)
 {
-  struct xkb_context *context;
   PhocInputDevice *input_device = PHOC_INPUT_DEVICE (self);
   struct wlr_input_device *device = phoc_input_device_get_device (input_device);
 
-  context = xkb_context_new (XKB_CONTEXT_NO_FLAGS);
-  if (context == NULL) {
-       return;
+  g_assert (device->keyboard);
+
+  /* Cached keymaps are shared so this avoids reuploading the same keymap */
+  if (keymap == self->keymap) {
+    xkb_keymap_unref (keymap);
+    return;
   }
 
   xkb_keymap_unref (self->keymap);
-  self->keymap = xkb_keymap_new_from_names (context, NULL,
-                                            XKB_KEYMAP_COMPILE_NO_FLAGS);
-  xkb_context_unref (context);
+  self->keymap = keymap;
 
   wlr_keyboard_set_keymap(device->keyboard, self->keymap);
 }
 
 
 static void
-set_xkb_keymap (PhocKeyboard *self, const gchar *layout, const gchar *variant, const gchar *options)
+set_fallback_keymap (PhocKeyboard *self)
 {
-  struct xkb_rule_names rules = { 0 };
-  struct xkb_context *context = NULL;
-  struct xkb_keymap *keymap = NULL;
-  PhocInputDevice *input_device = PHOC_INPUT_DEVICE (self);
-  struct wlr_input_device *device = phoc_input_device_get_device (input_device);
+  struct xkb_keymap *keymap;
 
-  g_assert (device->keyboard);
+  keymap = keymap_cache_get (NULL, NULL, NULL);
+  if (keymap == NULL)
+    return;
 
-  rules.layout = layout;
-  rules.variant = variant;
-  rules.options = options;
+  phoc_keyboard_set_keymap (self, keymap);
+}
 
-  context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
-  if (context == NULL) {
-    g_warning ("Cannot create XKB context");
-    goto out;
-  }
 
-  keymap = xkb_map_new_from_names(context, &rules, XKB_KEYMAP_COMPILE_NO_FLAGS);
+static void
+set_xkb_keymap (PhocKeyboard *self, const gchar *layout, const gchar *variant, const gchar *options)
+{
+  struct xkb_keymap *keymap;
+
+  keymap = keymap_cache_get (layout, variant, options);
   if (keymap == NULL) {
     g_warning ("Cannot create XKB keymap");
+    if (self->keymap == NULL)
+      set_fallback_keymap (self);
+    return;
   }
 
- out:
-  if (context)
-    xkb_context_unref(context);
+  phoc_keyboard_set_keymap (self, keymap);
+}
 
-  if (keymap) {
-    xkb_keymap_unref (self->keymap);
-    self->keymap = keymap;
-  } else if (self->keymap == NULL) {
-    set_fallback_keymap (self);
-    return;
-  }
 
-  wlr_keyboard_set_keymap(device->keyboard, self->keymap);
+/* Compile the keymaps of the other configured layouts ahead of time */
+static void
+prefetch_xkb_keymaps (PhocKeyboard *self, GVariant *sources, const char *options)
+{
+  GVariantIter iter;
+  const gchar *type, *id;
+
+  g_variant_iter_init (&iter, sources);
+  while (g_variant_iter_next (&iter, "(&s&s)", &type, &id)) {
+    const gchar *layout = NULL, *variant = NULL;
+
+    if (g_strcmp0 (type, "xkb"))
+      continue;
+
+    if (!gnome_xkb_info_get_layout_info (self->xkbinfo, id, NULL, NULL, &layout, &variant))
+      continue;
+
+    keymap_cache_prefetch (layout, variant, options);
+  }
 }
 
 
@@ -463,6 +630,7 @@ on_input_setting_changed (PhocKeyboard *self,
   g_debug ("Switching to layout %s %s", layout, variant);
 
   set_xkb_keymap (self, layout, variant, xkb_options_string);
+  prefetch_xkb_keymaps (self, sources, xkb_options_string);
 }
 
 static void
@@ -505,9 +673,13 @@ handle_keyboard_key (struct wl_listener *listener, void *data)
 {
   PhocKeyboard *self = wl_container_of (listener, self, keyboard_key);
   struct wlr_event_keyboard_key *event = data;
+  struct wlr_input_device *device;
 
   g_assert (PHOC_IS_KEYBOARD (self));
+  device = phoc_input_device_get_device (PHOC_INPUT_DEVICE (self));
 
+  phoc_input_record_event (phoc_server_get_default ()->input, PHOC_INPUT_RECORD_KEY,
+                           device, event);
   phoc_keyboard_handle_key (self, event);
   g_signal_emit (self, signals[ACTIVITY], 0);
 }
@@ -517,9 +689,13 @@ static void
 handle_keyboard_modifiers (struct wl_listener *listener, void *data)
 {
   PhocKeyboard *self = wl_container_of (listener, self, keyboard_modifiers);
+  struct wlr_input_device *device;
 
   g_assert (PHOC_IS_KEYBOARD (self));
+  device = phoc_input_device_get_device (PHOC_INPUT_DEVICE (self));
 
+  phoc_input_record_event (phoc_server_get_default ()->input, PHOC_INPUT_RECORD_MODIFIERS,
+                           device, &device->keyboard->modifiers);
   phoc_keyboard_handle_modifiers (self);
   g_signal_emit (self, signals[ACTIVITY], 0);
 }
@@ -548,6 +724,7 @@ phoc_keyboard_finalize(GObject *object)
 
   xkb_keymap_unref (self->keymap);
   self->keymap = NULL;
+  keymap_cache_unref ();
 
   G_OBJECT_CLASS (phoc_keyboard_parent_class)->finalize (object);
 }
@@ -576,6 +753,7 @@ phoc_keyboard_constructed (GObject *object)
     "org.gnome.desktop.peripherals.keyboard");
   self->meta_key = WLR_MODIFIER_LOGO;
 
+  keymap_cache_ref ();
   set_fallback_keymap (self);
   self->xkbinfo = gnome_xkb_info_new ();
 
@@ -21,6 +21,7 @@
 #include "output.h"
 #include "seat.h"
 #include "server.h"
+#include "xdg-surface.h"
 
 #define LAYER_SHELL_LAYER_COUNT 4
 
@@ -248,6 +249,29 @@ static void change_osk(const struct osk_origin *osk, struct wl_list layers[LAYER
 	}
 }
 
+/*
+ * Views that got a configure due to the layout change are resized once
+ * they commit. Keep the output's content until all of them did so.
+ */
+static void
+transaction_add_view (PhocOutput *output, PhocView *view)
+{
+  struct wlr_box box;
+
+  if (!PHOC_IS_XDG_SURFACE (view))
+    return;
+
+  view_get_box (view, &box);
+  if (!wlr_output_layout_intersects (output->desktop->layout, output->wlr_output, &box))
+    return;
+
+  if (phoc_xdg_surface_from_view (view)->pending_move_resize_configure_serial == 0)
+    return;
+
+  phoc_output_transaction_add_view (output, view);
+}
+
+
 void
 phoc_layer_shell_arrange (PhocOutput *output)
 {
@@ -293,6 +317,7 @@ phoc_layer_shell_arrange (PhocOutput *output)
     } else if (output->desktop->maximize) {
       view_center (view, NULL);
     }
+    transaction_add_view (output, view);
   }
 
   // Arrange non-exlusive surfaces from top->bottom
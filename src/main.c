@@ -16,9 +16,17 @@
 #include <wlr/config.h>
 #include <wlr/render/wlr_renderer.h>
 #include <wlr/util/log.h>
+#include "input-replay.h"
 #include "settings.h"
 #include "server.h"
 
+static void
+on_replay_done (PhocInputReplay *replay)
+{
+  g_message ("Replayed %u input events", phoc_input_replay_get_n_events (replay));
+}
+
+
 static void
 print_version (void)
 {
@@ -74,6 +82,9 @@ static GDebugKey debug_keys[] =
  { .key = "touch-points",
    .value = PHOC_SERVER_DEBUG_FLAG_TOUCH_POINTS,
  },
+ { .key = "client-stats",
+   .value = PHOC_SERVER_DEBUG_FLAG_CLIENT_STATS,
+ },
 };
 
 
@@ -100,8 +111,12 @@ main(int argc, char **argv)
   g_autoptr(GError) err = NULL;
   g_autoptr(GMainLoop) loop = NULL;
   g_autoptr(PhocServer) server = NULL;
+  g_autoptr(PhocInputReplay) replay = NULL;
   g_autofree gchar *config_path = NULL;
   g_autofree gchar *exec = NULL;
+  g_autofree gchar *record_path = NULL;
+  g_autofree gchar *replay_path = NULL;
+  double replay_speed = 1.0;
   PhocServerFlags flags = PHOC_SERVER_FLAG_NONE;
   PhocServerDebugFlags debug_flags = PHOC_SERVER_DEBUG_FLAG_NONE;
   gboolean version = FALSE, shell_mode = FALSE;
@@ -115,6 +130,12 @@ main(int argc, char **argv)
      "Command (session) that will be ran at startup", NULL},
     {"shell", 'S', 0, G_OPTION_ARG_NONE, &shell_mode,
      "Whether to expect a shell to attach", NULL},
+    {"record-input", 0, 0, G_OPTION_ARG_FILENAME, &record_path,
+     "Record input events to FILE", "FILE"},
+    {"replay-input", 0, 0, G_OPTION_ARG_FILENAME, &replay_path,
+     "Replay input events recorded in FILE", "FILE"},
+    {"replay-speed", 0, 0, G_OPTION_ARG_DOUBLE, &replay_speed,
+     "Speed up replay by FACTOR, 0 replays as fast as possible (default: 1)", "FACTOR"},
     {"version", 0, 0, G_OPTION_ARG_NONE, &version,
      "Show version information", NULL},
     { NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL }
@@ -147,6 +168,23 @@ main(int argc, char **argv)
   if (!phoc_server_setup (server, config_path, exec, loop, flags, debug_flags))
     return 1;
 
+  if (record_path && !phoc_input_start_recording (server->input, record_path, &err)) {
+    g_warning ("Failed to record input: %s", err->message);
+    return 1;
+  }
+
+  if (replay_path) {
+    PhocSeat *seat = phoc_input_get_seat (server->input, PHOC_CONFIG_DEFAULT_SEAT_NAME);
+
+    replay = phoc_input_replay_new (replay_path, &err);
+    if (replay == NULL) {
+      g_warning ("Failed to load input recording: %s", err->message);
+      return 1;
+    }
+    g_signal_connect (replay, "done", G_CALLBACK (on_replay_done), NULL);
+    phoc_input_replay_start (replay, seat, replay_speed);
+  }
+
   g_main_loop_run (loop);
 
   return phoc_server_get_session_exit_status (server);
@@ -4,11 +4,15 @@
 
 #define _POSIX_C_SOURCE 200809L
 #include <assert.h>
+#include <math.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <sys/stat.h>
 #include <time.h>
 #include <wlr/backend/drm.h>
 #include <wlr/config.h>
+#include <wlr/interfaces/wlr_output.h>
+#include <wlr/types/wlr_buffer.h>
 #include <wlr/types/wlr_compositor.h>
 #include <wlr/types/wlr_output_layout.h>
 #include <wlr/types/wlr_output_power_management_v1.h>
@@ -24,6 +28,11 @@
 #include "utils.h"
 #include "xwayland-surface.h"
 
+#define PHOC_OUTPUT_TRANSACTION_TIMEOUT 150 /* ms */
+#define PHOC_OUTPUT_ROTATION_DURATION   300 /* ms */
+/* zwp_linux_dmabuf_feedback_v1.tranche_flags.scanout */
+#define PHOC_DMABUF_TRANCHE_FLAG_SCANOUT 1
+
 static void phoc_output_initable_iface_init (GInitableIface *iface);
 
 G_DEFINE_TYPE_WITH_CODE (PhocOutput, phoc_output, G_TYPE_OBJECT,
@@ -146,9 +155,136 @@ phoc_output_get_property (GObject    *object,
   }
 }
 
+static void
+handle_scanout_surface_destroy (struct wl_listener *listener, void *data)
+{
+  PhocOutput *self = wl_container_of (listener, self, scanout.surface_destroy);
+
+  wl_list_remove (&self->scanout.surface_destroy.link);
+  wl_list_init (&self->scanout.surface_destroy.link);
+  self->scanout.surface = NULL;
+}
+
+
+static dev_t
+get_drm_device (int drm_fd, dev_t fallback)
+{
+  struct stat st;
+
+  if (drm_fd < 0 || fstat (drm_fd, &st) != 0)
+    return fallback;
+
+  return st.st_rdev;
+}
+
+/*
+ * Build the feedback sent to scanout candidates: a tranche with the
+ * primary plane's formats the renderer can import as well (so we can
+ * still composite if scanout fails) followed by the renderer's
+ * formats.
+ */
+static gboolean
+scanout_feedback_init (PhocOutput *self)
+{
+  PhocServer *server = phoc_server_get_default ();
+  struct wlr_renderer *wlr_renderer = phoc_renderer_get_wlr_renderer (server->renderer);
+  const struct wlr_drm_format_set *render_formats, *primary_formats;
+  dev_t main_device, target_device;
+
+  if (self->scanout.checked)
+    return self->scanout.formats.len > 0;
+  self->scanout.checked = TRUE;
+
+  if (server->linux_dmabuf == NULL)
+    return FALSE;
+
+  /* Only backends with planes (DRM) know about primary plane formats */
+  if (self->wlr_output->impl->get_primary_formats == NULL)
+    return FALSE;
+
+  render_formats = wlr_renderer_get_dmabuf_texture_formats (wlr_renderer);
+  primary_formats = self->wlr_output->impl->get_primary_formats (self->wlr_output,
+                                                                 WLR_BUFFER_CAP_DMABUF);
+  if (render_formats == NULL || primary_formats == NULL)
+    return FALSE;
+
+  main_device = get_drm_device (wlr_renderer_get_drm_fd (wlr_renderer), 0);
+  if (main_device == 0)
+    return FALSE;
+  target_device = get_drm_device (wlr_backend_get_drm_fd (self->wlr_output->backend), main_device);
+
+  for (size_t i = 0; i < primary_formats->len; i++) {
+    const struct wlr_drm_format *fmt = primary_formats->formats[i];
+
+    for (size_t j = 0; j < fmt->len; j++) {
+      if (wlr_drm_format_set_has (render_formats, fmt->format, fmt->modifiers[j]))
+        wlr_drm_format_set_add (&self->scanout.formats, fmt->format, fmt->modifiers[j]);
+    }
+  }
+
+  if (self->scanout.formats.len == 0) {
+    g_debug ("No scanout capable formats on %s", self->wlr_output->name);
+    return FALSE;
+  }
+
+  self->scanout.tranches[0] = (struct wlr_linux_dmabuf_feedback_v1_tranche) {
+    .target_device = target_device,
+    .flags = PHOC_DMABUF_TRANCHE_FLAG_SCANOUT,
+    .formats = &self->scanout.formats,
+  };
+  self->scanout.tranches[1] = (struct wlr_linux_dmabuf_feedback_v1_tranche) {
+    .target_device = main_device,
+    .formats = render_formats,
+  };
+  self->scanout.feedback = (struct wlr_linux_dmabuf_feedback_v1) {
+    .main_device = main_device,
+    .tranches_len = G_N_ELEMENTS (self->scanout.tranches),
+    .tranches = self->scanout.tranches,
+  };
+
+  return TRUE;
+}
+
+
+static void
+scanout_feedback_set_surface (PhocOutput *self, struct wlr_surface *surface)
+{
+  PhocServer *server = phoc_server_get_default ();
+
+  if (self->scanout.surface == surface)
+    return;
+
+  if (self->scanout.surface) {
+    /* Back to the default feedback */
+    wlr_linux_dmabuf_v1_set_surface_feedback (server->linux_dmabuf, self->scanout.surface, NULL);
+    wl_list_remove (&self->scanout.surface_destroy.link);
+    wl_list_init (&self->scanout.surface_destroy.link);
+    self->scanout.surface = NULL;
+  }
+
+  if (surface == NULL)
+    return;
+
+  if (!wlr_linux_dmabuf_v1_set_surface_feedback (server->linux_dmabuf, surface,
+                                                 &self->scanout.feedback)) {
+    g_warning ("Failed to send scanout feedback on %s", self->wlr_output->name);
+    return;
+  }
+
+  self->scanout.surface = surface;
+  self->scanout.capable = FALSE;
+  self->scanout.feedback_surfaces++;
+  self->scanout.surface_destroy.notify = handle_scanout_surface_destroy;
+  wl_signal_add (&surface->events.destroy, &self->scanout.surface_destroy);
+}
+
+
 static void
 phoc_output_init (PhocOutput *self)
 {
+  wl_list_init (&self->idle_activity.link);
+  wl_list_init (&self->scanout.surface_destroy.link);
+  self->transaction.views = g_ptr_array_new ();
 }
 
 PhocOutput *
@@ -171,8 +307,10 @@ update_output_manager_config (PhocDesktop *desktop)
   wl_list_for_each (output, &desktop->outputs, link) {
     struct wlr_output_configuration_head_v1 *config_head =
       wlr_output_configuration_head_v1_create (config, output->wlr_output);
+    PhocOutput *positioned = output->mirror.source ?: output;
     struct wlr_box *output_box = wlr_output_layout_get_box (
-      output->desktop->layout, output->wlr_output);
+      output->desktop->layout, positioned->wlr_output);
+    /* Mirrors are reported at their source's position */
     if (output_box) {
       config_head->state.x = output_box->x;
       config_head->state.y = output_box->y;
@@ -200,6 +338,191 @@ phoc_output_handle_enable (struct wl_listener *listener, void *data)
   update_output_manager_config (self->desktop);
 }
 
+/*
+ * Find the mode with the lowest refresh rate that is still at or
+ * above the idle refresh rate and matches the current resolution.
+ */
+static struct wlr_output_mode *
+idle_refresh_find_mode (PhocOutput *self)
+{
+  struct wlr_output *wlr_output = self->wlr_output;
+  struct wlr_output_mode *mode, *best = NULL;
+
+  wl_list_for_each (mode, &wlr_output->modes, link) {
+    if (mode->width != wlr_output->width || mode->height != wlr_output->height)
+      continue;
+
+    if (mode->refresh < self->idle_refresh.refresh || mode->refresh >= wlr_output->refresh)
+      continue;
+
+    if (best == NULL || mode->refresh < best->refresh)
+      best = mode;
+  }
+
+  return best;
+}
+
+
+static void
+idle_refresh_stage_switch (PhocOutput *self)
+{
+  struct wlr_output *wlr_output = self->wlr_output;
+
+  if (self->idle_refresh.switch_mode) {
+    wlr_output_set_mode (wlr_output, self->idle_refresh.switch_mode);
+  } else {
+    wlr_output_set_custom_mode (wlr_output, wlr_output->width, wlr_output->height,
+                                self->idle_refresh.switch_refresh);
+  }
+}
+
+/*
+ * Apply the mode together with the next rendered frame rather than
+ * with a commit of its own (which would show a black frame). The
+ * damage needed to get that frame and the one wlroots adds on mode
+ * changes isn't activity.
+ */
+static void
+idle_refresh_switch (PhocOutput *self, struct wlr_output_mode *mode, int refresh)
+{
+  self->idle_refresh.switching = TRUE;
+  self->idle_refresh.switch_mode = mode;
+  self->idle_refresh.switch_refresh = refresh;
+  idle_refresh_stage_switch (self);
+  phoc_output_damage_whole (self);
+}
+
+
+/*
+ * Drop a staged but not yet committed refresh rate switch so it doesn't
+ * get tested or committed along with an output configuration. It's
+ * staged again with the next frame unless the configuration sets a mode.
+ */
+static void
+idle_refresh_unstage_switch (PhocOutput *self)
+{
+  if (self->idle_refresh.switching)
+    wlr_output_rollback (self->wlr_output);
+}
+
+
+static void
+idle_refresh_enter (PhocOutput *self)
+{
+  struct wlr_output *wlr_output = self->wlr_output;
+  struct wlr_output_mode *mode = NULL;
+
+  if (self->idle_refresh.full_refresh || !wlr_output->enabled)
+    return;
+
+  /* The panel already refreshes on demand */
+  if (wlr_output->adaptive_sync_status == WLR_OUTPUT_ADAPTIVE_SYNC_ENABLED)
+    return;
+
+  if (wl_list_empty (&wlr_output->modes)) {
+    if (wlr_output->refresh <= self->idle_refresh.refresh)
+      return;
+  } else {
+    mode = idle_refresh_find_mode (self);
+    if (mode == NULL)
+      return;
+  }
+
+  g_debug ("Lowering refresh rate of %s from %d mHz", wlr_output->name, wlr_output->refresh);
+  self->idle_refresh.full_mode = wlr_output->current_mode;
+  self->idle_refresh.full_refresh = wlr_output->refresh;
+  idle_refresh_switch (self, mode, mode ? mode->refresh : self->idle_refresh.refresh);
+}
+
+
+static void
+idle_refresh_leave (PhocOutput *self)
+{
+  if (!self->idle_refresh.full_refresh)
+    return;
+
+  g_debug ("Restoring refresh rate of %s to %d mHz", self->wlr_output->name,
+           self->idle_refresh.full_refresh);
+  idle_refresh_switch (self, self->idle_refresh.full_mode, self->idle_refresh.full_refresh);
+  self->idle_refresh.full_mode = NULL;
+  self->idle_refresh.full_refresh = 0;
+}
+
+
+static gboolean
+on_idle_refresh_timeout (gpointer data)
+{
+  PhocOutput *self = PHOC_OUTPUT (data);
+  gint64 idle = (g_get_monotonic_time () - self->idle_refresh.last_activity) / 1000;
+
+  self->idle_refresh.timer_id = 0;
+
+  /* Activity since the timer got armed, wait for the remaining time */
+  if (idle < self->idle_refresh.timeout) {
+    self->idle_refresh.timer_id = g_timeout_add (self->idle_refresh.timeout - idle,
+                                                 on_idle_refresh_timeout, self);
+    g_source_set_name_by_id (self->idle_refresh.timer_id, "[phoc] idle refresh");
+    return G_SOURCE_REMOVE;
+  }
+
+  idle_refresh_enter (self);
+  return G_SOURCE_REMOVE;
+}
+
+
+static void
+idle_refresh_note_activity (PhocOutput *self)
+{
+  if (!self->idle_refresh.refresh)
+    return;
+
+  /* Only record the time here, it's checked once the timer fires */
+  self->idle_refresh.last_activity = g_get_monotonic_time ();
+  idle_refresh_leave (self);
+
+  if (self->idle_refresh.timer_id == 0) {
+    self->idle_refresh.timer_id = g_timeout_add (self->idle_refresh.timeout,
+                                                 on_idle_refresh_timeout, self);
+    g_source_set_name_by_id (self->idle_refresh.timer_id, "[phoc] idle refresh");
+  }
+}
+
+
+static void
+transaction_finish (PhocOutput *self)
+{
+  g_clear_handle_id (&self->transaction.timeout_id, g_source_remove);
+  g_ptr_array_set_size (self->transaction.views, 0);
+
+  /* Show the new layout in one go */
+  phoc_output_damage_whole (self);
+}
+
+
+static gboolean
+on_transaction_timeout (gpointer data)
+{
+  PhocOutput *self = PHOC_OUTPUT (data);
+
+  g_debug ("Layout transaction on %s timed out, %u views didn't commit",
+           self->wlr_output->name, self->transaction.views->len);
+
+  self->transaction.timeout_id = 0;
+  transaction_finish (self);
+
+  return G_SOURCE_REMOVE;
+}
+
+
+static void
+phoc_output_handle_idle_activity (struct wl_listener *listener, void *data)
+{
+  PhocOutput *self = wl_container_of (listener, self, idle_activity);
+
+  idle_refresh_note_activity (self);
+}
+
+
 static void
 phoc_output_damage_handle_frame (struct wl_listener *listener,
                                  void               *data)
@@ -208,6 +531,17 @@ phoc_output_damage_handle_frame (struct wl_listener *listener,
   PhocServer *server = phoc_server_get_default ();
   PhocRenderer *renderer = phoc_server_get_renderer (server);
 
+  /* Damage caused by switching the refresh rate isn't activity */
+  if (self->idle_refresh.switching) {
+    /* A failed or rolled back commit dropped the mode, stage it again */
+    if (!(self->wlr_output->pending.committed & WLR_OUTPUT_STATE_MODE))
+      idle_refresh_stage_switch (self);
+  } else if (self->idle_refresh.ignore_frames) {
+    self->idle_refresh.ignore_frames--;
+  } else if (pixman_region32_not_empty (&self->damage->current)) {
+    idle_refresh_note_activity (self);
+  }
+
   phoc_renderer_render_output (renderer, self);
 }
 
@@ -235,12 +569,55 @@ phoc_output_handle_mode (struct wl_listener *listener, void *data)
   update_output_manager_config (self->desktop);
 }
 
+/*
+ * Hand a new frame of the source to the mirror. The previously imported
+ * texture refers to the old buffer's content so it's dropped too.
+ */
+static void
+mirror_set_buffer (PhocOutput *self, struct wlr_buffer *buffer)
+{
+  g_clear_pointer (&self->mirror.texture, wlr_texture_destroy);
+  g_clear_pointer (&self->mirror.buffer, wlr_buffer_unlock);
+
+  /* Keeps the source's swapchain from reusing it while the mirror shows it */
+  if (buffer)
+    self->mirror.buffer = wlr_buffer_lock (buffer);
+  self->mirror.needs_commit = buffer != NULL;
+}
+
 static void
 phoc_output_handle_commit (struct wl_listener *listener, void *data)
 {
   PhocOutput *self = wl_container_of (listener, self, commit);
+  struct wlr_output_event_commit *event = data;
 
   phoc_layer_shell_arrange (self);
+
+  if (self->blank.unblank_ts && (event->committed & WLR_OUTPUT_STATE_BUFFER)) {
+    self->blank.resume_time = g_get_monotonic_time () - self->blank.unblank_ts;
+    self->blank.unblank_ts = 0;
+    g_debug ("Unblanking %s took %" G_GINT64_FORMAT " µs until the first frame",
+             self->wlr_output->name, self->blank.resume_time);
+  }
+
+  if (self->mirror.mirrors && (event->committed & WLR_OUTPUT_STATE_BUFFER) && event->buffer) {
+    for (GSList *elem = self->mirror.mirrors; elem; elem = elem->next) {
+      PhocOutput *mirror = PHOC_OUTPUT (elem->data);
+
+      mirror_set_buffer (mirror, event->buffer);
+    }
+  }
+
+  if (self->idle_refresh.switching && (event->committed & WLR_OUTPUT_STATE_MODE)) {
+    g_debug ("Switched refresh rate of %s to %d mHz", self->wlr_output->name,
+             self->wlr_output->refresh);
+    self->idle_refresh.switching = FALSE;
+    /* wlroots damages the whole output on mode changes */
+    self->idle_refresh.ignore_frames = 1;
+  }
+
+  if (event->committed & WLR_OUTPUT_STATE_SCALE)
+    phoc_fractional_scale_manager_update_scales (self->desktop->fractional_scale_manager);
 }
 
 static float
@@ -317,6 +694,37 @@ phoc_output_set_mode (struct wlr_output *output, PhocOutputConfig *oc)
 }
 
 
+/*
+ * Set up mirrors configured in phoc.ini involving this output, either
+ * as mirror or as source.
+ */
+static void
+mirror_apply_config (PhocOutput *self)
+{
+  PhocServer *server = phoc_server_get_default ();
+  PhocConfig *config = server->config;
+  PhocOutputConfig *output_config;
+  PhocOutput *output;
+
+  output_config = phoc_config_get_output (config, self->wlr_output);
+  wl_list_for_each (output, &self->desktop->outputs, link) {
+    PhocOutputConfig *other_config;
+
+    if (output == self)
+      continue;
+
+    if (output_config && g_strcmp0 (output_config->mirror, output->wlr_output->name) == 0) {
+      phoc_output_set_mirror_source (self, output);
+      continue;
+    }
+
+    other_config = phoc_config_get_output (config, output->wlr_output);
+    if (other_config && g_strcmp0 (other_config->mirror, self->wlr_output->name) == 0)
+      phoc_output_set_mirror_source (output, self);
+  }
+}
+
+
 static gboolean
 phoc_output_initable_init (GInitable    *initable,
                            GCancellable *cancellable,
@@ -418,6 +826,16 @@ phoc_output_initable_init (GInitable    *initable,
   }
   wlr_output_commit (self->wlr_output);
 
+  mirror_apply_config (self);
+
+  if (output_config && output_config->idle.refresh_rate > 0) {
+    self->idle_refresh.refresh = (int)(output_config->idle.refresh_rate * 1000);
+    self->idle_refresh.timeout = output_config->idle.timeout;
+    self->idle_activity.notify = phoc_output_handle_idle_activity;
+    wl_signal_add (&self->desktop->idle->events.activity_notify, &self->idle_activity);
+    idle_refresh_note_activity (self);
+  }
+
   for (GSList *elem = phoc_input_get_seats (input); elem; elem = elem->next) {
     PhocSeat *seat = PHOC_SEAT (elem->data);
 
@@ -440,11 +858,28 @@ phoc_output_finalize (GObject *object)
 {
   PhocOutput *self = PHOC_OUTPUT (object);
 
+  /* Don't put an output that's going away back into the layout */
+  if (self->mirror.source) {
+    self->mirror.source->mirror.mirrors = g_slist_remove (self->mirror.source->mirror.mirrors, self);
+    self->mirror.source = NULL;
+  }
+  mirror_set_buffer (self, NULL);
+  while (self->mirror.mirrors)
+    phoc_output_set_mirror_source (PHOC_OUTPUT (self->mirror.mirrors->data), NULL);
+
   wl_list_remove (&self->link);
   wl_list_remove (&self->enable.link);
   wl_list_remove (&self->mode.link);
   wl_list_remove (&self->commit.link);
   wl_list_remove (&self->output_destroy.link);
+  wl_list_remove (&self->idle_activity.link);
+  g_clear_handle_id (&self->idle_refresh.timer_id, g_source_remove);
+  g_clear_handle_id (&self->transaction.timeout_id, g_source_remove);
+  g_clear_pointer (&self->transaction.views, g_ptr_array_unref);
+  g_clear_pointer (&self->rotation.texture, wlr_texture_destroy);
+  g_clear_pointer (&self->rotation.buffer, wlr_buffer_drop);
+  scanout_feedback_set_surface (self, NULL);
+  wlr_drm_format_set_finish (&self->scanout.formats);
   g_clear_list (&self->debug_touch_points, g_free);
 
   for (size_t i = 0; i < G_N_ELEMENTS (self->layers); ++i)
@@ -919,82 +1354,304 @@ phoc_output_damage_from_local_surface (PhocOutput *self, struct wlr_surface
                                         damage_surface_iterator, &whole);
 }
 
-void
-handle_output_manager_apply (struct wl_listener *listener, void *data)
-{
-  PhocDesktop *desktop =
-    wl_container_of (listener, desktop, output_manager_apply);
-  struct wlr_output_configuration_v1 *config = data;
+typedef struct {
+  bool                     committed;
+  bool                     enabled;
+  struct wlr_output_mode  *mode;
+  int32_t                  width, height, refresh;
+  enum wl_output_transform transform;
+  float                    scale;
+} PhocOutputHeadState;
 
-  bool ok = true;
-  struct wlr_output_configuration_head_v1 *config_head;
 
-  // First disable outputs we need to disable
-  wl_list_for_each (config_head, &config->heads, link) {
-    struct wlr_output *wlr_output = config_head->state.output;
+static void
+save_head_state (struct wlr_output *wlr_output, PhocOutputHeadState *state)
+{
+  *state = (PhocOutputHeadState) {
+    .enabled = wlr_output->enabled,
+    .mode = wlr_output->current_mode,
+    .width = wlr_output->width,
+    .height = wlr_output->height,
+    .refresh = wlr_output->refresh,
+    .transform = wlr_output->transform,
+    .scale = wlr_output->scale,
+  };
+}
 
-    if (config_head->state.enabled)
-      continue;
 
-    if (!wlr_output->enabled)
-      continue;
+static void
+stage_saved_head_state (struct wlr_output *wlr_output, PhocOutputHeadState *state)
+{
+  wlr_output_enable (wlr_output, state->enabled);
+  if (!state->enabled)
+    return;
 
-    wlr_output_enable (wlr_output, false);
-    wlr_output_layout_remove (desktop->layout, wlr_output);
-    ok &= wlr_output_commit (wlr_output);
-  }
+  if (state->mode)
+    wlr_output_set_mode (wlr_output, state->mode);
+  else
+    wlr_output_set_custom_mode (wlr_output, state->width, state->height, state->refresh);
+  wlr_output_set_transform (wlr_output, state->transform);
+  wlr_output_set_scale (wlr_output, state->scale);
+}
 
-  // Then enable outputs that need to
-  wl_list_for_each (config_head, &config->heads, link) {
-    struct wlr_output *wlr_output = config_head->state.output;
-    PhocOutput *output = wlr_output->data;
+/*
+ * Set the pending state of a head's output. Only properties that
+ * differ from the current state are set so unchanged outputs don't
+ * get a commit (and hence a modeset) at all.
+ */
+static void
+stage_config_head (struct wlr_output_configuration_head_v1 *config_head)
+{
+  struct wlr_output *wlr_output = config_head->state.output;
 
-    if (!config_head->state.enabled)
-      continue;
+  if (!config_head->state.enabled) {
+    if (wlr_output->enabled)
+      wlr_output_enable (wlr_output, false);
+    return;
+  }
 
+  if (!wlr_output->enabled)
     wlr_output_enable (wlr_output, true);
-    if (config_head->state.mode != NULL) {
+
+  if (config_head->state.mode != NULL) {
+    if (config_head->state.mode != wlr_output->current_mode)
       wlr_output_set_mode (wlr_output, config_head->state.mode);
-    } else {
-      wlr_output_set_custom_mode (wlr_output,
-                                  config_head->state.custom_mode.width,
-                                  config_head->state.custom_mode.height,
-                                  config_head->state.custom_mode.refresh);
-    }
-    wlr_output_layout_add (desktop->layout, wlr_output,
-                           config_head->state.x, config_head->state.y);
-    wlr_output_set_transform (wlr_output, config_head->state.transform);
-    wlr_output_set_scale (wlr_output, config_head->state.scale);
-    ok &= wlr_output_commit (wlr_output);
-    if (output->fullscreen_view) {
-      phoc_view_set_fullscreen (output->fullscreen_view, true, wlr_output);
-    }
+  } else if (config_head->state.custom_mode.width != wlr_output->width ||
+             config_head->state.custom_mode.height != wlr_output->height ||
+             (config_head->state.custom_mode.refresh &&
+              config_head->state.custom_mode.refresh != wlr_output->refresh)) {
+    wlr_output_set_custom_mode (wlr_output,
+                                config_head->state.custom_mode.width,
+                                config_head->state.custom_mode.height,
+                                config_head->state.custom_mode.refresh);
   }
 
-  if (ok) {
-    wlr_output_configuration_v1_send_succeeded (config);
-  } else {
-    wlr_output_configuration_v1_send_failed (config);
-  }
-  wlr_output_configuration_v1_destroy (config);
+  if (config_head->state.transform != wlr_output->transform)
+    wlr_output_set_transform (wlr_output, config_head->state.transform);
 
-  update_output_manager_config (desktop);
+  if (config_head->state.scale != wlr_output->scale)
+    wlr_output_set_scale (wlr_output, config_head->state.scale);
 }
 
-void
-handle_output_manager_test (struct wl_listener *listener, void *data)
+
+/* wlroots doesn't reject these, they'd only fail once rendering */
+static gboolean
+config_head_is_valid (struct wlr_output_configuration_head_v1 *config_head)
 {
-  PhocDesktop *desktop =
-    wl_container_of (listener, desktop, output_manager_test);
-  struct wlr_output_configuration_v1 *config = data;
+  if (!config_head->state.enabled)
+    return TRUE;
 
-  // TODO: implement test-only mode
-  wlr_output_configuration_v1_send_succeeded (config);
-  wlr_output_configuration_v1_destroy (config);
-}
+  if (config_head->state.scale <= 0)
+    return FALSE;
 
-void
-phoc_output_handle_output_power_manager_set_mode (struct wl_listener *listener, void *data)
+  if (config_head->state.mode == NULL &&
+      (config_head->state.custom_mode.width <= 0 || config_head->state.custom_mode.height <= 0))
+    return FALSE;
+
+  return TRUE;
+}
+
+
+static gboolean
+stage_and_test_config (struct wlr_output_configuration_v1 *config)
+{
+  struct wlr_output_configuration_head_v1 *config_head;
+
+  wl_list_for_each (config_head, &config->heads, link)
+    idle_refresh_unstage_switch (config_head->state.output->data);
+
+  wl_list_for_each (config_head, &config->heads, link) {
+    struct wlr_output *wlr_output = config_head->state.output;
+
+    if (!config_head_is_valid (config_head)) {
+      g_debug ("Invalid output configuration for %s", wlr_output->name);
+      return FALSE;
+    }
+
+    stage_config_head (config_head);
+    if (wlr_output->pending.committed && !wlr_output_test (wlr_output)) {
+      g_debug ("Output configuration for %s failed test", wlr_output->name);
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+
+static void
+rollback_config (struct wlr_output_configuration_v1 *config)
+{
+  struct wlr_output_configuration_head_v1 *config_head;
+
+  wl_list_for_each (config_head, &config->heads, link)
+    wlr_output_rollback (config_head->state.output);
+}
+
+
+/*
+ * The output management protocol has no notion of mirroring, enabled
+ * outputs placed at the same position mirror the built-in one or,
+ * if there's none, the first one of them.
+ */
+static PhocOutput *
+config_find_mirror_source (struct wlr_output_configuration_v1      *config,
+                           struct wlr_output_configuration_head_v1 *config_head)
+{
+  struct wlr_output_configuration_head_v1 *other, *first = NULL, *builtin = NULL, *source;
+
+  wl_list_for_each (other, &config->heads, link) {
+    if (!other->state.enabled ||
+        other->state.x != config_head->state.x || other->state.y != config_head->state.y) {
+      continue;
+    }
+
+    if (first == NULL)
+      first = other;
+    if (builtin == NULL && phoc_output_is_builtin (other->state.output->data))
+      builtin = other;
+  }
+
+  source = builtin ?: first;
+  if (source == NULL || source == config_head)
+    return NULL;
+
+  return source->state.output->data;
+}
+
+
+void
+handle_output_manager_apply (struct wl_listener *listener, void *data)
+{
+  PhocDesktop *desktop =
+    wl_container_of (listener, desktop, output_manager_apply);
+  struct wlr_output_configuration_v1 *config = data;
+  struct wlr_output_configuration_head_v1 *config_head;
+  g_autofree PhocOutputHeadState *saved = NULL;
+  bool ok = true;
+  int i;
+
+  saved = g_new0 (PhocOutputHeadState, wl_list_length (&config->heads));
+  i = 0;
+  wl_list_for_each (config_head, &config->heads, link)
+    save_head_state (config_head->state.output, &saved[i++]);
+
+  // Validate the whole configuration before touching any output
+  if (!stage_and_test_config (config)) {
+    rollback_config (config);
+    wlr_output_configuration_v1_send_failed (config);
+    wlr_output_configuration_v1_destroy (config);
+    return;
+  }
+
+  // First disable outputs we need to disable to free up CRTCs, then
+  // enable the others. Unchanged outputs have nothing pending.
+  for (int pass = 0; pass < 2 && ok; pass++) {
+    bool enable = pass;
+
+    i = 0;
+    wl_list_for_each (config_head, &config->heads, link) {
+      struct wlr_output *wlr_output = config_head->state.output;
+      PhocOutput *output = wlr_output->data;
+      PhocOutputHeadState *state = &saved[i++];
+      bool mode_set;
+
+      if (config_head->state.enabled != enable || !wlr_output->pending.committed)
+        continue;
+
+      if (enable && (wlr_output->pending.committed & WLR_OUTPUT_STATE_TRANSFORM))
+        phoc_output_rotation_begin (output);
+
+      mode_set = wlr_output->pending.committed & WLR_OUTPUT_STATE_MODE;
+      if (!wlr_output_commit (wlr_output)) {
+        g_warning ("Failed to commit output configuration for %s", wlr_output->name);
+        ok = false;
+        break;
+      }
+      state->committed = true;
+
+      /* An explicitly configured mode replaces the one saved while downclocked */
+      if (mode_set) {
+        output->idle_refresh.full_mode = NULL;
+        output->idle_refresh.full_refresh = 0;
+        output->idle_refresh.switching = FALSE;
+      }
+    }
+  }
+
+  if (!ok) {
+    // Restore the outputs we already changed, drop the rest
+    i = 0;
+    wl_list_for_each (config_head, &config->heads, link) {
+      struct wlr_output *wlr_output = config_head->state.output;
+      PhocOutputHeadState *state = &saved[i++];
+
+      wlr_output_rollback (wlr_output);
+      phoc_output_rotation_clear (wlr_output->data);
+      if (!state->committed)
+        continue;
+
+      stage_saved_head_state (wlr_output, state);
+      if (!wlr_output_commit (wlr_output))
+        g_warning ("Failed to restore output configuration for %s", wlr_output->name);
+    }
+    wlr_output_configuration_v1_send_failed (config);
+    wlr_output_configuration_v1_destroy (config);
+    update_output_manager_config (desktop);
+    return;
+  }
+
+  i = 0;
+  wl_list_for_each (config_head, &config->heads, link) {
+    struct wlr_output *wlr_output = config_head->state.output;
+    PhocOutput *output = wlr_output->data;
+    PhocOutputHeadState *state = &saved[i++];
+    PhocOutput *mirror_source;
+    struct wlr_box *box;
+
+    if (!config_head->state.enabled) {
+      phoc_output_set_mirror_source (output, NULL);
+      wlr_output_layout_remove (desktop->layout, wlr_output);
+      continue;
+    }
+
+    mirror_source = config_find_mirror_source (config, config_head);
+    phoc_output_set_mirror_source (output, mirror_source);
+    if (mirror_source)
+      continue;
+
+    box = wlr_output_layout_get_box (desktop->layout, wlr_output);
+    if (box == NULL || box->x != config_head->state.x || box->y != config_head->state.y) {
+      wlr_output_layout_add (desktop->layout, wlr_output,
+                             config_head->state.x, config_head->state.y);
+    }
+
+    if (state->committed && output->fullscreen_view)
+      phoc_view_set_fullscreen (output->fullscreen_view, true, wlr_output);
+  }
+
+  wlr_output_configuration_v1_send_succeeded (config);
+  wlr_output_configuration_v1_destroy (config);
+
+  update_output_manager_config (desktop);
+}
+
+void
+handle_output_manager_test (struct wl_listener *listener, void *data)
+{
+  struct wlr_output_configuration_v1 *config = data;
+
+  if (stage_and_test_config (config))
+    wlr_output_configuration_v1_send_succeeded (config);
+  else
+    wlr_output_configuration_v1_send_failed (config);
+
+  rollback_config (config);
+  wlr_output_configuration_v1_destroy (config);
+}
+
+void
+phoc_output_handle_output_power_manager_set_mode (struct wl_listener *listener, void *data)
 {
   struct wlr_output_power_v1_set_mode_event *event = data;
   PhocOutput *self;
@@ -1019,14 +1676,8 @@ phoc_output_handle_output_power_manager_set_mode (struct wl_listener *listener,
   if (enable == self->wlr_output->enabled)
     return;
 
-  wlr_output_enable (self->wlr_output, enable);
-  if (!wlr_output_commit (self->wlr_output)) {
+  if (!phoc_output_set_blank (self, !enable))
     g_warning ("Failed to commit power mode change to %d for %p", enable, self);
-    return;
-  }
-
-  if (enable)
-    phoc_output_damage_whole (self);
 }
 
 /**
@@ -1095,3 +1746,440 @@ phoc_output_has_fullscreen_view (PhocOutput *self)
 
   return self->fullscreen_view != NULL && self->fullscreen_view->wlr_surface != NULL;
 }
+
+/**
+ * phoc_output_transaction_add_view:
+ * @self: The output
+ * @view: A view that got configured due to a layout change
+ *
+ * Adds @view to the output's layout transaction. Until all views of
+ * the transaction committed their new size or a timeout expires the
+ * output keeps showing the previous layout so there are no frames
+ * with only some views resized.
+ */
+void
+phoc_output_transaction_add_view (PhocOutput *self, PhocView *view)
+{
+  g_assert (PHOC_IS_OUTPUT (self));
+
+  if (g_ptr_array_find (self->transaction.views, view, NULL))
+    return;
+
+  g_ptr_array_add (self->transaction.views, view);
+  if (self->transaction.timeout_id == 0) {
+    self->transaction.timeout_id = g_timeout_add (PHOC_OUTPUT_TRANSACTION_TIMEOUT,
+                                                  on_transaction_timeout, self);
+    g_source_set_name_by_id (self->transaction.timeout_id, "[phoc] layout transaction");
+  }
+}
+
+/**
+ * phoc_output_transaction_remove_view:
+ * @self: The output
+ * @view: The view
+ *
+ * Removes @view from the output's layout transaction, e.g. because it
+ * committed its new size or got unmapped. The transaction completes
+ * once the last view got removed.
+ */
+void
+phoc_output_transaction_remove_view (PhocOutput *self, PhocView *view)
+{
+  g_assert (PHOC_IS_OUTPUT (self));
+
+  if (!g_ptr_array_remove_fast (self->transaction.views, view))
+    return;
+
+  if (self->transaction.views->len == 0)
+    transaction_finish (self);
+}
+
+/**
+ * phoc_output_transaction_is_pending:
+ * @self: The output
+ *
+ * Returns: %TRUE if the output waits for views to commit a layout
+ *   change and hence shouldn't be repainted.
+ */
+gboolean
+phoc_output_transaction_is_pending (PhocOutput *self)
+{
+  g_assert (PHOC_IS_OUTPUT (self));
+
+  return self->transaction.views->len > 0;
+}
+
+/**
+ * phoc_output_rotation_begin:
+ * @self: The output
+ *
+ * Captures the output's current content before its transform
+ * changes. Until the rotation animation finished and all views
+ * committed the new layout the snapshot is shown rotating towards the
+ * new transform instead of the live scene.
+ */
+void
+phoc_output_rotation_begin (PhocOutput *self)
+{
+  PhocServer *server = phoc_server_get_default ();
+  PhocRenderer *renderer = phoc_server_get_renderer (server);
+
+  g_assert (PHOC_IS_OUTPUT (self));
+
+  phoc_output_rotation_clear (self);
+
+  if (!self->wlr_output->enabled)
+    return;
+
+  if (!phoc_renderer_snapshot_output (renderer, self,
+                                      &self->rotation.buffer, &self->rotation.texture)) {
+    g_debug ("Failed to snapshot %s, not animating rotation", self->wlr_output->name);
+    return;
+  }
+
+  self->rotation.from = self->wlr_output->transform;
+  self->rotation.start = g_get_monotonic_time ();
+}
+
+/**
+ * phoc_output_rotation_clear:
+ * @self: The output
+ *
+ * Drops the rotation snapshot so the live scene is shown again.
+ */
+void
+phoc_output_rotation_clear (PhocOutput *self)
+{
+  g_assert (PHOC_IS_OUTPUT (self));
+
+  if (self->rotation.texture == NULL)
+    return;
+
+  g_clear_pointer (&self->rotation.texture, wlr_texture_destroy);
+  g_clear_pointer (&self->rotation.buffer, wlr_buffer_drop);
+  phoc_output_damage_whole (self);
+}
+
+/**
+ * phoc_output_rotation_get_state:
+ * @self: The output
+ * @angle: (out): The snapshot's current rotation in radians
+ * @scale: (out): The snapshot's current scale
+ *
+ * Advances the rotation animation. Once it finished and no layout
+ * transaction is pending anymore the snapshot is dropped.
+ *
+ * Returns: %TRUE if the snapshot should be rendered instead of the scene
+ */
+gboolean
+phoc_output_rotation_get_state (PhocOutput *self, float *angle, float *scale)
+{
+  struct wlr_texture *texture = self->rotation.texture;
+  enum wl_output_transform delta;
+  double progress, t;
+
+  g_assert (PHOC_IS_OUTPUT (self));
+
+  if (texture == NULL)
+    return FALSE;
+
+  progress = (g_get_monotonic_time () - self->rotation.start) /
+    (PHOC_OUTPUT_ROTATION_DURATION * 1000.0);
+  if (progress >= 1.0 && !phoc_output_transaction_is_pending (self)) {
+    phoc_output_rotation_clear (self);
+    return FALSE;
+  }
+  t = phoc_ease_out_cubic (MIN (progress, 1.0));
+
+  /* The transform taking the snapshot's buffer to the new one */
+  delta = wlr_output_transform_compose (wlr_output_transform_invert (self->rotation.from),
+                                        self->wlr_output->transform);
+
+  /*
+   * Transforms rotate counter-clockwise while positive angles rotate
+   * clockwise in buffer coordinates. Flips can't be animated by
+   * rotating so the snapshot stays in place then.
+   */
+  switch (delta) {
+  case WL_OUTPUT_TRANSFORM_90:
+    *angle = -M_PI_2 * t;
+    break;
+  case WL_OUTPUT_TRANSFORM_180:
+    *angle = M_PI * t;
+    break;
+  case WL_OUTPUT_TRANSFORM_270:
+    *angle = M_PI_2 * t;
+    break;
+  default:
+    *angle = 0;
+    break;
+  }
+
+  /* Shrink the snapshot so it fits once rotated by 90 degrees */
+  *scale = 1.0;
+  if (delta == WL_OUTPUT_TRANSFORM_90 || delta == WL_OUTPUT_TRANSFORM_270) {
+    double fit = (double) MIN (texture->width, texture->height) /
+      MAX (texture->width, texture->height);
+
+    *scale = 1.0 + (fit - 1.0) * t;
+  }
+
+  return TRUE;
+}
+
+
+/* Enable the output again using the mode it had when it got blanked */
+static void
+stage_unblank (PhocOutput *self)
+{
+  struct wlr_output *wlr_output = self->wlr_output;
+
+  wlr_output_enable (wlr_output, true);
+  if (self->blank.mode) {
+    wlr_output_set_mode (wlr_output, self->blank.mode);
+  } else if (self->blank.width && self->blank.height) {
+    wlr_output_set_custom_mode (wlr_output, self->blank.width, self->blank.height,
+                                self->blank.refresh);
+  }
+}
+
+/**
+ * phoc_output_set_blank:
+ * @self: The output
+ * @blank: Whether to blank or unblank the output
+ *
+ * Powers the output down or up again. While blanked nothing gets
+ * rendered and clients on the output get no frame callbacks. The
+ * output's mode is kept so unblanking doesn't need to pick or probe
+ * a mode and the first frame is rendered right into the commit that
+ * enables the output.
+ *
+ * Returns: %TRUE on success, %FALSE otherwise
+ */
+gboolean
+phoc_output_set_blank (PhocOutput *self, gboolean blank)
+{
+  PhocServer *server = phoc_server_get_default ();
+  struct wlr_output *wlr_output;
+
+  g_assert (PHOC_IS_OUTPUT (self));
+  wlr_output = self->wlr_output;
+
+  if (blank) {
+    if (!wlr_output->enabled)
+      return TRUE;
+
+    self->blank.mode = wlr_output->current_mode;
+    self->blank.width = wlr_output->width;
+    self->blank.height = wlr_output->height;
+    self->blank.refresh = wlr_output->refresh;
+    /* Come back at the full refresh rate */
+    if (self->idle_refresh.full_refresh) {
+      self->blank.mode = self->idle_refresh.full_mode;
+      self->blank.refresh = self->idle_refresh.full_refresh;
+    }
+
+    /* Don't carry a refresh rate switch into the disabling commit */
+    if (self->idle_refresh.switching)
+      wlr_output_rollback (wlr_output);
+
+    wlr_output_enable (wlr_output, false);
+    if (!wlr_output_commit (wlr_output))
+      return FALSE;
+
+    self->idle_refresh.full_mode = NULL;
+    self->idle_refresh.full_refresh = 0;
+    self->idle_refresh.switching = FALSE;
+    self->idle_refresh.ignore_frames = 0;
+    self->blank.active = TRUE;
+    self->blank.unblank_ts = 0;
+    g_clear_handle_id (&self->idle_refresh.timer_id, g_source_remove);
+    return TRUE;
+  }
+
+  if (wlr_output->enabled)
+    return TRUE;
+
+  self->blank.unblank_ts = g_get_monotonic_time ();
+  stage_unblank (self);
+  phoc_output_damage_whole (self);
+  phoc_renderer_render_output (phoc_server_get_renderer (server), self);
+
+  /* Nothing got rendered (e.g. a layout transaction is pending), enable without a frame */
+  if (!wlr_output->enabled) {
+    wlr_output_rollback (wlr_output);
+    stage_unblank (self);
+    if (!wlr_output_commit (wlr_output)) {
+      self->blank.unblank_ts = 0;
+      return FALSE;
+    }
+    phoc_output_damage_whole (self);
+  }
+
+  self->blank.active = FALSE;
+  idle_refresh_note_activity (self);
+  return TRUE;
+}
+
+/**
+ * phoc_output_is_blanked:
+ * @self: The output
+ *
+ * Returns: %TRUE if the output got blanked via [method@Output.set_blank]
+ */
+gboolean
+phoc_output_is_blanked (PhocOutput *self)
+{
+  g_assert (PHOC_IS_OUTPUT (self));
+
+  return self->blank.active;
+}
+
+/**
+ * phoc_output_set_mirror_source:
+ * @self: The output
+ * @source: (nullable): The output to mirror or %NULL to stop mirroring
+ *
+ * Shows @source's content on @self instead of a part of the layout.
+ * The source's frames are scaled to fit (or scanned out directly if
+ * possible) so the scene isn't rendered a second time. A mirror isn't
+ * part of the output layout.
+ */
+void
+phoc_output_set_mirror_source (PhocOutput *self, PhocOutput *source)
+{
+  struct wlr_output_layout *layout;
+
+  g_assert (PHOC_IS_OUTPUT (self));
+  layout = self->desktop->layout;
+
+  if (self->mirror.source == source)
+    return;
+
+  if (source) {
+    g_return_if_fail (source != self);
+    g_return_if_fail (source->mirror.source == NULL);
+    g_return_if_fail (self->mirror.mirrors == NULL);
+  }
+
+  if (self->mirror.source) {
+    self->mirror.source->mirror.mirrors = g_slist_remove (self->mirror.source->mirror.mirrors, self);
+    mirror_set_buffer (self, NULL);
+  }
+
+  self->mirror.source = source;
+  if (source) {
+    g_debug ("Mirroring %s on %s", source->wlr_output->name, self->wlr_output->name);
+    source->mirror.mirrors = g_slist_prepend (source->mirror.mirrors, self);
+    wlr_output_layout_remove (layout, self->wlr_output);
+    /* Make sure there's a frame to show */
+    phoc_output_damage_whole (source);
+  } else if (!wlr_output_layout_get (layout, self->wlr_output)) {
+    g_debug ("Stopped mirroring on %s", self->wlr_output->name);
+    wlr_output_layout_add_auto (layout, self->wlr_output);
+  }
+
+  phoc_output_damage_whole (self);
+}
+
+/**
+ * phoc_output_mirror_get_box:
+ * @self: The mirror output
+ * @box: (out): The area showing the source
+ *
+ * Gets the area (in output-local buffer coordinates) the mirror shows
+ * its source in: scaled to fit and centered.
+ */
+void
+phoc_output_mirror_get_box (PhocOutput *self, struct wlr_box *box)
+{
+  int sw, sh, mw, mh;
+  double scale;
+
+  g_assert (PHOC_IS_OUTPUT (self));
+  g_assert (self->mirror.source);
+
+  wlr_output_transformed_resolution (self->mirror.source->wlr_output, &sw, &sh);
+  wlr_output_transformed_resolution (self->wlr_output, &mw, &mh);
+
+  scale = MIN ((double)mw / sw, (double)mh / sh);
+  box->width = round (sw * scale);
+  box->height = round (sh * scale);
+  box->x = (mw - box->width) / 2;
+  box->y = (mh - box->height) / 2;
+}
+
+/**
+ * phoc_output_damage_mirrors:
+ * @self: The source output
+ * @damage: (nullable): The damage of the source's frame in output-local
+ *   buffer coordinates, %NULL if everything changed
+ *
+ * Damages the corresponding areas on the outputs mirroring @self.
+ */
+void
+phoc_output_damage_mirrors (PhocOutput *self, pixman_region32_t *damage)
+{
+  int width, height;
+
+  g_assert (PHOC_IS_OUTPUT (self));
+
+  wlr_output_transformed_resolution (self->wlr_output, &width, &height);
+  for (GSList *elem = self->mirror.mirrors; elem; elem = elem->next) {
+    PhocOutput *mirror = PHOC_OUTPUT (elem->data);
+    pixman_region32_t mirror_damage;
+    struct wlr_box box;
+
+    if (damage == NULL) {
+      phoc_output_damage_whole (mirror);
+      continue;
+    }
+
+    phoc_output_mirror_get_box (mirror, &box);
+    pixman_region32_init (&mirror_damage);
+    wlr_region_scale (&mirror_damage, damage, (float)box.width / width);
+    pixman_region32_translate (&mirror_damage, box.x, box.y);
+    wlr_output_damage_add (mirror->damage, &mirror_damage);
+    pixman_region32_fini (&mirror_damage);
+  }
+}
+
+/**
+ * phoc_output_update_scanout_feedback:
+ * @self: The output
+ *
+ * Sends a scanout tranche for the output's primary plane to the
+ * fullscreen view's surface so the client can pick buffers that can
+ * be scanned out directly and reverts to the default feedback once
+ * the view no longer qualifies. Called before each frame.
+ */
+void
+phoc_output_update_scanout_feedback (PhocOutput *self)
+{
+  struct wlr_surface *surface = NULL;
+  struct wlr_dmabuf_attributes attribs;
+  PhocView *view;
+
+  g_assert (PHOC_IS_OUTPUT (self));
+
+  view = self->fullscreen_view;
+  if (view && phoc_view_is_mapped (view) && self->mirror.source == NULL &&
+      scanout_feedback_init (self)) {
+    surface = view->wlr_surface;
+  }
+
+  scanout_feedback_set_surface (self, surface);
+
+  surface = self->scanout.surface;
+  if (surface == NULL || self->scanout.capable || surface->buffer == NULL)
+    return;
+
+  if (wlr_buffer_get_dmabuf (&surface->buffer->base, &attribs) &&
+      wlr_drm_format_set_has (&self->scanout.formats, attribs.format, attribs.modifier)) {
+    self->scanout.capable = TRUE;
+    self->scanout.capable_surfaces++;
+    g_debug ("Fullscreen surface %p on %s uses a scanout capable buffer (%u of %u)",
+             surface, self->wlr_output->name,
+             (guint)self->scanout.capable_surfaces, (guint)self->scanout.feedback_surfaces);
+  }
+}
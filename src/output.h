@@ -5,6 +5,8 @@
 #include <gio/gio.h>
 #include <glib-object.h>
 #include <wayland-server-core.h>
+#include <wlr/render/drm_format_set.h>
+#include <wlr/types/wlr_linux_dmabuf_v1.h>
 #include <wlr/types/wlr_output_damage.h>
 #include <wlr/types/wlr_xdg_shell.h>
 #include <wlr/util/box.h>
@@ -49,6 +51,68 @@ struct _PhocOutput {
   struct wl_listener        damage_frame;
   struct wl_listener        damage_destroy;
   struct wl_listener        output_destroy;
+
+  struct {
+    int                     refresh;       // mHz, 0 when disabled
+    guint                   timeout;       // ms
+    gint64                  last_activity; // µs
+    guint                   timer_id;
+    int                     full_refresh;  // mHz, non-zero while downclocked
+    struct wlr_output_mode *full_mode;
+    gboolean                switching;     // rate switch waiting for a frame
+    struct wlr_output_mode *switch_mode;   // NULL for custom modes
+    int                     switch_refresh;
+    guint                   ignore_frames; // frames whose damage is ours
+  } idle_refresh;
+  struct wl_listener        idle_activity;
+
+  struct {
+    GPtrArray              *views;         // views yet to commit the new layout
+    guint                   timeout_id;
+  } transaction;
+
+  struct {
+    PhocOutput             *source;        // output shown on this one, if any
+    GSList                 *mirrors;       // outputs showing this one
+    struct wlr_buffer      *buffer;        // the source's last frame
+    struct wlr_texture     *texture;       // buffer imported for scaling, if needed
+    gboolean                needs_commit;  // buffer wasn't shown yet
+  } mirror;
+
+  struct {
+    gboolean                active;
+    struct wlr_output_mode *mode;          // mode to restore, NULL for custom modes
+    int                     width, height, refresh;
+    gint64                  unblank_ts;    // µs, set until the first frame got committed
+    gint64                  resume_time;   // µs from the last unblank to its first frame
+  } blank;
+
+  struct {
+    guint64                 frames;        // frames that had to draw a software cursor
+    guint64                 fallbacks;     // switches from hardware to software cursors
+    gboolean                active;
+  } software_cursor;
+
+  struct {
+    gboolean                active;        // the fullscreen view is scanned out
+    struct wlr_surface     *surface;       // surface that got the scanout tranche
+    struct wl_listener      surface_destroy;
+    gboolean                capable;       // @surface committed a scanout capable buffer
+    gboolean                checked;       // @feedback got built (if possible)
+    struct wlr_drm_format_set formats;     // primary plane formats the renderer can import
+    struct wlr_linux_dmabuf_feedback_v1_tranche tranches[2];
+    struct wlr_linux_dmabuf_feedback_v1 feedback;
+    guint64                 feedback_surfaces; // surfaces sent a scanout tranche
+    guint64                 capable_surfaces;  // ... that switched to scanout capable buffers
+    guint64                 frames;        // frames scanned out directly
+  } scanout;
+
+  struct {
+    struct wlr_buffer      *buffer;        // snapshot taken before the transform changed
+    struct wlr_texture     *texture;
+    enum wl_output_transform from;
+    gint64                  start;         // µs
+  } rotation;
 };
 
 PhocOutput *phoc_output_new (PhocDesktop       *desktop,
@@ -121,5 +185,17 @@ gboolean    phoc_output_is_match (PhocOutput *self,
                                   const char *model,
                                   const char *serial);
 gboolean    phoc_output_has_fullscreen_view (PhocOutput *self);
+void        phoc_output_transaction_add_view (PhocOutput *self, PhocView *view);
+void        phoc_output_transaction_remove_view (PhocOutput *self, PhocView *view);
+gboolean    phoc_output_transaction_is_pending (PhocOutput *self);
+void        phoc_output_set_mirror_source (PhocOutput *self, PhocOutput *source);
+void        phoc_output_mirror_get_box (PhocOutput *self, struct wlr_box *box);
+void        phoc_output_damage_mirrors (PhocOutput *self, pixman_region32_t *damage);
+gboolean    phoc_output_set_blank (PhocOutput *self, gboolean blank);
+gboolean    phoc_output_is_blanked (PhocOutput *self);
+void        phoc_output_update_scanout_feedback (PhocOutput *self);
+void        phoc_output_rotation_begin (PhocOutput *self);
+void        phoc_output_rotation_clear (PhocOutput *self);
+gboolean    phoc_output_rotation_get_state (PhocOutput *self, float *angle, float *scale);
 
 G_END_DECLS
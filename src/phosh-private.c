@@ -82,12 +82,25 @@ typedef struct {
   PhocPhoshPrivate   *phosh;
 } PhocPhoshPrivateStartupTracker;
 
+typedef struct {
+  PhocView          *view;
+  struct wl_listener view_destroy;
+  struct wlr_box     box;
+} PhocPhoshPrivateAtlasEntry;
+
+typedef struct {
+  struct wl_resource *resource;
+  GPtrArray          *entries;
+  gboolean            used;
+} PhocPhoshPrivateThumbnailAtlas;
+
 static PhocPhoshPrivate *phoc_phosh_private_from_resource (struct wl_resource *resource);
 static PhocPhoshPrivateKeyboardEventData *phoc_phosh_private_keyboard_event_from_resource (struct wl_resource *resource);
 static PhocPhoshPrivateScreencopyFrame *phoc_phosh_private_screencopy_frame_from_resource(struct wl_resource *resource);
 static PhocPhoshPrivateStartupTracker *phoc_phosh_private_startup_tracker_from_resource(struct wl_resource *resource);
+static PhocPhoshPrivateThumbnailAtlas *phoc_phosh_private_thumbnail_atlas_from_resource(struct wl_resource *resource);
 
-#define PHOSH_PRIVATE_VERSION 6
+#define PHOSH_PRIVATE_VERSION 7
 
 
 static void
@@ -522,6 +535,11 @@ handle_get_thumbnail (struct wl_client *client,
     return;
   }
 
+  if (!phoc_client_stats_request_thumbnail (phoc_server_get_default ()->client_stats, client)) {
+    zwlr_screencopy_frame_v1_send_failed (frame->resource);
+    return;
+  }
+
   frame->toplevel = toplevel;
   frame->view = view;
 
@@ -560,6 +578,201 @@ handle_get_thumbnail (struct wl_client *client,
 }
 
 
+static void
+atlas_entry_free (PhocPhoshPrivateAtlasEntry *entry)
+{
+  if (entry->view)
+    wl_list_remove (&entry->view_destroy.link);
+  g_free (entry);
+}
+
+
+static void
+atlas_entry_handle_view_destroy (struct wl_listener *listener, void *data)
+{
+  PhocPhoshPrivateAtlasEntry *entry = wl_container_of (listener, entry, view_destroy);
+
+  wl_list_remove (&entry->view_destroy.link);
+  entry->view = NULL;
+}
+
+
+static void
+phosh_private_thumbnail_atlas_handle_resource_destroy (struct wl_resource *resource)
+{
+  PhocPhoshPrivateThumbnailAtlas *atlas = phoc_phosh_private_thumbnail_atlas_from_resource (resource);
+
+  g_debug ("Destroying thumbnail_atlas %p (res %p)", atlas, atlas->resource);
+  g_ptr_array_free (atlas->entries, TRUE);
+  g_free (atlas);
+}
+
+
+static void
+thumbnail_atlas_handle_add_toplevel (struct wl_client   *client,
+                                     struct wl_resource *atlas_resource,
+                                     struct wl_resource *toplevel,
+                                     int32_t             x,
+                                     int32_t             y,
+                                     int32_t             width,
+                                     int32_t             height)
+{
+  PhocPhoshPrivateThumbnailAtlas *atlas = phoc_phosh_private_thumbnail_atlas_from_resource (atlas_resource);
+  struct wlr_foreign_toplevel_handle_v1 *toplevel_handle = wl_resource_get_user_data (toplevel);
+  PhocPhoshPrivateAtlasEntry *entry;
+
+  if (atlas->used) {
+    wl_resource_post_error (atlas_resource,
+                            PHOSH_PRIVATE_THUMBNAIL_ATLAS_ERROR_ALREADY_USED,
+                            "atlas already used");
+    return;
+  }
+
+  if (x < 0 || y < 0 || width <= 0 || height <= 0) {
+    wl_resource_post_error (atlas_resource,
+                            PHOSH_PRIVATE_THUMBNAIL_ATLAS_ERROR_INVALID_RECT,
+                            "invalid rectangle %d,%d %dx%d", x, y, width, height);
+    return;
+  }
+
+  entry = g_new0 (PhocPhoshPrivateAtlasEntry, 1);
+  entry->box = (struct wlr_box){ .x = x, .y = y, .width = width, .height = height };
+  /* Vanished toplevels keep their (empty) entry so the rect gets cleared */
+  if (toplevel_handle && toplevel_handle->data) {
+    entry->view = toplevel_handle->data;
+    entry->view_destroy.notify = atlas_entry_handle_view_destroy;
+    wl_signal_add (&entry->view->events.destroy, &entry->view_destroy);
+  }
+
+  g_ptr_array_add (atlas->entries, entry);
+}
+
+
+static void
+thumbnail_atlas_handle_capture (struct wl_client   *client,
+                                struct wl_resource *atlas_resource,
+                                struct wl_resource *buffer_resource)
+{
+  PhocServer *server = phoc_server_get_default ();
+  PhocRenderer *renderer = phoc_server_get_renderer (server);
+  PhocPhoshPrivateThumbnailAtlas *atlas = phoc_phosh_private_thumbnail_atlas_from_resource (atlas_resource);
+  struct wl_shm_buffer *buffer;
+  g_autofree PhocView **views = NULL;
+  g_autofree struct wlr_box *boxes = NULL;
+  uint32_t renderer_flags = 0;
+  gboolean success;
+
+  if (atlas->used) {
+    wl_resource_post_error (atlas_resource,
+                            PHOSH_PRIVATE_THUMBNAIL_ATLAS_ERROR_ALREADY_USED,
+                            "atlas already used");
+    return;
+  }
+  atlas->used = TRUE;
+
+  buffer = wl_shm_buffer_get (buffer_resource);
+  if (buffer == NULL || wl_shm_buffer_get_format (buffer) != WL_SHM_FORMAT_ARGB8888) {
+    wl_resource_post_error (atlas_resource,
+                            PHOSH_PRIVATE_THUMBNAIL_ATLAS_ERROR_INVALID_BUFFER,
+                            "unsupported buffer type");
+    return;
+  }
+
+  int32_t width = wl_shm_buffer_get_width (buffer);
+  int32_t height = wl_shm_buffer_get_height (buffer);
+  int32_t stride = wl_shm_buffer_get_stride (buffer);
+  if (width <= 0 || height <= 0 || stride < 4 * width) {
+    wl_resource_post_error (atlas_resource,
+                            PHOSH_PRIVATE_THUMBNAIL_ATLAS_ERROR_INVALID_BUFFER,
+                            "invalid buffer attributes");
+    return;
+  }
+
+  views = g_new0 (PhocView *, atlas->entries->len);
+  boxes = g_new0 (struct wlr_box, atlas->entries->len);
+  for (guint i = 0; i < atlas->entries->len; i++) {
+    PhocPhoshPrivateAtlasEntry *entry = g_ptr_array_index (atlas->entries, i);
+
+    /* Don't add up client controlled values, they could overflow */
+    if (entry->box.x < 0 || entry->box.width <= 0 || entry->box.x > width - entry->box.width ||
+        entry->box.y < 0 || entry->box.height <= 0 || entry->box.y > height - entry->box.height) {
+      wl_resource_post_error (atlas_resource,
+                              PHOSH_PRIVATE_THUMBNAIL_ATLAS_ERROR_INVALID_RECT,
+                              "rectangle %d doesn't fit into %dx%d buffer", i, width, height);
+      return;
+    }
+    views[i] = entry->view;
+    boxes[i] = entry->box;
+  }
+
+  /* The whole atlas is a single render pass so account for it only once */
+  if (!phoc_client_stats_request_thumbnail (server->client_stats, client)) {
+    phosh_private_thumbnail_atlas_send_failed (atlas_resource);
+    return;
+  }
+
+  wl_shm_buffer_begin_access (buffer);
+  success = phoc_renderer_render_views_to_buffer (renderer, views, boxes, atlas->entries->len,
+                                                  width, height, stride, &renderer_flags,
+                                                  wl_shm_buffer_get_data (buffer));
+  wl_shm_buffer_end_access (buffer);
+
+  if (!success) {
+    phosh_private_thumbnail_atlas_send_failed (atlas_resource);
+    return;
+  }
+
+  phosh_private_thumbnail_atlas_send_flags (atlas_resource,
+                                            (renderer_flags & WLR_RENDERER_READ_PIXELS_Y_INVERT) ?
+                                            PHOSH_PRIVATE_THUMBNAIL_ATLAS_FLAGS_Y_INVERT : 0);
+
+  struct timespec now;
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  uint32_t tv_sec_hi = (sizeof(now.tv_sec) > 4) ? now.tv_sec >> 32 : 0;
+  uint32_t tv_sec_lo = now.tv_sec & 0xFFFFFFFF;
+  phosh_private_thumbnail_atlas_send_ready (atlas_resource, tv_sec_hi, tv_sec_lo, now.tv_nsec);
+}
+
+
+static void
+thumbnail_atlas_handle_destroy (struct wl_client   *client,
+                                struct wl_resource *atlas_resource)
+{
+  wl_resource_destroy (atlas_resource);
+}
+
+
+static const struct phosh_private_thumbnail_atlas_interface phoc_phosh_private_thumbnail_atlas_impl = {
+  .add_toplevel = thumbnail_atlas_handle_add_toplevel,
+  .capture = thumbnail_atlas_handle_capture,
+  .destroy = thumbnail_atlas_handle_destroy,
+};
+
+
+static void
+handle_get_thumbnail_atlas (struct wl_client   *client,
+                            struct wl_resource *phosh_private_resource,
+                            uint32_t            id)
+{
+  PhocPhoshPrivateThumbnailAtlas *atlas = g_new0 (PhocPhoshPrivateThumbnailAtlas, 1);
+  int version = wl_resource_get_version (phosh_private_resource);
+
+  atlas->resource = wl_resource_create (client, &phosh_private_thumbnail_atlas_interface, version, id);
+  if (atlas->resource == NULL) {
+    g_free (atlas);
+    wl_client_post_no_memory (client);
+    return;
+  }
+  atlas->entries = g_ptr_array_new_with_free_func ((GDestroyNotify) atlas_entry_free);
+
+  g_debug ("New phosh_private_thumbnail_atlas %p (res %p)", atlas, atlas->resource);
+  wl_resource_set_implementation (atlas->resource,
+                                  &phoc_phosh_private_thumbnail_atlas_impl,
+                                  atlas,
+                                  phosh_private_thumbnail_atlas_handle_resource_destroy);
+}
+
+
 static void
 phoc_phosh_private_startup_tracker_handle_resource_destroy (struct wl_resource *resource)
 {
@@ -666,6 +879,7 @@ static const struct phosh_private_interface phosh_private_impl = {
   handle_get_keyboard_event,   /* interface */
   handle_get_startup_tracker,  /* interface */
   handle_set_shell_state,
+  handle_get_thumbnail_atlas,  /* interface */
 };
 
 
@@ -735,6 +949,15 @@ phoc_phosh_private_startup_tracker_from_resource (struct wl_resource *resource)
 }
 
 
+static PhocPhoshPrivateThumbnailAtlas *
+phoc_phosh_private_thumbnail_atlas_from_resource (struct wl_resource *resource)
+{
+  assert (wl_resource_instance_of (resource, &phosh_private_thumbnail_atlas_interface,
+                                   &phoc_phosh_private_thumbnail_atlas_impl));
+  return wl_resource_get_user_data (resource);
+}
+
+
 static void
 phoc_phosh_private_constructed (GObject *object)
 {
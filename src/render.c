@@ -23,14 +23,15 @@
 #include <assert.h>
 #include <drm_fourcc.h>
 #include <fcntl.h>
+#include <math.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <time.h>
 #include <wlr/backend.h>
 #include <wlr/config.h>
 #include <wlr/render/wlr_renderer.h>
-#include <wlr/render/gles2.h>
-#include <wlr/render/egl.h>
+#include <wlr/render/wlr_texture.h>
+#include <wlr/render/pixman.h>
 #include <wlr/types/wlr_compositor.h>
 #include <wlr/types/wlr_matrix.h>
 #include <wlr/types/wlr_buffer.h>
@@ -38,8 +39,6 @@
 #include <wlr/util/region.h>
 #include <wlr/version.h>
 #include <wlr/render/allocator.h>
-#include <GLES2/gl2.h>
-#include <GLES2/gl2ext.h>
 
 /* Private wlr_allocator headers */
 struct wlr_drm_format *wlr_drm_format_create (uint32_t format);
@@ -82,6 +81,7 @@ static guint signals[N_SIGNALS] = { 0 };
 enum {
   PROP_0,
   PROP_WLR_BACKEND,
+  PROP_NAME,
   PROP_LAST_PROP
 };
 static GParamSpec *props[PROP_LAST_PROP];
@@ -92,6 +92,10 @@ struct _PhocRenderer {
   struct wlr_backend   *wlr_backend;
   struct wlr_renderer  *wlr_renderer;
   struct wlr_allocator *wlr_allocator;
+  char                 *name;
+
+  GHashTable           *thumbnail_cache;
+  GHashTable           *scaled_cache;
 };
 
 static void phoc_renderer_initable_iface_init (GInitableIface *iface);
@@ -103,14 +107,38 @@ G_DEFINE_TYPE_WITH_CODE (PhocRenderer, phoc_renderer, G_TYPE_OBJECT,
 struct render_data {
   pixman_region32_t *damage;
   float alpha;
+  /* If set, rendered instead of the surface's texture */
+  struct wlr_texture *texture;
 };
 
+/*
+ * A view rendered at a different size. Kept until the view gets
+ * damaged or a different size is requested. Used for thumbnails
+ * and views shrunk by scale-to-fit.
+ */
+typedef struct {
+  PhocView           *view;
+  struct wl_listener  view_destroy;
+  GHashTable         *cache;
+  guint               damage_serial;
+  int                 target_width, target_height;
+  struct wlr_buffer  *buffer;
+  struct wlr_texture *texture;
+} PhocViewCacheEntry;
+
 struct view_render_data {
   PhocView *view;
+  int x;
+  int y;
   int width;
   int height;
 };
 
+struct scaled_cache_data {
+  PhocRenderer *renderer;
+  PhocView *view;
+};
+
 struct touch_point_data {
   int id;
   double x;
@@ -130,6 +158,9 @@ phoc_renderer_set_property (GObject      *object,
   case PROP_WLR_BACKEND:
     self->wlr_backend = g_value_get_pointer (value);
     break;
+  case PROP_NAME:
+    self->name = g_value_dup_string (value);
+    break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
     break;
@@ -149,6 +180,9 @@ phoc_renderer_get_property (GObject    *object,
   case PROP_WLR_BACKEND:
     g_value_set_pointer (value, self->wlr_backend);
     break;
+  case PROP_NAME:
+    g_value_set_string (value, self->name);
+    break;
   default:
     G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
     break;
@@ -235,6 +269,22 @@ collect_touch_points (PhocOutput *output, struct wlr_surface *surface, struct wl
   }
 }
 
+/*
+ * Only surfaces using fractional scaling on outputs with non-integer
+ * scales need snapping, leave everything else as is.
+ */
+static gboolean
+surface_wants_snapping (PhocOutput *output, struct wlr_surface *surface)
+{
+  float scale = output->wlr_output->scale;
+
+  if (scale == floorf (scale))
+    return FALSE;
+
+  return phoc_fractional_scale_manager_has_surface (output->desktop->fractional_scale_manager,
+                                                    surface);
+}
+
 static void render_surface_iterator(PhocOutput *output,
 		struct wlr_surface *surface, struct wlr_box *box, float rotation,
 		float scale, void *_data) {
@@ -243,21 +293,28 @@ static void render_surface_iterator(PhocOutput *output,
 	pixman_region32_t *output_damage = data->damage;
 	float alpha = data->alpha;
 
-	struct wlr_texture *texture = wlr_surface_get_texture(surface);
+	struct wlr_texture *texture = data->texture ?: wlr_surface_get_texture(surface);
 	if (!texture) {
 		return;
 	}
 
 	struct wlr_fbox src_box;
 	wlr_surface_get_buffer_source_box(surface, &src_box);
+	enum wl_output_transform transform =
+		wlr_output_transform_invert(surface->current.transform);
+	if (data->texture) {
+		/* Cached textures are already cropped and transformed */
+		src_box = (struct wlr_fbox){ .width = texture->width, .height = texture->height };
+		transform = WL_OUTPUT_TRANSFORM_NORMAL;
+	}
 
 	struct wlr_box dst_box = *box;
 	phoc_output_scale_box (output, &dst_box, scale);
 	phoc_output_scale_box (output, &dst_box, wlr_output->scale);
+	if (surface_wants_snapping (output, surface))
+		phoc_utils_snap_to_buffer_size (&dst_box, &src_box, transform);
 
 	float matrix[9];
-	enum wl_output_transform transform =
-		wlr_output_transform_invert(surface->current.transform);
 	wlr_matrix_project_box(matrix, &dst_box, transform, rotation,
 		wlr_output->transform_matrix);
 
@@ -306,6 +363,32 @@ buffer_damage_finish:
 	pixman_region32_fini(&damage);
 }
 
+static void
+count_view_surface_iterator (struct wlr_surface *surface, int sx, int sy, void *data)
+{
+  guint *n = data;
+
+  (*n)++;
+}
+
+/*
+ * Whether the view is shrunk by scale-to-fit and can be rendered from
+ * a single cached texture. Views with subsurfaces or popups are
+ * rendered directly as a single texture wouldn't cover them.
+ */
+static gboolean
+view_wants_scaled_cache (PhocView *view)
+{
+  PhocServer *server = phoc_server_get_default ();
+  guint n_surfaces = 0;
+
+  if (!server->config->scale_to_fit_cache || view->scale == 1.0 || !view->wlr_surface)
+    return FALSE;
+
+  view_for_each_surface (view, count_view_surface_iterator, &n_surfaces);
+  return n_surfaces == 1;
+}
+
 static void render_view(PhocOutput *output, PhocView *view,
 		struct render_data *data) {
 	// Do not render views fullscreened on other outputs
@@ -317,7 +400,17 @@ static void render_view(PhocOutput *output, PhocView *view,
 	if (!view_is_fullscreen (view)) {
 		render_decorations(output, view, data);
 	}
+
+	/* Filled in by scaled_cache_update() if the view qualifies */
+	PhocRenderer *self = phoc_server_get_renderer (phoc_server_get_default ());
+	PhocViewCacheEntry *entry = g_hash_table_lookup (self->scaled_cache, view);
+	if (entry && entry->texture && entry->damage_serial == view->damage_serial &&
+	    view_wants_scaled_cache (view)) {
+		data->texture = entry->texture;
+	}
+
 	phoc_output_view_for_each_surface(output, view, render_surface_iterator, data);
+	data->texture = NULL;
 }
 
 static void
@@ -544,6 +637,7 @@ view_render_iterator (struct wlr_surface *surface, int sx, int sy, void *_data)
   float mat[16];
   wlr_matrix_identity (mat);
 
+  wlr_matrix_translate (mat, data->x, data->y);
   wlr_matrix_scale (mat, data->width / (float)geo.width, data->height / (float)geo.height);
   wlr_matrix_scale (mat, 1 / (float)root->current.scale, 1 / (float)root->current.scale);
   wlr_matrix_scale (mat, view->scale, view->scale);
@@ -556,6 +650,183 @@ view_render_iterator (struct wlr_surface *surface, int sx, int sy, void *_data)
                       1.0);
 }
 
+static struct wlr_buffer *
+create_argb_buffer (PhocRenderer *self, int width, int height)
+{
+  struct wlr_drm_format *fmt = wlr_drm_format_create (DRM_FORMAT_ARGB8888);
+  struct wlr_buffer *buffer;
+
+  wlr_drm_format_add (&fmt, DRM_FORMAT_MOD_INVALID);
+  buffer = wlr_allocator_create_buffer (self->wlr_allocator, width, height, fmt);
+  free (fmt);
+
+  return buffer;
+}
+
+
+static void
+release_texture_buffer (struct wlr_texture *texture, struct wlr_buffer *buffer)
+{
+  if (texture)
+    wlr_texture_destroy (texture);
+  if (buffer)
+    wlr_buffer_drop (buffer);
+}
+
+
+static void
+view_cache_entry_clear (PhocViewCacheEntry *entry)
+{
+  release_texture_buffer (entry->texture, entry->buffer);
+  entry->texture = NULL;
+  entry->buffer = NULL;
+}
+
+
+static void
+view_cache_entry_free (PhocViewCacheEntry *entry)
+{
+  wl_list_remove (&entry->view_destroy.link);
+  view_cache_entry_clear (entry);
+  g_free (entry);
+}
+
+
+static void
+view_cache_handle_view_destroy (struct wl_listener *listener, void *data)
+{
+  PhocViewCacheEntry *entry = wl_container_of (listener, entry, view_destroy);
+
+  g_hash_table_remove (entry->cache, entry->view);
+}
+
+
+static PhocViewCacheEntry *
+view_cache_lookup (GHashTable *cache, PhocView *view)
+{
+  PhocViewCacheEntry *entry = g_hash_table_lookup (cache, view);
+
+  if (entry)
+    return entry;
+
+  entry = g_new0 (PhocViewCacheEntry, 1);
+  entry->view = view;
+  entry->cache = cache;
+  entry->view_destroy.notify = view_cache_handle_view_destroy;
+  wl_signal_add (&view->events.destroy, &entry->view_destroy);
+  g_hash_table_insert (cache, view, entry);
+
+  return entry;
+}
+
+
+/*
+ * Render @view scaled to @width x @height into a new buffer. If
+ * @src is given it's rendered instead of the view's surfaces.
+ */
+static gboolean
+render_downscale_step (PhocRenderer        *self,
+                       PhocView            *view,
+                       struct wlr_texture  *src,
+                       int                  width,
+                       int                  height,
+                       struct wlr_buffer  **buffer_out,
+                       struct wlr_texture **texture_out)
+{
+  struct wlr_buffer *buffer = create_argb_buffer (self, width, height);
+  struct wlr_texture *texture;
+
+  if (!buffer)
+    return FALSE;
+
+  if (!wlr_renderer_begin_with_buffer (self->wlr_renderer, buffer)) {
+    wlr_buffer_drop (buffer);
+    return FALSE;
+  }
+  wlr_renderer_clear (self->wlr_renderer, (float[])COLOR_TRANSPARENT);
+
+  if (src) {
+    float mat[9];
+
+    wlr_matrix_identity (mat);
+    wlr_matrix_scale (mat, width / (float)src->width, height / (float)src->height);
+    wlr_render_texture (self->wlr_renderer, src, mat, 0, 0, 1.0);
+  } else {
+    struct view_render_data render_data = {
+      .view = view,
+      .width = width,
+      .height = height,
+    };
+    wlr_surface_for_each_surface (view->wlr_surface, view_render_iterator, &render_data);
+  }
+  wlr_renderer_end (self->wlr_renderer);
+
+  texture = wlr_texture_from_buffer (self->wlr_renderer, buffer);
+  if (!texture) {
+    wlr_buffer_drop (buffer);
+    return FALSE;
+  }
+
+  *buffer_out = buffer;
+  *texture_out = texture;
+  return TRUE;
+}
+
+
+/*
+ * Get a texture of @view that is less than twice the size of the
+ * target box. We get there by halving the view's size in each step
+ * so every bilinear sample averages neighbouring source pixels
+ * rather than skipping most of them. Returns %NULL if the view is
+ * small enough to be rendered directly.
+ */
+static struct wlr_texture *
+thumbnail_cache_get (PhocRenderer *self, PhocView *view, int width, int height)
+{
+  PhocViewCacheEntry *entry;
+  struct wlr_buffer *buffer = NULL;
+  struct wlr_texture *texture = NULL;
+  struct wlr_box geo;
+  int w, h;
+
+  view_get_geometry (view, &geo);
+  w = geo.width * view->wlr_surface->current.scale;
+  h = geo.height * view->wlr_surface->current.scale;
+  if (w / 2 < width || h / 2 < height)
+    return NULL;
+
+  entry = view_cache_lookup (self->thumbnail_cache, view);
+  if (entry->texture && entry->damage_serial == view->damage_serial &&
+      entry->target_width == width && entry->target_height == height) {
+    return entry->texture;
+  }
+  view_cache_entry_clear (entry);
+
+  do {
+    struct wlr_buffer *next_buffer;
+    struct wlr_texture *next_texture;
+
+    w /= 2;
+    h /= 2;
+    if (!render_downscale_step (self, view, texture, w, h, &next_buffer, &next_texture)) {
+      release_texture_buffer (texture, buffer);
+      return NULL;
+    }
+    release_texture_buffer (texture, buffer);
+    buffer = next_buffer;
+    texture = next_texture;
+  } while (w / 2 >= width && h / 2 >= height);
+
+  entry->buffer = buffer;
+  entry->texture = texture;
+  entry->damage_serial = view->damage_serial;
+  entry->target_width = width;
+  entry->target_height = height;
+
+  return texture;
+}
+
+
 gboolean
 phoc_renderer_render_view_to_buffer (PhocRenderer *self,
                                      PhocView     *view,
@@ -565,37 +836,109 @@ phoc_renderer_render_view_to_buffer (PhocRenderer *self,
                                      uint32_t     *flags,
                                      void         *data)
 {
-  struct wlr_surface *surface = view->wlr_surface;
+  struct wlr_box box = { .width = width, .height = height };
+
+  g_return_val_if_fail (view->wlr_surface, false);
+
+  return phoc_renderer_render_views_to_buffer (self, &view, &box, 1,
+                                               width, height, stride, flags, data);
+}
+
+/**
+ * phoc_renderer_render_views_to_buffer:
+ * @self: The renderer
+ * @views: (array length=n_views): The views to render
+ * @boxes: (array length=n_views): The target rectangle of each view
+ * @n_views: The number of views
+ * @width: The width of the target buffer
+ * @height: The height of the target buffer
+ * @stride: The stride of the target buffer
+ * @flags: (out): Return location for `wlr_renderer_read_pixels` flags
+ * @data: The target buffer's data
+ *
+ * Renders each view scaled into its rectangle of the target
+ * buffer. All views are rendered in a single pass and read back at
+ * once. `NULL` and unmapped views are skipped leaving their
+ * rectangle cleared.
+ *
+ * Views that are scaled down by more than a factor of two are
+ * downscaled in several steps first. The intermediate result is
+ * cached until the view gets damaged.
+ *
+ * Returns: %TRUE on success, otherwise %FALSE
+ */
+gboolean
+phoc_renderer_render_views_to_buffer (PhocRenderer    *self,
+                                      PhocView       **views,
+                                      struct wlr_box  *boxes,
+                                      guint            n_views,
+                                      int              width,
+                                      int              height,
+                                      int              stride,
+                                      uint32_t        *flags,
+                                      void            *data)
+{
+  g_autofree struct wlr_texture **downscaled = NULL;
   struct wlr_buffer *buffer;
+  gboolean ret;
 
-  g_return_val_if_fail (surface, false);
   g_return_val_if_fail (self->wlr_allocator, false);
 
-  struct wlr_drm_format *fmt = wlr_drm_format_create (DRM_FORMAT_ARGB8888);
+  /* Downscaling needs render passes of its own so do it upfront */
+  downscaled = g_new0 (struct wlr_texture *, n_views);
+  for (guint i = 0; i < n_views; i++) {
+    if (views[i] == NULL || views[i]->wlr_surface == NULL)
+      continue;
 
-  wlr_drm_format_add(&fmt, DRM_FORMAT_MOD_INVALID);
-  buffer = wlr_allocator_create_buffer (self->wlr_allocator, width, height, fmt);
-  if (!buffer) {
-    free (fmt);
-    g_return_val_if_reached (false);
+    downscaled[i] = thumbnail_cache_get (self, views[i], boxes[i].width, boxes[i].height);
   }
 
-  struct view_render_data render_data ={
-    .view = view,
-    .width = width,
-    .height = height
-  };
+  buffer = create_argb_buffer (self, width, height);
+  if (!buffer)
+    g_return_val_if_reached (false);
 
   wlr_renderer_begin_with_buffer (self->wlr_renderer, buffer);
   wlr_renderer_clear (self->wlr_renderer, (float[])COLOR_TRANSPARENT);
-  wlr_surface_for_each_surface (surface, view_render_iterator, &render_data);
-  wlr_renderer_read_pixels (self->wlr_renderer, DRM_FORMAT_ARGB8888, NULL, stride, width, height, 0, 0, 0, 0, data);
+
+  for (guint i = 0; i < n_views; i++) {
+    PhocView *view = views[i];
+
+    if (view == NULL || view->wlr_surface == NULL)
+      continue;
+
+    /* Keep subsurfaces from bleeding into neighbouring rectangles */
+    wlr_renderer_scissor (self->wlr_renderer, &boxes[i]);
+
+    if (downscaled[i]) {
+      struct wlr_texture *texture = downscaled[i];
+      float mat[9];
+
+      wlr_matrix_identity (mat);
+      wlr_matrix_translate (mat, boxes[i].x, boxes[i].y);
+      wlr_matrix_scale (mat,
+                        boxes[i].width / (float)texture->width,
+                        boxes[i].height / (float)texture->height);
+      wlr_render_texture (self->wlr_renderer, texture, mat, 0, 0, 1.0);
+    } else {
+      struct view_render_data render_data = {
+        .view = view,
+        .x = boxes[i].x,
+        .y = boxes[i].y,
+        .width = boxes[i].width,
+        .height = boxes[i].height,
+      };
+      wlr_surface_for_each_surface (view->wlr_surface, view_render_iterator, &render_data);
+    }
+  }
+  wlr_renderer_scissor (self->wlr_renderer, NULL);
+
+  ret = wlr_renderer_read_pixels (self->wlr_renderer, DRM_FORMAT_ARGB8888, flags, stride,
+                                  width, height, 0, 0, 0, 0, data);
   wlr_renderer_end (self->wlr_renderer);
 
   wlr_buffer_drop (buffer);
-  free(fmt);
 
-  return true;
+  return ret;
 }
 
 static void surface_send_frame_done_iterator(PhocOutput *output,
@@ -606,6 +949,273 @@ static void surface_send_frame_done_iterator(PhocOutput *output,
 }
 
 
+/*
+ * Render the view's single surface into a buffer of the size it
+ * occupies on the output so repaints only need to blit it.
+ */
+static void
+scaled_cache_update_iterator (PhocOutput *output, struct wlr_surface *surface,
+                              struct wlr_box *box, float rotation, float scale, void *data)
+{
+  struct scaled_cache_data *cache_data = data;
+  PhocRenderer *self = cache_data->renderer;
+  PhocView *view = cache_data->view;
+  struct wlr_output *wlr_output = output->wlr_output;
+  struct wlr_texture *texture = wlr_surface_get_texture (surface);
+  PhocViewCacheEntry *entry;
+  struct wlr_box dst_box = *box;
+  struct wlr_box output_box = { .width = wlr_output->width, .height = wlr_output->height };
+  struct wlr_box intersection;
+  struct wlr_fbox src_box;
+  float matrix[9], identity[9];
+
+  if (!texture)
+    return;
+
+  phoc_output_scale_box (output, &dst_box, scale);
+  phoc_output_scale_box (output, &dst_box, wlr_output->scale);
+  if (dst_box.width <= 0 || dst_box.height <= 0 ||
+      !wlr_box_intersection (&intersection, &dst_box, &output_box)) {
+    return;
+  }
+
+  entry = view_cache_lookup (self->scaled_cache, view);
+  if (entry->texture && entry->damage_serial == view->damage_serial &&
+      entry->target_width == dst_box.width && entry->target_height == dst_box.height) {
+    return;
+  }
+  view_cache_entry_clear (entry);
+
+  entry->buffer = create_argb_buffer (self, dst_box.width, dst_box.height);
+  if (!entry->buffer)
+    return;
+
+  if (!wlr_renderer_begin_with_buffer (self->wlr_renderer, entry->buffer)) {
+    view_cache_entry_clear (entry);
+    return;
+  }
+  wlr_renderer_clear (self->wlr_renderer, (float[])COLOR_TRANSPARENT);
+
+  wlr_surface_get_buffer_source_box (surface, &src_box);
+  wlr_matrix_identity (identity);
+  wlr_matrix_project_box (matrix, &(struct wlr_box){ .width = dst_box.width, .height = dst_box.height },
+                          wlr_output_transform_invert (surface->current.transform), 0, identity);
+  wlr_render_subtexture_with_matrix (self->wlr_renderer, texture, &src_box, matrix, 1.0);
+  wlr_renderer_end (self->wlr_renderer);
+
+  entry->texture = wlr_texture_from_buffer (self->wlr_renderer, entry->buffer);
+  if (!entry->texture) {
+    view_cache_entry_clear (entry);
+    return;
+  }
+  entry->damage_serial = view->damage_serial;
+  entry->target_width = dst_box.width;
+  entry->target_height = dst_box.height;
+}
+
+
+/*
+ * Views shrunk by scale-to-fit are rendered into an offscreen buffer
+ * when they changed. This needs render passes of its own so it
+ * happens before the output's render pass starts.
+ */
+static void
+scaled_cache_update (PhocRenderer *self, PhocOutput *output)
+{
+  PhocServer *server = phoc_server_get_default ();
+  PhocDesktop *desktop = output->desktop;
+  PhocView *view;
+
+  if (!server->config->scale_to_fit_cache)
+    return;
+
+  wl_list_for_each (view, &desktop->views, link) {
+    if (output->fullscreen_view && output->fullscreen_view != view)
+      continue;
+
+    if (!phoc_desktop_view_is_visible (desktop, view) || !view_wants_scaled_cache (view))
+      continue;
+
+    struct scaled_cache_data data = { .renderer = self, .view = view };
+
+    phoc_output_view_for_each_surface (output, view, scaled_cache_update_iterator, &data);
+  }
+}
+
+
+/*
+ * Cursors that can't use the cursor plane are drawn by
+ * wlr_output_render_software_cursors which makes every pointer
+ * motion repaint the output so keep track of how often that happens.
+ */
+static void
+update_software_cursor_stats (PhocOutput *output)
+{
+  struct wlr_output *wlr_output = output->wlr_output;
+  struct wlr_output_cursor *cursor;
+  gboolean active = FALSE;
+
+  wl_list_for_each (cursor, &wlr_output->cursors, link) {
+    if (cursor->enabled && cursor->visible && cursor->texture &&
+        wlr_output->hardware_cursor != cursor) {
+      active = TRUE;
+      break;
+    }
+  }
+
+  if (active && !output->software_cursor.active) {
+    output->software_cursor.fallbacks++;
+    g_debug ("Using software cursor on %s (%" G_GUINT64_FORMAT " times so far)",
+             wlr_output->name, output->software_cursor.fallbacks);
+  }
+  output->software_cursor.active = active;
+  if (active)
+    output->software_cursor.frames++;
+}
+
+
+/*
+ * Render the output's layers, views and drag icons into the current
+ * render pass. @damage is in output-local buffer coordinates.
+ */
+static void render_scene(PhocOutput *output, pixman_region32_t *damage) {
+	PhocDesktop *desktop = PHOC_DESKTOP (output->desktop);
+	PhocServer *server = phoc_server_get_default ();
+	struct render_data data = {
+		.damage = damage,
+		.alpha = 1.0,
+	};
+
+	// If a view is fullscreen on this output, render it
+	if (output->fullscreen_view != NULL) {
+		PhocView *view = output->fullscreen_view;
+
+		render_view(output, view, &data);
+
+		// During normal rendering the xwayland window tree isn't traversed
+		// because all windows are rendered. Here we only want to render
+		// the fullscreen window's children so we have to traverse the tree.
+#ifdef PHOC_XWAYLAND
+		if (view->type == PHOC_XWAYLAND_VIEW) {
+			PhocXWaylandSurface *xwayland_surface =
+				phoc_xwayland_surface_from_view(view);
+			phoc_output_xwayland_children_for_each_surface(output,
+				xwayland_surface->xwayland_surface,
+				render_surface_iterator, &data);
+		}
+#endif
+
+		if (output->force_shell_reveal) {
+			// Render top layer above fullscreen view when requested
+			render_layer (output, damage, ZWLR_LAYER_SHELL_V1_LAYER_TOP);
+		}
+	} else {
+		// Render background and bottom layers under views
+		render_layer (output, damage, ZWLR_LAYER_SHELL_V1_LAYER_BACKGROUND);
+		render_layer (output, damage, ZWLR_LAYER_SHELL_V1_LAYER_BOTTOM);
+
+		PhocView *view;
+			// Render all views
+		wl_list_for_each_reverse(view, &desktop->views, link) {
+			if (phoc_desktop_view_is_visible(desktop, view)) {
+				render_view(output, view, &data);
+			}
+		}
+
+		// Render top layer above views
+		render_layer (output, damage, ZWLR_LAYER_SHELL_V1_LAYER_TOP);
+	}
+
+	render_drag_icons(output, damage, server->input);
+
+	render_layer (output, damage, ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY);
+}
+
+
+/*
+ * Render the snapshot taken before a transform change rotated by
+ * @angle and scaled by @scale around the output's center. The snapshot
+ * is in buffer coordinates so the output's transform doesn't apply.
+ */
+static void
+render_rotation_snapshot (PhocOutput *output, float angle, float scale)
+{
+  struct wlr_output *wlr_output = output->wlr_output;
+  struct wlr_texture *texture = output->rotation.texture;
+  float matrix[9], identity[9];
+  struct wlr_box box = {
+    .width = texture->width * scale,
+    .height = texture->height * scale,
+  };
+
+  box.x = (wlr_output->width - box.width) / 2;
+  box.y = (wlr_output->height - box.height) / 2;
+
+  wlr_renderer_scissor (wlr_output->renderer, NULL);
+  wlr_renderer_clear (wlr_output->renderer, (float[])COLOR_BLACK);
+
+  wlr_matrix_identity (identity);
+  wlr_matrix_project_box (matrix, &box, WL_OUTPUT_TRANSFORM_NORMAL, angle, identity);
+  wlr_render_texture_with_matrix (wlr_output->renderer, texture, matrix, 1.0);
+}
+
+
+/**
+ * phoc_renderer_snapshot_output:
+ * @self: The renderer
+ * @output: The output to capture
+ * @buffer: (out): The buffer holding the snapshot
+ * @texture: (out): A texture of @buffer
+ *
+ * Renders the output's current scene into a new buffer of the output's
+ * buffer size, e.g. to keep showing it while the output reconfigures.
+ * The caller owns @buffer and @texture.
+ *
+ * Returns: %TRUE on success, %FALSE otherwise
+ */
+gboolean
+phoc_renderer_snapshot_output (PhocRenderer        *self,
+                               PhocOutput          *output,
+                               struct wlr_buffer  **buffer,
+                               struct wlr_texture **texture)
+{
+  struct wlr_output *wlr_output = output->wlr_output;
+  pixman_region32_t damage;
+  int width, height;
+
+  g_assert (PHOC_IS_RENDERER (self));
+  g_assert (buffer && texture);
+
+  *buffer = create_argb_buffer (self, wlr_output->width, wlr_output->height);
+  if (!*buffer)
+    return FALSE;
+
+  scaled_cache_update (self, output);
+
+  if (!wlr_renderer_begin_with_buffer (self->wlr_renderer, *buffer)) {
+    g_clear_pointer (buffer, wlr_buffer_drop);
+    return FALSE;
+  }
+  wlr_renderer_clear (self->wlr_renderer, (float[])COLOR_BLACK);
+
+  wlr_output_transformed_resolution (wlr_output, &width, &height);
+  pixman_region32_init_rect (&damage, 0, 0, width, height);
+  render_scene (output, &damage);
+  pixman_region32_fini (&damage);
+
+  wlr_renderer_scissor (self->wlr_renderer, NULL);
+  wlr_renderer_end (self->wlr_renderer);
+
+  *texture = wlr_texture_from_buffer (self->wlr_renderer, *buffer);
+  if (!*texture) {
+    g_clear_pointer (buffer, wlr_buffer_drop);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+
 static void
 render_damage (PhocRenderer *self, PhocOutput *output)
 {
@@ -637,6 +1247,92 @@ render_damage (PhocRenderer *self, PhocOutput *output)
 }
 
 
+/*
+ * Show the source output's last frame on the mirror. If buffer size
+ * and transform match it's scanned out directly, otherwise it's
+ * scaled to fit. Either way the scene isn't traversed again. A source
+ * buffer is only committed once, the imported texture is kept until
+ * the source commits a new one.
+ */
+static void
+render_mirror (PhocRenderer *self, PhocOutput *output)
+{
+  struct wlr_output *wlr_output = output->wlr_output;
+  struct wlr_output *source = output->mirror.source->wlr_output;
+  struct wlr_buffer *buffer = output->mirror.buffer;
+  pixman_region32_t buffer_damage, frame_damage;
+  pixman_box32_t *rects;
+  struct wlr_box box;
+  float matrix[9];
+  int nrects, width, height;
+  bool needs_frame, enabling;
+
+  if (buffer == NULL)
+    return;
+
+  enabling = !wlr_output->enabled && (wlr_output->pending.committed & WLR_OUTPUT_STATE_ENABLED);
+  if (buffer->width == wlr_output->width && buffer->height == wlr_output->height &&
+      source->transform == wlr_output->transform) {
+    /* Nothing new to show */
+    if (!output->mirror.needs_commit && !enabling)
+      return;
+
+    wlr_output_attach_buffer (wlr_output, buffer);
+    if (wlr_output_test (wlr_output)) {
+      if (wlr_output_commit (wlr_output))
+        output->mirror.needs_commit = FALSE;
+      return;
+    }
+    wlr_output_rollback (wlr_output);
+  }
+
+  if (output->mirror.texture == NULL) {
+    output->mirror.texture = wlr_texture_from_buffer (self->wlr_renderer, buffer);
+    if (output->mirror.texture == NULL) {
+      g_debug ("Failed to import %s's buffer for mirroring", source->name);
+      return;
+    }
+  }
+
+  pixman_region32_init (&buffer_damage);
+  if (!wlr_output_damage_attach_render (output->damage, &needs_frame, &buffer_damage))
+    goto out;
+
+  if (!needs_frame) {
+    wlr_output_rollback (wlr_output);
+    goto out;
+  }
+
+  wlr_renderer_begin (self->wlr_renderer, wlr_output->width, wlr_output->height);
+
+  phoc_output_mirror_get_box (output, &box);
+  wlr_matrix_project_box (matrix, &box, wlr_output_transform_invert (source->transform), 0,
+                          wlr_output->transform_matrix);
+
+  rects = pixman_region32_rectangles (&buffer_damage, &nrects);
+  for (int i = 0; i < nrects; ++i) {
+    scissor_output (wlr_output, &rects[i]);
+    wlr_renderer_clear (self->wlr_renderer, (float[])COLOR_BLACK);
+    wlr_render_texture_with_matrix (self->wlr_renderer, output->mirror.texture, matrix, 1.0);
+  }
+  wlr_renderer_scissor (self->wlr_renderer, NULL);
+  wlr_renderer_end (self->wlr_renderer);
+
+  wlr_output_transformed_resolution (wlr_output, &width, &height);
+  pixman_region32_init (&frame_damage);
+  wlr_region_transform (&frame_damage, &output->damage->current,
+                        wlr_output_transform_invert (wlr_output->transform), width, height);
+  wlr_output_set_damage (wlr_output, &frame_damage);
+  pixman_region32_fini (&frame_damage);
+
+  if (wlr_output_commit (wlr_output))
+    output->mirror.needs_commit = FALSE;
+
+ out:
+  pixman_region32_fini (&buffer_damage);
+}
+
+
 /**
  * phoc_renderer_render_output:
  * @self: The renderer
@@ -646,14 +1342,17 @@ render_damage (PhocRenderer *self, PhocOutput *output)
  */
 void phoc_renderer_render_output (PhocRenderer *self, PhocOutput *output) {
 	struct wlr_output *wlr_output = output->wlr_output;
-	PhocDesktop *desktop = PHOC_DESKTOP (output->desktop);
 	PhocServer *server = phoc_server_get_default ();
 	struct wlr_renderer *wlr_renderer;
+	float rotation_angle, rotation_scale;
+	bool rotating;
 
         g_assert (PHOC_IS_RENDERER (self));
         wlr_renderer = self->wlr_renderer;
 
-	if (!wlr_output->enabled) {
+	// Unblanking renders the first frame into the commit enabling the output
+	if (!wlr_output->enabled &&
+	    !((wlr_output->pending.committed & WLR_OUTPUT_STATE_ENABLED) && wlr_output->pending.enabled)) {
 		return;
 	}
 
@@ -662,25 +1361,46 @@ void phoc_renderer_render_output (PhocRenderer *self, PhocOutput *output) {
 
 	float clear_color[] = COLOR_BLACK;
 
+	if (output->mirror.source) {
+		render_mirror (self, output);
+		return;
+	}
+
 	g_signal_emit (self, signals[RENDER_START], 0, output);
 
+	phoc_output_update_scanout_feedback (output);
+
+	rotating = phoc_output_rotation_get_state (output, &rotation_angle, &rotation_scale);
+	if (rotating) {
+		// The snapshot moves every frame
+		phoc_output_damage_whole (output);
+	} else if (phoc_output_transaction_is_pending (output)) {
+		// Keep showing the previous layout until all views caught up
+		goto send_frame_done;
+	}
+
 	// Check if we can delegate the fullscreen surface to the output
-	if (phoc_output_has_fullscreen_view (output)) {
-		static bool last_scanned_out = false;
-		bool scanned_out = scan_out_fullscreen_view(output);
-
-		if (scanned_out && !last_scanned_out) {
-			g_debug ("Starting fullscreen view scan out");
-		} else if (!scanned_out && last_scanned_out) {
-			g_debug ("Stopping fullscreen view scan out");
-		}
-		last_scanned_out = scanned_out;
+	bool scanned_out = false;
+	if (!rotating && phoc_output_has_fullscreen_view (output))
+		scanned_out = scan_out_fullscreen_view(output);
+
+	if (scanned_out && !output->scanout.active) {
+		g_debug ("Starting fullscreen view scan out on %s", wlr_output->name);
+	} else if (!scanned_out && output->scanout.active) {
+		g_debug ("Stopping fullscreen view scan out on %s, %" G_GUINT64_FORMAT " frames scanned out so far",
+			 wlr_output->name, output->scanout.frames);
+	}
+	output->scanout.active = scanned_out;
 
-		if (scanned_out) {
-			goto send_frame_done;
-		}
+	if (scanned_out) {
+		output->scanout.frames++;
+		phoc_output_damage_mirrors (output, NULL);
+		goto send_frame_done;
 	}
 
+	// Needs render passes of its own so do it before attaching the output's buffer
+	scaled_cache_update (self, output);
+
 	bool needs_frame;
 	pixman_region32_t buffer_damage;
 	pixman_region32_init(&buffer_damage);
@@ -689,11 +1409,6 @@ void phoc_renderer_render_output (PhocRenderer *self, PhocOutput *output) {
 		return;
 	}
 
-	struct render_data data = {
-		.damage = &buffer_damage,
-		.alpha = 1.0,
-	};
-
 	enum wl_output_transform transform =
 		wlr_output_transform_invert(wlr_output->transform);
 
@@ -726,51 +1441,15 @@ void phoc_renderer_render_output (PhocRenderer *self, PhocOutput *output) {
 		wlr_renderer_clear(wlr_renderer, clear_color);
 	}
 
-	// If a view is fullscreen on this output, render it
-	if (output->fullscreen_view != NULL) {
-		PhocView *view = output->fullscreen_view;
-
-		render_view(output, view, &data);
-
-		// During normal rendering the xwayland window tree isn't traversed
-		// because all windows are rendered. Here we only want to render
-		// the fullscreen window's children so we have to traverse the tree.
-#ifdef PHOC_XWAYLAND
-		if (view->type == PHOC_XWAYLAND_VIEW) {
-			PhocXWaylandSurface *xwayland_surface =
-				phoc_xwayland_surface_from_view(view);
-			phoc_output_xwayland_children_for_each_surface(output,
-				xwayland_surface->xwayland_surface,
-				render_surface_iterator, &data);
-		}
-#endif
-
-		if (output->force_shell_reveal) {
-			// Render top layer above fullscreen view when requested
-			render_layer (output, &buffer_damage, ZWLR_LAYER_SHELL_V1_LAYER_TOP);
-		}
-	} else {
-		// Render background and bottom layers under views
-		render_layer (output, &buffer_damage, ZWLR_LAYER_SHELL_V1_LAYER_BACKGROUND);
-		render_layer (output, &buffer_damage, ZWLR_LAYER_SHELL_V1_LAYER_BOTTOM);
-
-		PhocView *view;
-			// Render all views
-		wl_list_for_each_reverse(view, &desktop->views, link) {
-			if (phoc_desktop_view_is_visible(desktop, view)) {
-				render_view(output, view, &data);
-			}
-		}
-
-		// Render top layer above views
-		render_layer (output, &buffer_damage, ZWLR_LAYER_SHELL_V1_LAYER_TOP);
+	if (rotating) {
+		render_rotation_snapshot (output, rotation_angle, rotation_scale);
+		goto renderer_end;
 	}
 
-	render_drag_icons(output, &buffer_damage, server->input);
-
-	render_layer (output, &buffer_damage, ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY);
+	render_scene (output, &buffer_damage);
 
 renderer_end:
+	update_software_cursor_stats (output);
 	wlr_output_render_software_cursors(wlr_output, &buffer_damage);
 	wlr_renderer_scissor(wlr_renderer, NULL);
 
@@ -793,6 +1472,9 @@ renderer_end:
 	wlr_output_set_damage(wlr_output, &frame_damage);
 	pixman_region32_fini(&frame_damage);
 
+	if (output->mirror.mirrors)
+		phoc_output_damage_mirrors (output, &output->damage->current);
+
 	if (!wlr_output_commit(wlr_output)) {
 		goto buffer_damage_finish;
 	}
@@ -809,21 +1491,67 @@ send_frame_done:
 }
 
 
+static struct wlr_renderer *
+create_wlr_renderer (struct wlr_backend *wlr_backend, const char *name)
+{
+  g_autofree char *saved = NULL;
+  struct wlr_renderer *wlr_renderer;
+
+  if (g_strcmp0 (name, "auto") == 0)
+    return wlr_renderer_autocreate (wlr_backend);
+
+  if (g_strcmp0 (name, "pixman") == 0)
+    return wlr_pixman_renderer_create ();
+
+  /* GPU renderers need the backend's DRM device, let wlroots open it */
+  saved = g_strdup (g_getenv ("WLR_RENDERER"));
+  g_setenv ("WLR_RENDERER", name, TRUE);
+  wlr_renderer = wlr_renderer_autocreate (wlr_backend);
+  if (saved)
+    g_setenv ("WLR_RENDERER", saved, TRUE);
+  else
+    g_unsetenv ("WLR_RENDERER");
+
+  return wlr_renderer;
+}
+
+
 static gboolean
 phoc_renderer_initable_init (GInitable    *initable,
                              GCancellable *cancellable,
                              GError      **error)
 {
   PhocRenderer *self = PHOC_RENDERER (initable);
+  const char *known[] = { "auto", "gles2", "pixman", "vulkan", NULL };
+
+  if (self->name == NULL)
+    self->name = g_strdup ("auto");
+
+  if (!g_strv_contains (known, self->name)) {
+    g_set_error (error,
+                 G_FILE_ERROR, G_FILE_ERROR_FAILED,
+                 "Unknown renderer '%s'", self->name);
+    return FALSE;
+  }
 
-  self->wlr_renderer = wlr_renderer_autocreate (self->wlr_backend);
+  self->wlr_renderer = create_wlr_renderer (self->wlr_backend, self->name);
   if (self->wlr_renderer == NULL) {
     g_set_error (error,
                  G_FILE_ERROR, G_FILE_ERROR_FAILED,
-		 "Could not create renderer");
+		 "Could not create %s renderer", self->name);
     return FALSE;
   }
 
+  /* Resolve what autocreate picked for logging and benchmarks */
+  if (wlr_renderer_is_pixman (self->wlr_renderer)) {
+    g_free (self->name);
+    self->name = g_strdup ("pixman");
+  } else if (g_strcmp0 (self->name, "auto") == 0) {
+    g_free (self->name);
+    self->name = g_strdup (g_getenv ("WLR_RENDERER") ?: "gles2");
+  }
+  g_debug ("Using %s renderer", self->name);
+
   self->wlr_allocator = wlr_allocator_autocreate (self->wlr_backend,
                                                   self->wlr_renderer);
   if (self->wlr_allocator == NULL) {
@@ -841,9 +1569,16 @@ static void
 phoc_renderer_finalize (GObject *object)
 {
   PhocRenderer *self = PHOC_RENDERER (object);
+
+  /* Cached textures must go before the allocator */
+  g_clear_pointer (&self->thumbnail_cache, g_hash_table_destroy);
+  g_clear_pointer (&self->scaled_cache, g_hash_table_destroy);
   if (self->wlr_allocator)
     wlr_allocator_destroy (self->wlr_allocator);
   /* TODO: destroy wlr_renderer */
+  g_free (self->name);
+
+  G_OBJECT_CLASS (phoc_renderer_parent_class)->finalize (object);
 }
 
 
@@ -874,6 +1609,19 @@ phoc_renderer_class_init (PhocRendererClass *klass)
                           "",
                           G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY);
 
+  /**
+   * PhocRenderer:name
+   *
+   * The renderer to use: `auto`, `gles2`, `pixman` or `vulkan`. Once
+   * constructed this is the renderer that is actually in use.
+   */
+  props[PROP_NAME] =
+    g_param_spec_string ("name",
+                         "",
+                         "",
+                         NULL,
+                         G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY);
+
   g_object_class_install_properties (object_class, PROP_LAST_PROP, props);
 
   /**
@@ -906,18 +1654,32 @@ phoc_renderer_class_init (PhocRendererClass *klass)
 static void
 phoc_renderer_init (PhocRenderer *self)
 {
+  self->thumbnail_cache = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL,
+                                                 (GDestroyNotify)view_cache_entry_free);
+  self->scaled_cache = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL,
+                                              (GDestroyNotify)view_cache_entry_free);
 }
 
 
 PhocRenderer *
-phoc_renderer_new (struct wlr_backend *wlr_backend, GError **error)
+phoc_renderer_new (struct wlr_backend *wlr_backend, const char *name, GError **error)
 {
   return PHOC_RENDERER (g_initable_new (PHOC_TYPE_RENDERER, NULL, error,
                                         "wlr-backend", wlr_backend,
+                                        "name", name,
                                         NULL));
 }
 
 
+const char *
+phoc_renderer_get_name (PhocRenderer *self)
+{
+  g_assert (PHOC_IS_RENDERER (self));
+
+  return self->name;
+}
+
+
 struct wlr_renderer *
 phoc_renderer_get_wlr_renderer (PhocRenderer *self)
 {
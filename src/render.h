@@ -17,7 +17,10 @@ G_BEGIN_DECLS
 
 G_DECLARE_FINAL_TYPE (PhocRenderer, phoc_renderer, PHOC, RENDERER, GObject)
 
-PhocRenderer *phoc_renderer_new (struct wlr_backend *wlr_backend, GError **error);
+PhocRenderer *phoc_renderer_new (struct wlr_backend *wlr_backend,
+                                 const char         *name,
+                                 GError            **error);
+const char   *phoc_renderer_get_name (PhocRenderer *self);
 void          phoc_renderer_render_output (PhocRenderer *self, PhocOutput *output);
 gboolean      phoc_renderer_render_view_to_buffer (PhocRenderer *self,
                                                    PhocView     *view,
@@ -26,4 +29,17 @@ gboolean      phoc_renderer_render_view_to_buffer (PhocRenderer *self,
                                                    int           stride,
                                                    uint32_t     *flags,
                                                    void         *data);
+gboolean      phoc_renderer_render_views_to_buffer (PhocRenderer    *self,
+                                                    PhocView       **views,
+                                                    struct wlr_box  *boxes,
+                                                    guint            n_views,
+                                                    int              width,
+                                                    int              height,
+                                                    int              stride,
+                                                    uint32_t        *flags,
+                                                    void            *data);
+gboolean      phoc_renderer_snapshot_output (PhocRenderer        *self,
+                                             PhocOutput          *output,
+                                             struct wlr_buffer  **buffer,
+                                             struct wlr_texture **texture);
 G_END_DECLS
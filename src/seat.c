@@ -37,6 +37,9 @@
 #include "xcursor.h"
 #include "xwayland-surface.h"
 
+/* Re-arm the seat's idle timers at most this often during continuous input */
+#define PHOC_SEAT_ACTIVITY_INTERVAL 250 /* ms */
+
 enum {
   PROP_0,
   PROP_INPUT,
@@ -100,6 +103,7 @@ handle_swipe_begin (struct wl_listener *listener, void *data)
   struct wlr_pointer_gestures_v1 *gestures = server->desktop->pointer_gestures;
   struct wlr_event_pointer_swipe_begin *event = data;
 
+  phoc_input_record_event (server->input, PHOC_INPUT_RECORD_SWIPE_BEGIN, event->device, event);
   wlr_pointer_gestures_v1_send_swipe_begin (gestures, cursor->seat->seat,
                                             event->time_msec, event->fingers);
 }
@@ -112,6 +116,7 @@ handle_swipe_update (struct wl_listener *listener, void *data)
   struct wlr_pointer_gestures_v1 *gestures = server->desktop->pointer_gestures;
   struct wlr_event_pointer_swipe_update *event = data;
 
+  phoc_input_record_event (server->input, PHOC_INPUT_RECORD_SWIPE_UPDATE, event->device, event);
   wlr_pointer_gestures_v1_send_swipe_update (gestures, cursor->seat->seat,
                                              event->time_msec, event->dx, event->dy);
 }
@@ -124,6 +129,7 @@ handle_swipe_end (struct wl_listener *listener, void *data)
   struct wlr_pointer_gestures_v1 *gestures = server->desktop->pointer_gestures;
   struct wlr_event_pointer_swipe_end *event = data;
 
+  phoc_input_record_event (server->input, PHOC_INPUT_RECORD_SWIPE_END, event->device, event);
   wlr_pointer_gestures_v1_send_swipe_end (gestures, cursor->seat->seat,
                                           event->time_msec, event->cancelled);
 }
@@ -136,6 +142,7 @@ handle_pinch_begin (struct wl_listener *listener, void *data)
   struct wlr_pointer_gestures_v1 *gestures = server->desktop->pointer_gestures;
   struct wlr_event_pointer_pinch_begin *event = data;
 
+  phoc_input_record_event (server->input, PHOC_INPUT_RECORD_PINCH_BEGIN, event->device, event);
   wlr_pointer_gestures_v1_send_pinch_begin (gestures, cursor->seat->seat,
                                             event->time_msec, event->fingers);
 }
@@ -148,6 +155,7 @@ handle_pinch_update (struct wl_listener *listener, void *data)
   struct wlr_pointer_gestures_v1 *gestures = server->desktop->pointer_gestures;
   struct wlr_event_pointer_pinch_update *event = data;
 
+  phoc_input_record_event (server->input, PHOC_INPUT_RECORD_PINCH_UPDATE, event->device, event);
   wlr_pointer_gestures_v1_send_pinch_update (gestures, cursor->seat->seat,
                                              event->time_msec, event->dx, event->dy,
                                              event->scale, event->rotation);
@@ -162,6 +170,7 @@ handle_pinch_end (struct wl_listener *listener, void *data)
     server->desktop->pointer_gestures;
   struct wlr_event_pointer_pinch_end *event = data;
 
+  phoc_input_record_event (server->input, PHOC_INPUT_RECORD_PINCH_END, event->device, event);
   wlr_pointer_gestures_v1_send_pinch_end (gestures, cursor->seat->seat,
                                           event->time_msec, event->cancelled);
 }
@@ -169,14 +178,14 @@ handle_pinch_end (struct wl_listener *listener, void *data)
 static void
 handle_switch_toggle (struct wl_listener *listener, void *data)
 {
-  PhocServer *server = phoc_server_get_default ();
   struct roots_switch *switch_device =
     wl_container_of (listener, switch_device, toggle);
-  PhocDesktop *desktop = server->desktop;
 
-  wlr_idle_notify_activity (desktop->idle, switch_device->seat->seat);
+  phoc_seat_notify_activity (switch_device->seat);
   struct wlr_event_switch_toggle *event = data;
 
+  phoc_input_record_event (phoc_server_get_default ()->input, PHOC_INPUT_RECORD_SWITCH_TOGGLE,
+                           event->device, event);
   roots_switch_handle_toggle (switch_device, event);
 }
 
@@ -195,7 +204,7 @@ handle_touch_down (struct wl_listener *listener, void *data)
              output->wlr_output->name);
     return;
   }
-  wlr_idle_notify_activity (desktop->idle, cursor->seat->seat);
+  phoc_seat_notify_activity (cursor->seat);
   phoc_cursor_handle_touch_down (cursor, event);
 }
 
@@ -216,7 +225,7 @@ handle_touch_up (struct wl_listener *listener, void *data)
              output->wlr_output->name);
     return;
   }
-  wlr_idle_notify_activity (desktop->idle, cursor->seat->seat);
+  phoc_seat_notify_activity (cursor->seat);
 }
 
 static void
@@ -237,7 +246,7 @@ handle_touch_motion (struct wl_listener *listener, void *data)
              output->wlr_output->name);
     return;
   }
-  wlr_idle_notify_activity (desktop->idle, cursor->seat->seat);
+  phoc_seat_notify_activity (cursor->seat);
 }
 
 static void
@@ -291,11 +300,9 @@ handle_tablet_tool_position (PhocCursor *cursor,
 static void
 handle_tool_axis (struct wl_listener *listener, void *data)
 {
-  PhocServer *server = phoc_server_get_default ();
   PhocCursor *cursor = wl_container_of (listener, cursor, tool_axis);
-  PhocDesktop *desktop = server->desktop;
 
-  wlr_idle_notify_activity (desktop->idle, cursor->seat->seat);
+  phoc_seat_notify_activity (cursor->seat);
   struct wlr_event_tablet_tool_axis *event = data;
   PhocTabletTool *phoc_tool = event->tool->data;
 
@@ -356,11 +363,9 @@ handle_tool_axis (struct wl_listener *listener, void *data)
 static void
 handle_tool_tip (struct wl_listener *listener, void *data)
 {
-  PhocServer *server = phoc_server_get_default ();
   PhocCursor *cursor = wl_container_of (listener, cursor, tool_tip);
-  PhocDesktop *desktop = server->desktop;
 
-  wlr_idle_notify_activity (desktop->idle, cursor->seat->seat);
+  phoc_seat_notify_activity (cursor->seat);
   struct wlr_event_tablet_tool_tip *event = data;
   PhocTabletTool *phoc_tool = event->tool->data;
 
@@ -390,11 +395,9 @@ handle_tablet_tool_destroy (struct wl_listener *listener, void *data)
 static void
 handle_tool_button (struct wl_listener *listener, void *data)
 {
-  PhocServer *server = phoc_server_get_default ();
   PhocCursor *cursor = wl_container_of (listener, cursor, tool_button);
-  PhocDesktop *desktop = server->desktop;
 
-  wlr_idle_notify_activity (desktop->idle, cursor->seat->seat);
+  phoc_seat_notify_activity (cursor->seat);
   struct wlr_event_tablet_tool_button *event = data;
   PhocTabletTool *phoc_tool = event->tool->data;
 
@@ -406,11 +409,9 @@ handle_tool_button (struct wl_listener *listener, void *data)
 static void
 handle_tablet_tool_set_cursor (struct wl_listener *listener, void *data)
 {
-  PhocServer *server = phoc_server_get_default ();
   PhocTabletTool *tool =
     wl_container_of (listener, tool, set_cursor);
   struct wlr_tablet_v2_event_cursor *evt = data;
-  PhocDesktop *desktop = server->desktop;
 
   struct wlr_seat_pointer_request_set_cursor_event event = {
     .surface = evt->surface,
@@ -420,7 +421,7 @@ handle_tablet_tool_set_cursor (struct wl_listener *listener, void *data)
     .seat_client = evt->seat_client,
   };
 
-  wlr_idle_notify_activity (desktop->idle, tool->seat->seat);
+  phoc_seat_notify_activity (tool->seat);
   phoc_cursor_handle_request_set_cursor (tool->seat->cursor, &event);
 }
 
@@ -431,7 +432,7 @@ handle_tool_proximity (struct wl_listener *listener, void *data)
   PhocCursor *cursor = wl_container_of (listener, cursor, tool_proximity);
   PhocDesktop *desktop = server->desktop;
 
-  wlr_idle_notify_activity (desktop->idle, cursor->seat->seat);
+  phoc_seat_notify_activity (cursor->seat);
   struct wlr_event_tablet_tool_proximity *event = data;
 
   struct wlr_tablet_tool *tool = event->tool;
@@ -442,7 +443,7 @@ handle_tool_proximity (struct wl_listener *listener, void *data)
     phoc_tool->seat = cursor->seat;
     tool->data = phoc_tool;
     phoc_tool->tablet_v2_tool =
-      wlr_tablet_tool_create (desktop->tablet_v2,
+      wlr_tablet_tool_create (phoc_desktop_get_tablet_manager (desktop),
                               cursor->seat->seat, tool);
     phoc_tool->tool_destroy.notify = handle_tablet_tool_destroy;
     wl_signal_add (&tool->events.destroy, &phoc_tool->tool_destroy);
@@ -935,13 +936,10 @@ on_keyboard_destroy (PhocSeat *self, PhocKeyboard *keyboard)
 static void
 on_keyboard_activity (PhocSeat *self, PhocKeyboard *keyboard)
 {
-  PhocServer *server = phoc_server_get_default ();
-  PhocDesktop *desktop = server->desktop;
-
   g_assert (PHOC_IS_SEAT (self));
   g_assert (PHOC_IS_KEYBOARD (keyboard));
 
-  wlr_idle_notify_activity (desktop->idle, self->seat);
+  phoc_seat_notify_activity (self);
 }
 
 
@@ -1195,7 +1193,7 @@ seat_add_tablet_pad (PhocSeat                *seat,
   PhocDesktop *desktop = server->desktop;
 
   tablet_pad->tablet_v2_pad =
-    wlr_tablet_pad_create (desktop->tablet_v2, seat->seat, device);
+    wlr_tablet_pad_create (phoc_desktop_get_tablet_manager (desktop), seat->seat, device);
 
   /* Search for a sibling tablet */
   if (!wlr_input_device_is_libinput (device)) {
@@ -1259,7 +1257,7 @@ seat_add_tablet_tool (PhocSeat                *seat,
   PhocDesktop *desktop = server->desktop;
 
   tablet->tablet_v2 =
-    wlr_tablet_create (desktop->tablet_v2, seat->seat, device);
+    wlr_tablet_create (phoc_desktop_get_tablet_manager (desktop), seat->seat, device);
 
   struct libinput_device_group *group =
     libinput_device_get_device_group (wlr_libinput_get_device_handle (device));
@@ -1324,6 +1322,8 @@ phoc_seat_configure_xcursor (PhocSeat *seat)
     }
   }
 
+  /* New scales need the image to be set again */
+  seat->cursor->image_name = NULL;
   phoc_seat_maybe_set_cursor (seat, seat->cursor->default_xcursor);
   wlr_cursor_warp (seat->cursor->cursor, NULL, seat->cursor->cursor->x,
                    seat->cursor->cursor->y);
@@ -1838,11 +1838,16 @@ phoc_seat_maybe_set_cursor (PhocSeat *self, const char *name)
 {
   if (phoc_seat_has_pointer (self) == FALSE) {
     wlr_cursor_set_image (self->cursor->cursor, NULL, 0, 0, 0, 0, 0, 0);
+    self->cursor->image_name = NULL;
   } else {
     if (!name)
       name = self->cursor->default_xcursor;
+    /* Setting an image uploads it to every output's cursor plane */
+    if (g_strcmp0 (name, self->cursor->image_name) == 0)
+      return;
     wlr_xcursor_manager_set_cursor_image (self->cursor->xcursor_manager,
                                           name, self->cursor->cursor);
+    self->cursor->image_name = name;
   }
 }
 
@@ -1914,6 +1919,7 @@ phoc_seat_finalize (GObject *object)
 {
   PhocSeat *self = PHOC_SEAT (object);
 
+  g_clear_handle_id (&self->activity.flush_id, g_source_remove);
   g_clear_pointer (&self->input_mapping_settings, g_hash_table_destroy);
   phoc_seat_handle_destroy (&self->destroy, self->seat);
   wlr_seat_destroy (self->seat);
@@ -2009,3 +2015,63 @@ phoc_seat_has_keyboard (PhocSeat *self)
   g_assert (self->seat);
   return (self->seat->capabilities & WL_SEAT_CAPABILITY_KEYBOARD);
 }
+
+
+static void
+seat_flush_activity (PhocSeat *self)
+{
+  PhocServer *server = phoc_server_get_default ();
+
+  g_clear_handle_id (&self->activity.flush_id, g_source_remove);
+  self->activity.pending = FALSE;
+  self->activity.last_notify = g_get_monotonic_time ();
+  wlr_idle_notify_activity (server->desktop->idle, self->seat);
+}
+
+
+static gboolean
+on_activity_flush (gpointer data)
+{
+  PhocSeat *self = PHOC_SEAT (data);
+
+  self->activity.flush_id = 0;
+  if (self->activity.pending)
+    seat_flush_activity (self);
+
+  return G_SOURCE_REMOVE;
+}
+
+/**
+ * phoc_seat_notify_activity:
+ * @self: The seat
+ *
+ * Notify the idle timers of @self about user activity. Since
+ * re-arming the timers costs a syscall per timer, notifications are
+ * rate limited so that continuous input like pointer motion re-arms
+ * them only a few times per second: The first activity after a pause
+ * is passed on right away (so idle clients get `resumed` without
+ * delay), further activity within the interval is passed on once the
+ * interval is over. Idle timeouts hence expire at most that interval
+ * late.
+ */
+void
+phoc_seat_notify_activity (PhocSeat *self)
+{
+  gint64 since_notify;
+
+  g_return_if_fail (PHOC_IS_SEAT (self));
+
+  since_notify = (g_get_monotonic_time () - self->activity.last_notify) / 1000;
+  if (since_notify >= PHOC_SEAT_ACTIVITY_INTERVAL) {
+    seat_flush_activity (self);
+    return;
+  }
+
+  self->activity.pending = TRUE;
+  if (self->activity.flush_id)
+    return;
+
+  self->activity.flush_id = g_timeout_add (PHOC_SEAT_ACTIVITY_INTERVAL - since_notify,
+                                           on_activity_flush, self);
+  g_source_set_name_by_id (self->activity.flush_id, "[phoc] seat activity");
+}
@@ -73,6 +73,12 @@ typedef struct _PhocSeat {
   struct wl_listener              destroy;
 
   GHashTable                     *input_mapping_settings;
+
+  struct {
+    gint64                        last_notify;
+    gboolean                      pending;
+    guint                         flush_id;
+  } activity;
 } PhocSeat;
 
 typedef struct _PhocSeatView {
@@ -185,3 +191,4 @@ void               phoc_seat_maybe_set_cursor (PhocSeat *self, const char *name)
 gboolean           phoc_seat_has_touch    (PhocSeat *self);
 gboolean           phoc_seat_has_pointer  (PhocSeat *self);
 gboolean           phoc_seat_has_keyboard (PhocSeat *self);
+void               phoc_seat_notify_activity (PhocSeat *self);
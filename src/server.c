@@ -13,21 +13,56 @@
 #include "seat.h"
 #include "server.h"
 
+#include <wlr/backend/libinput.h>
+#include <wlr/types/wlr_drm.h>
 #include <wlr/xwayland.h>
 
+#include <drm_fourcc.h>
 #include <errno.h>
+#include <glib-unix.h>
 
 static void phoc_server_initable_iface_init (GInitableIface *iface);
 
 G_DEFINE_TYPE_WITH_CODE (PhocServer, phoc_server, G_TYPE_OBJECT,
 			 G_IMPLEMENT_INTERFACE (G_TYPE_INITABLE, phoc_server_initable_iface_init));
 
+/*
+ * libinput, DRM and all client sockets are part of the same
+ * wl_event_loop which is dispatched from a single source at default
+ * priority (so our timeouts, D-Bus and settings aren't starved by busy
+ * clients). Each dispatch is bounded: wl_event_loop_dispatch() handles at
+ * most one epoll batch per main loop iteration so a flooding client
+ * can't monopolize the loop. Additionally the libinput and DRM fds are
+ * watched by sources of their own at higher priority so input and page
+ * flips get dispatched ahead of other sources.
+ */
+#define PHOC_WAYLAND_PRIORITY_SOURCE_PRIORITY G_PRIORITY_HIGH
+/* Dispatches taking longer than this (in µs) get logged */
+#define PHOC_WAYLAND_SLOW_DISPATCH 8000
+
 typedef struct {
   GSource source;
   struct wl_display *display;
 } WaylandEventSource;
 
 
+static void
+wayland_event_loop_dispatch (struct wl_display *display)
+{
+  struct wl_event_loop *loop = wl_display_get_event_loop (display);
+  PhocServer *server = phoc_server_get_default ();
+  gint64 start = g_get_monotonic_time (), elapsed;
+
+  wl_event_loop_dispatch (loop, 0);
+  if (server->client_stats)
+    phoc_client_stats_end_dispatch (server->client_stats);
+
+  elapsed = g_get_monotonic_time () - start;
+  if (G_UNLIKELY (elapsed > PHOC_WAYLAND_SLOW_DISPATCH))
+    g_debug ("Slow wayland dispatch: %.3f ms", elapsed / 1000.0);
+}
+
+
 static gboolean
 wayland_event_source_prepare (GSource *base,
                               int     *timeout)
@@ -36,6 +71,8 @@ wayland_event_source_prepare (GSource *base,
 
   *timeout = -1;
 
+  /* Flush once per iteration: covers events queued by our last dispatch
+   * as well as the ones queued by other (GLib) sources since then */
   wl_display_flush_clients (source->display);
 
   return FALSE;
@@ -47,9 +84,8 @@ wayland_event_source_dispatch (GSource     *base,
                                void        *data)
 {
   WaylandEventSource *source = (WaylandEventSource *)base;
-  struct wl_event_loop *loop = wl_display_get_event_loop (source->display);
 
-  wl_event_loop_dispatch (loop, 0);
+  wayland_event_loop_dispatch (source->display);
 
   return TRUE;
 }
@@ -76,6 +112,55 @@ wayland_event_source_new (struct wl_display *display)
   return &source->source;
 }
 
+static gboolean
+on_priority_fd_ready (int fd, GIOCondition condition, gpointer data)
+{
+  PhocServer *self = phoc_server_get_default ();
+  guint *source_id = data;
+
+  if (condition & (G_IO_ERR | G_IO_HUP | G_IO_NVAL)) {
+    g_warning ("Stopped watching fd %d: %d", fd, condition);
+    *source_id = 0;
+    return G_SOURCE_REMOVE;
+  }
+
+  /* Dispatches clients too but input and vblank events are part of the batch */
+  wayland_event_loop_dispatch (self->wl_display);
+
+  return G_SOURCE_CONTINUE;
+}
+
+
+static void
+watch_priority_fd (int fd, const char *name, guint *source_id)
+{
+  if (fd < 0 || *source_id)
+    return;
+
+  *source_id = g_unix_fd_add_full (PHOC_WAYLAND_PRIORITY_SOURCE_PRIORITY, fd,
+                                   G_IO_IN | G_IO_ERR | G_IO_HUP,
+                                   on_priority_fd_ready, source_id, NULL);
+  g_source_set_name_by_id (*source_id, name);
+}
+
+
+static void
+handle_new_input (struct wl_listener *listener, void *data)
+{
+  PhocServer *self = wl_container_of (listener, self, new_input);
+  struct wlr_input_device *device = data;
+  struct libinput_device *ldev;
+
+  if (!wlr_input_device_is_libinput (device))
+    return;
+
+  /* All libinput devices share the backend's context */
+  ldev = wlr_libinput_get_device_handle (device);
+  watch_priority_fd (libinput_get_fd (libinput_device_get_context (ldev)),
+                     "[phoc] libinput source", &self->input_source);
+}
+
+
 static void
 phoc_wayland_init (PhocServer *self)
 {
@@ -134,6 +219,8 @@ phoc_startup_session_in_idle(PhocServer *self)
 		      G_SPAWN_DO_NOT_REAP_CHILD,
 		      on_child_setup, self, &pid, &err)) {
     g_child_watch_add (pid, (GChildWatchFunc)on_session_exit, self);
+    g_info ("Session spawned %.3f ms after startup",
+            (g_get_monotonic_time () - self->startup_ts) / 1000.0);
   } else {
     g_warning ("Failed to launch session: %s", err->message);
     g_main_loop_quit (self->mainloop);
@@ -188,6 +275,17 @@ damage_shield (PhocServer *self, PhocOutput *output, PhocRenderer *renderer)
 }
 
 
+static void
+on_first_frame (PhocServer *self, PhocOutput *output, PhocRenderer *renderer)
+{
+  g_assert (PHOC_IS_SERVER (self));
+
+  g_info ("First frame rendered %.3f ms after startup",
+          (g_get_monotonic_time () - self->startup_ts) / 1000.0);
+  g_clear_signal_handler (&self->first_frame_id, self->renderer);
+}
+
+
 static void
 on_shell_state_changed (PhocServer *self, GParamSpec *pspec, PhocPhoshPrivate *phosh)
 {
@@ -220,6 +318,71 @@ on_shell_state_changed (PhocServer *self, GParamSpec *pspec, PhocPhoshPrivate *p
   }
 }
 
+/*
+ * Like wlr_renderer_init_wl_display() but keeps a reference to the
+ * linux-dmabuf global so we can send per surface feedback.
+ */
+static void
+init_buffer_protocols (PhocServer *self, struct wlr_renderer *wlr_renderer)
+{
+  const uint32_t *formats;
+  size_t n_formats;
+
+  if (wl_display_init_shm (self->wl_display))
+    g_warning ("Failed to initialize shm");
+
+  formats = wlr_renderer_get_shm_texture_formats (wlr_renderer, &n_formats);
+  for (size_t i = 0; i < n_formats; i++) {
+    /* ARGB8888 and XRGB8888 are always supported and have different codes */
+    if (formats[i] != DRM_FORMAT_ARGB8888 && formats[i] != DRM_FORMAT_XRGB8888)
+      wl_display_add_shm_format (self->wl_display, formats[i]);
+  }
+
+  if (wlr_renderer_get_dmabuf_texture_formats (wlr_renderer) == NULL)
+    return;
+
+  if (wlr_renderer_get_drm_fd (wlr_renderer) >= 0) {
+    if (wlr_drm_create (self->wl_display, wlr_renderer) == NULL)
+      g_warning ("Failed to create wl_drm global");
+  } else {
+    g_info ("Cannot get renderer DRM FD, disabling wl_drm");
+  }
+
+  self->linux_dmabuf = wlr_linux_dmabuf_v1_create (self->wl_display, wlr_renderer);
+  if (self->linux_dmabuf == NULL)
+    g_warning ("Failed to create linux-dmabuf global");
+}
+
+
+/*
+ * The renderer is picked via PHOC_RENDERER or phoc.ini so it can only
+ * be created once the config got parsed.
+ */
+static gboolean
+init_renderer (PhocServer *self, const char *renderer_name)
+{
+  g_autoptr (GError) err = NULL;
+  struct wlr_renderer *wlr_renderer;
+  gint64 ts = g_get_monotonic_time ();
+
+  self->renderer = phoc_renderer_new (self->backend, renderer_name, &err);
+  if (self->renderer == NULL) {
+    g_warning ("Failed to create renderer: %s", err->message);
+    return FALSE;
+  }
+  wlr_renderer = phoc_renderer_get_wlr_renderer (self->renderer);
+  PHOC_LOG_PHASE (ts, "renderer");
+
+  self->data_device_manager = wlr_data_device_manager_create(self->wl_display);
+  init_buffer_protocols (self, wlr_renderer);
+
+  self->compositor = wlr_compositor_create(self->wl_display,
+                                           wlr_renderer);
+  PHOC_LOG_PHASE (ts, "compositor");
+
+  return TRUE;
+}
+
 
 static gboolean
 phoc_server_initable_init (GInitable    *initable,
@@ -227,7 +390,9 @@ phoc_server_initable_init (GInitable    *initable,
 			   GError      **error)
 {
   PhocServer *self = PHOC_SERVER (initable);
-  struct wlr_renderer *wlr_renderer;
+  gint64 ts;
+
+  self->startup_ts = ts = g_get_monotonic_time ();
 
   self->wl_display = wl_display_create();
   if (self->wl_display == NULL) {
@@ -236,6 +401,7 @@ phoc_server_initable_init (GInitable    *initable,
 		 "Could not create wayland display");
     return FALSE;
   }
+  PHOC_LOG_PHASE (ts, "display");
 
   self->backend = wlr_backend_autocreate(self->wl_display);
   if (self->backend == NULL) {
@@ -244,18 +410,12 @@ phoc_server_initable_init (GInitable    *initable,
 		 "Could not create backend");
     return FALSE;
   }
+  PHOC_LOG_PHASE (ts, "backend");
 
-  self->renderer = phoc_renderer_new (self->backend, error);
-  if (self->renderer == NULL) {
-    return FALSE;
-  }
-  wlr_renderer = phoc_renderer_get_wlr_renderer (self->renderer);
-
-  self->data_device_manager = wlr_data_device_manager_create(self->wl_display);
-  wlr_renderer_init_wl_display(wlr_renderer, self->wl_display);
-
-  self->compositor = wlr_compositor_create(self->wl_display,
-                                           wlr_renderer);
+  watch_priority_fd (wlr_backend_get_drm_fd (self->backend), "[phoc] DRM source",
+                     &self->drm_source);
+  self->new_input.notify = handle_new_input;
+  wl_signal_add (&self->backend->events.new_input, &self->new_input);
 
   return TRUE;
 }
@@ -273,14 +433,21 @@ phoc_server_dispose (GObject *object)
 {
   PhocServer *self = PHOC_SERVER (object);
 
+  /* The backend closes the fds */
+  g_clear_handle_id (&self->drm_source, g_source_remove);
+  g_clear_handle_id (&self->input_source, g_source_remove);
+
   if (self->backend) {
+    wl_list_remove (&self->new_input.link);
     wl_display_destroy_clients (self->wl_display);
     wlr_backend_destroy(self->backend);
     self->backend = NULL;
   }
+  g_clear_object (&self->client_stats);
 
   g_clear_signal_handler (&self->render_shield_id, self->renderer);
   g_clear_signal_handler (&self->damage_shield_id, self->renderer);
+  g_clear_signal_handler (&self->first_frame_id, self->renderer);
   g_clear_object (&self->renderer);
 
   G_OBJECT_CLASS (phoc_server_parent_class)->dispose (object);
@@ -366,6 +533,8 @@ phoc_server_setup (PhocServer *self, const char *config_path,
                    PhocServerFlags flags,
 		   PhocServerDebugFlags debug_flags)
 {
+  gint64 ts = g_get_monotonic_time ();
+
   g_assert (!self->inited);
 
   self->config = phoc_config_create (config_path);
@@ -373,12 +542,22 @@ phoc_server_setup (PhocServer *self, const char *config_path,
     /* phoc_config_create printed an error */
     return FALSE;
   }
+  PHOC_LOG_PHASE (ts, "config");
+
+  if (!init_renderer (self, g_getenv ("PHOC_RENDERER") ?: self->config->renderer))
+    return FALSE;
 
   self->debug_flags = debug_flags;
   self->mainloop = mainloop;
   self->exit_status = 1;
+  self->client_stats = phoc_client_stats_new (debug_flags & PHOC_SERVER_DEBUG_FLAG_CLIENT_STATS);
+  phoc_client_stats_set_budgets (self->client_stats,
+                                 self->config->budget.thumbnail_rate,
+                                 self->config->budget.background_frame_rate);
   self->desktop = phoc_desktop_new (self->config);
+  PHOC_LOG_PHASE (ts, "desktop");
   self->input = phoc_input_new ();
+  PHOC_LOG_PHASE (ts, "input");
   self->session = g_strdup (session);
   self->mainloop = mainloop;
   self->flags = flags;
@@ -392,12 +571,17 @@ phoc_server_setup (PhocServer *self, const char *config_path,
 
   g_print ("Running compositor on wayland display '%s'\n", socket);
 
+  self->first_frame_id = g_signal_connect_object (self->renderer, "render-end",
+                                                  G_CALLBACK (on_first_frame),
+                                                  self, G_CONNECT_SWAPPED);
+  /* Outputs and input devices (and hence seats) get added here */
   if (!wlr_backend_start(self->backend)) {
     g_warning("Failed to start backend");
     wlr_backend_destroy(self->backend);
     wl_display_destroy(self->wl_display);
     return FALSE;
   }
+  PHOC_LOG_PHASE (ts, "backend start");
 
   g_setenv("WAYLAND_DISPLAY", socket, true);
 #ifdef PHOC_XWAYLAND
@@ -419,6 +603,7 @@ phoc_server_setup (PhocServer *self, const char *config_path,
   phoc_wayland_init (self);
   if (self->session)
     phoc_startup_session (self);
+  PHOC_LOG_PHASE (ts, "setup");
 
   self->inited = TRUE;
   return TRUE;
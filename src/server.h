@@ -1,5 +1,6 @@
 #pragma once
 
+#include "client-stats.h"
 #include "render.h"
 
 #include <wayland-server-core.h>
@@ -8,6 +9,7 @@
 #include <wlr/config.h>
 #include <wlr/types/wlr_compositor.h>
 #include <wlr/types/wlr_data_device.h>
+#include <wlr/types/wlr_linux_dmabuf_v1.h>
 #include "settings.h"
 #include "desktop.h"
 #include "input.h"
@@ -34,6 +36,7 @@ typedef enum _PhocServerDebugFlags {
   PHOC_SERVER_DEBUG_FLAG_DAMAGE_TRACKING = 1 << 1,
   PHOC_SERVER_DEBUG_FLAG_NO_QUIT =         1 << 2,
   PHOC_SERVER_DEBUG_FLAG_TOUCH_POINTS =    1 << 3,
+  PHOC_SERVER_DEBUG_FLAG_CLIENT_STATS =    1 << 4,
 } PhocServerDebugFlags;
 
 /**
@@ -52,6 +55,7 @@ struct _PhocServer {
   PhocConfig *config;
   PhocDesktop *desktop;
   PhocInput *input;
+  PhocClientStats *client_stats;
   PhocServerFlags flags;
   PhocServerDebugFlags debug_flags;
   gboolean inited;
@@ -64,6 +68,9 @@ struct _PhocServer {
   /* Wayland resources */
   struct wl_display *wl_display;
   guint wl_source;
+  guint drm_source;
+  guint input_source;
+  struct wl_listener new_input;
 
   /* WLR tools */
   struct wlr_compositor *compositor;
@@ -72,6 +79,11 @@ struct _PhocServer {
 
   /* Global resources */
   struct wlr_data_device_manager *data_device_manager;
+  struct wlr_linux_dmabuf_v1     *linux_dmabuf;
+
+  /* Startup timing */
+  gint64 startup_ts;
+  gulong first_frame_id;
 
   /* Fader */
   gulong render_shield_id;
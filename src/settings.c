@@ -71,14 +71,52 @@ static int config_ini_handler(PhocConfig *config, const char *section, const cha
 			} else if (strcasecmp(value, "immediate") == 0) {
 				config->xwayland = true;
 				config->xwayland_lazy = false;
+			} else if (strcasecmp(value, "prewarm") == 0) {
+				config->xwayland = true;
+				config->xwayland_prewarm = true;
 			} else if (strcasecmp(value, "false") == 0) {
 				config->xwayland = false;
 			} else {
 				g_critical ("got unknown xwayland value: %s", value);
 			}
+		} else if (strcmp(name, "xwayland-idle-timeout") == 0) {
+			config->xwayland_idle_timeout = strtoul(value, NULL, 10);
+		} else if (strcmp(name, "scale-to-fit-cache") == 0) {
+			if (strcasecmp(value, "true") == 0) {
+				config->scale_to_fit_cache = true;
+			} else if (strcasecmp(value, "false") == 0) {
+				config->scale_to_fit_cache = false;
+			} else {
+				g_critical ("got invalid scale-to-fit-cache value: %s", value);
+			}
+		} else if (strcmp(name, "renderer") == 0) {
+			g_free (config->renderer);
+			config->renderer = g_strdup (value);
 		} else {
 			g_critical ("got unknown core config: %s", name);
 		}
+	} else if (strcmp(section, "budget") == 0) {
+		if (strcmp(name, "thumbnail-rate") == 0) {
+			config->budget.thumbnail_rate = strtoul(value, NULL, 10);
+		} else if (strcmp(name, "background-frame-rate") == 0) {
+			config->budget.background_frame_rate = strtoul(value, NULL, 10);
+		} else {
+			g_critical ("got unknown budget config: %s", name);
+		}
+	} else if (strcmp(section, "touch") == 0) {
+		if (strcmp(name, "resample") == 0) {
+			if (strcasecmp(value, "true") == 0) {
+				config->touch.resample = true;
+			} else if (strcasecmp(value, "false") == 0) {
+				config->touch.resample = false;
+			} else {
+				g_critical ("got invalid touch resample value: %s", value);
+			}
+		} else if (strcmp(name, "max-prediction") == 0) {
+			config->touch.max_prediction = strtoul(value, NULL, 10);
+		} else {
+			g_critical ("got unknown touch config: %s", name);
+		}
 	} else if (strncmp(output_prefix, section, strlen(output_prefix)) == 0) {
 		const char *output_name = section + strlen(output_prefix);
 		PhocOutputConfig *oc;
@@ -97,6 +135,7 @@ static int config_ini_handler(PhocConfig *config, const char *section, const cha
 			oc->transform = WL_OUTPUT_TRANSFORM_NORMAL;
 			oc->scale = 0;
 			oc->enable = true;
+			oc->idle.timeout = PHOC_OUTPUT_CONFIG_IDLE_TIMEOUT;
 			wl_list_init(&oc->modes);
 			wl_list_insert(&config->outputs, &oc->link);
 		}
@@ -157,6 +196,17 @@ static int config_ini_handler(PhocConfig *config, const char *section, const cha
 			g_debug ("Configured output %s with mode %dx%d@%f",
 					oc->name, oc->mode.width, oc->mode.height,
 					oc->mode.refresh_rate);
+		} else if (strcmp(name, "idle-refresh") == 0) {
+			oc->idle.refresh_rate = strtof(value, NULL);
+			if (oc->idle.refresh_rate < 0) {
+				g_critical ("got invalid idle refresh rate: %s", value);
+				oc->idle.refresh_rate = 0;
+			}
+		} else if (strcmp(name, "idle-timeout") == 0) {
+			oc->idle.timeout = strtoul(value, NULL, 10);
+		} else if (strcmp(name, "mirror") == 0) {
+			g_free (oc->mirror);
+			oc->mirror = g_strdup (value);
 		} else if (strcmp(name, "modeline") == 0) {
 			PhocOutputModeConfig *mode = g_new0 (PhocOutputModeConfig, 1);
 
@@ -191,6 +241,7 @@ phoc_config_create (const char *config_path)
 
   config->xwayland = true;
   config->xwayland_lazy = true;
+  config->touch.max_prediction = PHOC_CONFIG_TOUCH_MAX_PREDICTION;
   wl_list_init(&config->outputs);
 
   config->config_path = g_strdup (config_path);
@@ -270,11 +321,13 @@ void phoc_config_destroy (PhocConfig *config)
       g_free (omc);
     }
     g_free (oc->name);
+    g_free (oc->mirror);
     g_free (oc);
   }
 
   g_object_unref (config->keybindings);
 
+  g_free (config->renderer);
   g_free (config->config_path);
   g_free (config);
 }
@@ -10,6 +10,8 @@
 G_BEGIN_DECLS
 
 #define PHOC_CONFIG_DEFAULT_SEAT_NAME "seat0"
+#define PHOC_OUTPUT_CONFIG_IDLE_TIMEOUT 1000 /* ms */
+#define PHOC_CONFIG_TOUCH_MAX_PREDICTION 8 /* ms */
 
 typedef struct _PhocOutputModeConfig {
 	drmModeModeInfo info;
@@ -28,16 +30,35 @@ typedef struct _PhocOutputConfig {
 		float refresh_rate;
 	} mode;
 	struct wl_list modes;
+	struct {
+		float refresh_rate;
+		guint timeout;
+	} idle;
+	char *mirror;
 } PhocOutputConfig;
 
 typedef struct _PhocConfig {
 	bool xwayland;
 	bool xwayland_lazy;
+	bool xwayland_prewarm;
+	guint xwayland_idle_timeout;
+	bool scale_to_fit_cache;
+	char *renderer;
 
 	PhocKeybindings *keybindings;
 
 	struct wl_list outputs;
 
+	struct {
+		guint thumbnail_rate;
+		guint background_frame_rate;
+	} budget;
+
+	struct {
+		bool resample;
+		guint max_prediction;
+	} touch;
+
 	char *config_path;
 } PhocConfig;
 
@@ -133,7 +133,8 @@ static void relay_send_im_done(PhocInputMethodRelay *relay,
 		// Don't let input method know about events from unfocused surfaces.
 		return;
 	}
-	// TODO: only send each of those if they were modified
+	// The input method's pending state is reset on every done so always
+	// send the full state, even if unchanged
 	if (input->active_features & WLR_TEXT_INPUT_V3_FEATURE_SURROUNDING_TEXT) {
 		wlr_input_method_v2_send_surrounding_text(input_method,
 			input->current.surrounding.text, input->current.surrounding.cursor,
@@ -0,0 +1,176 @@
+/*
+ * Copyright (C) 2022 Purism SPC
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#define G_LOG_DOMAIN "phoc-touch-resampler"
+
+#include "config.h"
+
+#include "touch-resampler.h"
+
+/* Same as PhocGestureSwipe's backlog */
+#define CAPTURE_THRESHOLD_US (150 * 1000)
+/* Samples used to estimate the current velocity */
+#define VELOCITY_WINDOW_US (40 * 1000)
+
+/**
+ * PhocTouchResampler:
+ *
+ * Touch samples arrive at the digitizer's rate which is unrelated to
+ * the output's refresh rate. Using the latest sample at each frame
+ * hence jitters. `PhocTouchResampler` keeps a short history of
+ * samples so the position can be interpolated to the time a frame is
+ * rendered (minus a small latency so there are samples around it) and,
+ * if that is past the last sample, extrapolated from the recent
+ * velocity by at most a configurable amount of time.
+ */
+
+typedef struct _Sample {
+  gint64 time;
+  double x;
+  double y;
+} Sample;
+
+struct _PhocTouchResampler {
+  GArray *samples;
+  gint64  max_prediction;
+};
+
+
+/**
+ * phoc_touch_resampler_new:
+ * @max_prediction_ms: How far to extrapolate beyond the last sample at most
+ *
+ * Returns: A new resampler
+ */
+PhocTouchResampler *
+phoc_touch_resampler_new (guint max_prediction_ms)
+{
+  PhocTouchResampler *self = g_new0 (PhocTouchResampler, 1);
+
+  self->samples = g_array_new (FALSE, FALSE, sizeof (Sample));
+  self->max_prediction = max_prediction_ms * 1000;
+
+  return self;
+}
+
+
+void
+phoc_touch_resampler_free (PhocTouchResampler *self)
+{
+  g_array_free (self->samples, TRUE);
+  g_free (self);
+}
+
+/**
+ * phoc_touch_resampler_reset:
+ * @self: The resampler
+ *
+ * Drops all samples, e.g. when a new touch sequence starts.
+ */
+void
+phoc_touch_resampler_reset (PhocTouchResampler *self)
+{
+  g_array_set_size (self->samples, 0);
+}
+
+/**
+ * phoc_touch_resampler_add_sample:
+ * @self: The resampler
+ * @time_us: The sample's timestamp in µs
+ * @x: The x coordinate
+ * @y: The y coordinate
+ *
+ * Adds a touch sample. Samples are expected in chronological order,
+ * a sample not newer than the last one replaces it.
+ */
+void
+phoc_touch_resampler_add_sample (PhocTouchResampler *self, gint64 time_us, double x, double y)
+{
+  Sample new = { .time = time_us, .x = x, .y = y };
+  guint i;
+
+  while (self->samples->len) {
+    Sample *last = &g_array_index (self->samples, Sample, self->samples->len - 1);
+
+    if (last->time < time_us)
+      break;
+    g_array_set_size (self->samples, self->samples->len - 1);
+  }
+
+  for (i = 0; i < self->samples->len; i++) {
+    if (g_array_index (self->samples, Sample, i).time >= time_us - CAPTURE_THRESHOLD_US)
+      break;
+  }
+  if (i > 0)
+    g_array_remove_range (self->samples, 0, i);
+
+  g_array_append_val (self->samples, new);
+}
+
+/**
+ * phoc_touch_resampler_get_position:
+ * @self: The resampler
+ * @time_us: The time the position is wanted for, usually when the
+ *   next frame gets presented
+ * @x: (out): The x coordinate
+ * @y: (out): The y coordinate
+ *
+ * Interpolates the position between the samples around @time_us. If
+ * @time_us is past the last sample the position is extrapolated from
+ * the current velocity.
+ *
+ * Returns: %TRUE if a position could be determined, %FALSE if there
+ *   are no samples
+ */
+gboolean
+phoc_touch_resampler_get_position (PhocTouchResampler *self, gint64 time_us, double *x, double *y)
+{
+  Sample *last, *start = NULL;
+  gint64 dt;
+
+  if (self->samples->len == 0)
+    return FALSE;
+
+  last = &g_array_index (self->samples, Sample, self->samples->len - 1);
+  *x = last->x;
+  *y = last->y;
+
+  /* Before the first sample, e.g. timestamps from a different clock */
+  if (time_us < g_array_index (self->samples, Sample, 0).time)
+    return TRUE;
+
+  if (time_us <= last->time) {
+    for (guint i = 1; i < self->samples->len; i++) {
+      Sample *a = &g_array_index (self->samples, Sample, i - 1);
+      Sample *b = &g_array_index (self->samples, Sample, i);
+      double f;
+
+      if (b->time < time_us)
+        continue;
+
+      f = (double)(time_us - a->time) / (b->time - a->time);
+      *x = a->x + (b->x - a->x) * f;
+      *y = a->y + (b->y - a->y) * f;
+      break;
+    }
+    return TRUE;
+  }
+
+  if (self->samples->len < 2 || self->max_prediction == 0)
+    return TRUE;
+
+  for (guint i = 0; i < self->samples->len - 1; i++) {
+    start = &g_array_index (self->samples, Sample, i);
+    if (start->time >= last->time - VELOCITY_WINDOW_US)
+      break;
+  }
+
+  dt = MIN (time_us - last->time, self->max_prediction);
+  *x += (last->x - start->x) * dt / (last->time - start->time);
+  *y += (last->y - start->y) * dt / (last->time - start->time);
+
+  return TRUE;
+}
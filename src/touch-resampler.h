@@ -0,0 +1,29 @@
+/*
+ * Copyright (C) 2022 Purism SPC
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _PhocTouchResampler PhocTouchResampler;
+
+PhocTouchResampler *phoc_touch_resampler_new          (guint               max_prediction_ms);
+void                phoc_touch_resampler_free         (PhocTouchResampler *self);
+void                phoc_touch_resampler_reset        (PhocTouchResampler *self);
+void                phoc_touch_resampler_add_sample   (PhocTouchResampler *self,
+                                                       gint64              time_us,
+                                                       double              x,
+                                                       double              y);
+gboolean            phoc_touch_resampler_get_position (PhocTouchResampler *self,
+                                                       gint64              time_us,
+                                                       double             *x,
+                                                       double             *y);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (PhocTouchResampler, phoc_touch_resampler_free)
+
+G_END_DECLS
@@ -12,6 +12,7 @@
 
 #include <inttypes.h>
 #include <math.h>
+#include <stdlib.h>
 #include <wlr/util/box.h>
 #include <wlr/version.h>
 #include "utils.h"
@@ -174,3 +175,34 @@ phoc_utils_compute_scale (int32_t phys_width, int32_t phys_height,
 
   return scale;
 }
+
+/**
+ * phoc_utils_snap_to_buffer_size:
+ * @dst_box: The box the buffer gets rendered to in output coordinates
+ * @src_box: The source box within the buffer
+ * @transform: The transform applied when rendering the buffer
+ *
+ * Clients using fractional scaling submit buffers matching the
+ * surface's size on the output but both sides round differently. If
+ * @dst_box is off by at most a pixel use the buffer's size so it's
+ * not resampled.
+ */
+void
+phoc_utils_snap_to_buffer_size (struct wlr_box *dst_box, const struct wlr_fbox *src_box,
+                                enum wl_output_transform transform)
+{
+  int width = round (src_box->width);
+  int height = round (src_box->height);
+
+  if (transform & WL_OUTPUT_TRANSFORM_90) {
+    int tmp = width;
+
+    width = height;
+    height = tmp;
+  }
+
+  if (abs (dst_box->width - width) <= 1 && abs (dst_box->height - height) <= 1) {
+    dst_box->width = width;
+    dst_box->height = height;
+  }
+}
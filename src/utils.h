@@ -2,6 +2,7 @@
 
 #include <glib.h>
 #include <wlr/types/wlr_output_layout.h>
+#include <wlr/util/box.h>
 
 G_BEGIN_DECLS
 
@@ -26,6 +27,20 @@ G_BEGIN_DECLS
  */
 #define PHOC_PRIV_CONTAINER(c, t, p)  (c)(PHOC_PRIV_CONTAINER_P(t,p))
 
+/**
+ * PHOC_LOG_PHASE:
+ * ts: A `gint64` holding the monotonic time the phase started at
+ * phase: The name of the phase
+ *
+ * Logs the duration of a (startup) phase and resets @ts to the current
+ * time so it can be used for the next phase.
+ */
+#define PHOC_LOG_PHASE(ts, phase) G_STMT_START {                         \
+    gint64 __now = g_get_monotonic_time ();                             \
+    g_debug ("Phase '%s' took %.3f ms", (phase), (__now - (ts)) / 1000.0); \
+    (ts) = __now;                                                       \
+  } G_STMT_END
+
 void phoc_utils_fix_transform (enum wl_output_transform *transform);
 void phoc_utils_rotate_child_position (double *sx, double *sy, double sw, double sh,
                                        double pw, double ph, float rotation);
@@ -35,5 +50,8 @@ double     phoc_ease_in_cubic               (double t);
 double     phoc_ease_out_cubic              (double t);
 float      phoc_utils_compute_scale         (int32_t phys_width, int32_t phys_height,
                                              int32_t width, int32_t height);
+void       phoc_utils_snap_to_buffer_size   (struct wlr_box *dst_box,
+                                             const struct wlr_fbox *src_box,
+                                             enum wl_output_transform transform);
 
 G_END_DECLS
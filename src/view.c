@@ -20,6 +20,10 @@ typedef struct _PhocViewPrivate {
   char *title;
   char *app_id;
   GSettings *settings;
+  /* Cached from settings to avoid lookups in hot paths */
+  gboolean scale_to_fit;
+  /* Frame callbacks deferred due to the background frame budget */
+  guint background_frame_id;
 } PhocViewPrivate;
 
 G_DEFINE_TYPE_WITH_PRIVATE (PhocView, phoc_view, G_TYPE_OBJECT)
@@ -842,27 +846,20 @@ munge_app_id (const gchar *app_id)
   return id;
 }
 
-static void view_update_scale(PhocView *view) {
+/**
+ * view_update_scale:
+ * @view: The #PhocView
+ *
+ * Scale the view down if it doesn't fit its output and scale-to-fit
+ * is enabled for it. Otherwise the view is shown at its original scale.
+ */
+void view_update_scale(PhocView *view) {
 	PhocServer *server = phoc_server_get_default ();
 	PhocViewPrivate *priv;
 
 	g_assert (PHOC_IS_VIEW (view));
 	priv = phoc_view_get_instance_private (view);
 
-	if (!PHOC_VIEW_GET_CLASS (view)->want_scaling(view)) {
-		return;
-	}
-
-	bool scaling_enabled = false;
-
-	if (priv->settings) {
-		scaling_enabled = g_settings_get_boolean (priv->settings, "scale-to-fit");
-	}
-
-	if (!scaling_enabled && !phoc_desktop_get_scale_to_fit (server->desktop)) {
-		return;
-	}
-
 	struct wlr_output *output = view_get_output(view);
 	if (!output) {
 		return;
@@ -870,20 +867,28 @@ static void view_update_scale(PhocView *view) {
 
 	PhocOutput *phoc_output = output->data;
 
-	float scalex = 1.0f, scaley = 1.0f, oldscale = view->scale;
-	scalex = phoc_output->usable_area.width / (float)view->box.width;
-	scaley = phoc_output->usable_area.height / (float)view->box.height;
-	if (scaley < scalex) {
-		view->scale = scaley;
-	} else {
-		view->scale = scalex;
-	}
-	if (view->scale < 0.5f) {
-		view->scale = 0.5f;
-	}
-	if (view->scale > 1.0f || view_is_fullscreen (view)) {
-		view->scale = 1.0f;
+	float oldscale = view->scale;
+	view->scale = 1.0f;
+
+	if (PHOC_VIEW_GET_CLASS (view)->want_scaling(view) &&
+	    (priv->scale_to_fit || phoc_desktop_get_scale_to_fit (server->desktop))) {
+		float scalex, scaley;
+
+		scalex = phoc_output->usable_area.width / (float)view->box.width;
+		scaley = phoc_output->usable_area.height / (float)view->box.height;
+		if (scaley < scalex) {
+			view->scale = scaley;
+		} else {
+			view->scale = scalex;
+		}
+		if (view->scale < 0.5f) {
+			view->scale = 0.5f;
+		}
+		if (view->scale > 1.0f || view_is_fullscreen (view)) {
+			view->scale = 1.0f;
+		}
 	}
+
 	if (view->scale != oldscale) {
 		if (view_is_maximized(view)) {
 			view_arrange_maximized(view, NULL);
@@ -941,6 +946,7 @@ void view_unmap(PhocView *view) {
 	wl_signal_emit(&view->events.unmap, view);
 
 	phoc_view_damage_whole (view);
+	phoc_view_layout_committed (view);
 
 	wl_list_remove(&view->surface_new_subsurface.link);
 
@@ -988,6 +994,18 @@ void view_initial_focus(PhocView *view) {
 	}
 }
 
+static gboolean
+on_background_frame_timeout (gpointer data)
+{
+  PhocView *view = PHOC_VIEW (data);
+  PhocViewPrivate *priv = phoc_view_get_instance_private (view);
+
+  priv->background_frame_id = 0;
+  view_send_frame_done_if_not_visible (view);
+
+  return G_SOURCE_REMOVE;
+}
+
 /**
  * view_send_frame_done_if_not_visible:
  * @view: The #PhocView
@@ -998,12 +1016,30 @@ void view_initial_focus(PhocView *view) {
  * by the client. It's worth calling this function when sending
  * events like `configure` or `close`, as these should get processed
  * immediately regardless of surface visibility.
+ *
+ * If the client exceeds its background frame budget the frame done
+ * event is sent once the budget allows it again.
  */
 void
 view_send_frame_done_if_not_visible (PhocView *view)
 {
+  PhocViewPrivate *priv = phoc_view_get_instance_private (view);
+
   if (!phoc_desktop_view_is_visible (view->desktop, view) && phoc_view_is_mapped (view)) {
+    PhocServer *server = phoc_server_get_default ();
+    struct wl_client *client = wl_resource_get_client (view->wlr_surface->resource);
     struct timespec now;
+    guint retry_ms;
+
+    if (!phoc_client_stats_allow_background_frame (server->client_stats, client, &retry_ms)) {
+      if (priv->background_frame_id == 0) {
+        priv->background_frame_id = g_timeout_add (retry_ms, on_background_frame_timeout, view);
+        g_source_set_name_by_id (priv->background_frame_id, "[phoc] background frame");
+      }
+      return;
+    }
+
+    g_clear_handle_id (&priv->background_frame_id, g_source_remove);
     clock_gettime (CLOCK_MONOTONIC, &now);
     wlr_surface_send_frame_done (view->wlr_surface, &now);
   }
@@ -1044,6 +1080,7 @@ phoc_view_apply_damage (PhocView *view)
 {
   PhocOutput *output;
 
+  view->damage_serial++;
   wl_list_for_each (output, &view->desktop->outputs, link)
     phoc_output_damage_from_view (output, view, false);
 }
@@ -1061,6 +1098,8 @@ void
 phoc_view_damage_whole (PhocView *view)
 {
   PhocOutput *output;
+
+  view->damage_serial++;
   wl_list_for_each(output, &view->desktop->outputs, link)
     phoc_output_damage_from_view (output, view, true);
 }
@@ -1108,6 +1147,66 @@ void view_update_size(PhocView *view, int width, int height) {
 	phoc_view_damage_whole (view);
 }
 
+/**
+ * view_update_geometry:
+ * @view: The view
+ * @x: The new x coordinate
+ * @y: The new y coordinate
+ * @width: The new width
+ * @height: The new height
+ * @moved: Whether @x and @y come from a pending move
+ *
+ * Updates the view's position and size in one go. Unlike calling
+ * view_update_size() followed by view_update_position() this damages
+ * the old and the new area only once. Views that need centering get
+ * centered on size changes unless they're being moved.
+ */
+void view_update_geometry(PhocView *view, int x, int y, int width, int height, bool moved) {
+	if (view->box.x == x && view->box.y == y &&
+	    view->box.width == width && view->box.height == height) {
+		return;
+	}
+
+	struct wlr_box before;
+	bool resized = view->box.width != width || view->box.height != height;
+	view_get_box(view, &before);
+	phoc_view_damage_whole (view);
+	view->box.x = x;
+	view->box.y = y;
+	view->box.width = width;
+	view->box.height = height;
+	if (resized) {
+		if (moved) {
+			/* An explicit move wins over centering */
+			view->pending_centering = false;
+		} else if (view->pending_centering || (view_is_floating (view) && phoc_desktop_get_auto_maximize (view->desktop))) {
+			/* Moves the view so the damage below covers the final position */
+			view_center (view, NULL);
+			view->pending_centering = false;
+		}
+		view_update_scale(view);
+	}
+	view_update_output(view, &before);
+	phoc_view_damage_whole (view);
+}
+
+/**
+ * phoc_view_layout_committed:
+ * @view: The view
+ *
+ * Notifies outputs waiting for the view to catch up with a layout
+ * change that it either did so or won't anymore (e.g. as it got
+ * unmapped).
+ */
+void
+phoc_view_layout_committed (PhocView *view)
+{
+  PhocOutput *output;
+
+  wl_list_for_each (output, &view->desktop->outputs, link)
+    phoc_output_transaction_remove_view (output, view);
+}
+
 void view_update_decorated(PhocView *view, bool decorated) {
 	if (view->decorated == decorated) {
 		return;
@@ -1159,6 +1258,20 @@ void view_set_parent(PhocView *view, PhocView *parent) {
 		                                          view->parent ? view->parent->toplevel_handle : NULL);
 }
 
+static void
+on_scale_to_fit_changed (PhocView    *self,
+                         const gchar *key,
+                         GSettings   *settings)
+{
+	PhocViewPrivate *priv;
+
+	g_assert (PHOC_IS_VIEW (self));
+	priv = phoc_view_get_instance_private (self);
+
+	priv->scale_to_fit = g_settings_get_boolean (settings, key);
+	view_update_scale (self);
+}
+
 void view_set_app_id(PhocView *view, const char *app_id) {
 	PhocViewPrivate *priv;
 
@@ -1169,10 +1282,14 @@ void view_set_app_id(PhocView *view, const char *app_id) {
 	priv->app_id = g_strdup (app_id);
 
 	g_clear_object (&priv->settings);
+	priv->scale_to_fit = FALSE;
 	if (app_id) {
 		g_autofree gchar *munged_app_id = munge_app_id (app_id);
 		g_autofree gchar *path = g_strconcat ("/sm/puri/phoc/application/", munged_app_id, "/", NULL);
 		priv->settings = g_settings_new_with_path ("sm.puri.phoc.application", path);
+		g_signal_connect_swapped (priv->settings, "changed::scale-to-fit",
+		                          G_CALLBACK (on_scale_to_fit_changed), view);
+		priv->scale_to_fit = g_settings_get_boolean (priv->settings, "scale-to-fit");
 	}
 
 	view_update_scale(view);
@@ -1283,6 +1400,7 @@ phoc_view_finalize (GObject *object)
     self->fullscreen_output->fullscreen_view = NULL;
   }
 
+  g_clear_handle_id (&priv->background_frame_id, g_source_remove);
   g_clear_pointer (&priv->title, g_free);
   g_clear_pointer (&priv->app_id, g_free);
   g_clear_object (&priv->settings);
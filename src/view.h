@@ -80,6 +80,7 @@ struct _PhocView {
 	struct wl_list stack; // PhocView::link
 
 	struct wlr_surface *wlr_surface; // set only when the surface is mapped
+	guint damage_serial; // bumped whenever the view's content is damaged
 	struct wl_list child_surfaces; // PhocViewChild::link
 
 	struct wlr_foreign_toplevel_handle_v1 *toplevel_handle;
@@ -190,6 +191,9 @@ gboolean view_is_tiled(const PhocView *view);
 gboolean view_is_fullscreen(const PhocView *view);
 void view_update_position(PhocView *view, int x, int y);
 void view_update_size(PhocView *view, int width, int height);
+void view_update_geometry(PhocView *view, int x, int y, int width, int height, bool moved);
+void view_update_scale(PhocView *view);
+void phoc_view_layout_committed (PhocView *view);
 void view_update_decorated(PhocView *view, bool decorated);
 void view_initial_focus(PhocView *view);
 void phoc_view_map (PhocView *view, struct wlr_surface *surface);
@@ -262,17 +262,16 @@ static void handle_surface_commit(struct wl_listener *listener, void *data) {
 		return;
 	}
 
-	phoc_view_apply_damage(view);
-
 	struct wlr_box size;
 	get_size(view, &size);
-	view_update_size(view, size.width, size.height);
 
+	double x = view->box.x;
+	double y = view->box.y;
+	bool moved = false;
 	uint32_t pending_serial =
 		roots_surface->pending_move_resize_configure_serial;
 	if (pending_serial > 0 && pending_serial >= surface->current.configure_serial) {
-		double x = view->box.x;
-		double y = view->box.y;
+		moved = view->pending_move_resize.update_x || view->pending_move_resize.update_y;
 		if (view->pending_move_resize.update_x) {
 			if (view_is_floating (view)) {
 				x = view->pending_move_resize.x + view->pending_move_resize.width -
@@ -289,7 +288,6 @@ static void handle_surface_commit(struct wl_listener *listener, void *data) {
 				y = view->pending_move_resize.y;
 			}
 		}
-		view_update_position(view, x, y);
 
 		if (pending_serial == surface->current.configure_serial) {
 			roots_surface->pending_move_resize_configure_serial = 0;
@@ -297,13 +295,23 @@ static void handle_surface_commit(struct wl_listener *listener, void *data) {
 	}
 
 	struct wlr_box geometry;
-        phoc_xdg_surface_get_geometry (roots_surface, &geometry);
-	if (roots_surface->saved_geometry.x != geometry.x || roots_surface->saved_geometry.y != geometry.y) {
-		view_update_position(view,
-		                     view->box.x + (roots_surface->saved_geometry.x - geometry.x) * view->scale,
-		                     view->box.y + (roots_surface->saved_geometry.y - geometry.y) * view->scale);
-	}
+	phoc_xdg_surface_get_geometry (roots_surface, &geometry);
+	x += (roots_surface->saved_geometry.x - geometry.x) * view->scale;
+	y += (roots_surface->saved_geometry.y - geometry.y) * view->scale;
 	roots_surface->saved_geometry = geometry;
+
+	/* A geometry change damages the old and new area as a whole
+	 * which covers the buffer damage as well */
+	if (view->box.x == (int)x && view->box.y == (int)y &&
+	    view->box.width == size.width && view->box.height == size.height) {
+		phoc_view_apply_damage(view);
+	} else {
+		view_update_geometry(view, x, y, size.width, size.height, moved);
+	}
+
+	if (roots_surface->pending_move_resize_configure_serial == 0) {
+		phoc_view_layout_committed(view);
+	}
 }
 
 static void handle_new_popup(struct wl_listener *listener, void *data) {
@@ -141,14 +141,12 @@ static void handle_surface_commit(struct wl_listener *listener, void *data) {
 	PhocView *view = &phoc_surface->view;
 	struct wlr_surface *wlr_surface = view->wlr_surface;
 
-	phoc_view_apply_damage(view);
-
 	int width = wlr_surface->current.width;
 	int height = wlr_surface->current.height;
-	view_update_size(view, width, height);
 
 	double x = view->box.x;
 	double y = view->box.y;
+	bool moved = view->pending_move_resize.update_x || view->pending_move_resize.update_y;
 	if (view->pending_move_resize.update_x) {
 		if (view_is_floating (view)) {
 			x = view->pending_move_resize.x + view->pending_move_resize.width -
@@ -167,7 +165,16 @@ static void handle_surface_commit(struct wl_listener *listener, void *data) {
 		}
 		view->pending_move_resize.update_y = false;
 	}
-	view_update_position(view, x, y);
+
+	/* A geometry change damages the old and new area as a whole
+	 * which covers the buffer damage as well */
+	if (view->box.x == (int)x && view->box.y == (int)y &&
+	    view->box.width == width && view->box.height == height) {
+		phoc_view_apply_damage(view);
+		return;
+	}
+
+	view_update_geometry(view, x, y, width, height, moved);
 }
 
 static void handle_map(struct wl_listener *listener, void *data) {
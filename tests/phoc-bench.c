@@ -0,0 +1,619 @@
+/*
+ * Copyright (C) 2022 Purism SPC
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+/*
+ * phoc-bench: Run phoc on the headless backend and drive it with
+ * scripted synthetic clients. For each scenario frame time, cpu time
+ * per frame, heap growth and commit to frame callback latency are
+ * recorded along with the damaged area per frame and appended as a
+ * JSON object to $PHOC_BENCH_OUTPUT (default: phoc-bench.json).
+ *
+ * Each scenario runs for $PHOC_BENCH_FRAMES ticks (default: 300) but
+ * at most $PHOC_BENCH_DURATION seconds (default: 5) so low rate
+ * scenarios like idle don't take minutes.
+ */
+
+#include "testlib.h"
+#include "testlib-layer-shell.h"
+
+#include <errno.h>
+#include <malloc.h>
+#include <poll.h>
+#include <stdio.h>
+#include <time.h>
+
+#define BENCH_DEFAULT_FRAMES 300
+#define BENCH_DEFAULT_DURATION 5 /* s */
+#define BENCH_DEFAULT_OUTPUT "phoc-bench.json"
+#define BENCH_TOPLEVEL_TITLE "phoc-bench-%u"
+#define BENCH_PANEL_HEIGHT 32
+#define BENCH_THUMBNAIL_SIZE 200
+
+typedef struct _PhocBenchScenario {
+  const char *name;
+  guint       n_toplevels;
+  guint       n_panels;
+  guint       rate;          /* commits per second and surface */
+  gboolean    pointer;       /* stream virtual pointer motion */
+  gboolean    thumbnails;    /* request thumbnails of all toplevels every tick */
+  guint       flood;         /* extra requests per tick from the first toplevel */
+  gboolean    resize;        /* toplevels alternate between two buffer sizes */
+} PhocBenchScenario;
+
+typedef struct _PhocBenchStats {
+  /* Compositor side, only accessed from the main thread */
+  GArray   *frame_time;      /* µs between render-start and render-end */
+  GArray   *frame_cpu;       /* µs of main thread cpu time for the same span */
+  GArray   *damage_area;     /* damaged output pixels per frame */
+  gint64    render_start;
+  gint64    render_start_cpu;
+  gsize     heap_start;
+  gsize     heap_peak;
+  gssize    heap_delta;
+
+  /* Client side, only accessed from the client thread */
+  GArray   *latency;         /* µs between commit and frame callback */
+  GArray   *thumbnail_latency;
+  guint     commits;
+  guint     pointer_events;
+  guint64   software_cursor_frames;
+} PhocBenchStats;
+
+typedef struct _PhocBenchRun {
+  const PhocBenchScenario *scenario;
+  PhocBenchStats           stats;
+  guint                    frames;
+  char                    *renderer;
+} PhocBenchRun;
+
+typedef struct _PhocBenchSurface {
+  struct wl_surface   *wl_surface;
+  PhocTestBuffer      *buffer;
+  struct wl_callback  *frame_callback;
+  gint64               commit_time;
+  PhocBenchStats      *stats;
+} PhocBenchSurface;
+
+typedef struct _PhocBenchToplevel {
+  PhocBenchSurface         surface;
+  struct xdg_surface      *xdg_surface;
+  struct xdg_toplevel     *xdg_toplevel;
+  PhocTestForeignToplevel *foreign_toplevel;
+  PhocTestBuffer           buffer;
+  PhocTestBuffer           resize_buffer;
+  char                    *title;
+  guint32                  width, height;
+  gboolean                 configured;
+} PhocBenchToplevel;
+
+
+static gint64
+bench_get_thread_cpu_time (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_THREAD_CPUTIME_ID, &ts);
+  return ts.tv_sec * G_USEC_PER_SEC + ts.tv_nsec / 1000;
+}
+
+
+static gsize
+bench_get_heap_in_use (void)
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+  struct mallinfo2 info = mallinfo2 ();
+
+  return info.uordblks + info.hblkhd;
+#else
+  return 0;
+#endif
+}
+
+
+static void
+on_render_start (PhocBenchStats *stats, PhocOutput *output)
+{
+  pixman_box32_t *rects;
+  gint64 area = 0;
+  int n_rects;
+
+  rects = pixman_region32_rectangles (&output->damage->current, &n_rects);
+  for (int i = 0; i < n_rects; i++)
+    area += (gint64)(rects[i].x2 - rects[i].x1) * (rects[i].y2 - rects[i].y1);
+  g_array_append_val (stats->damage_area, area);
+
+  stats->render_start = g_get_monotonic_time ();
+  stats->render_start_cpu = bench_get_thread_cpu_time ();
+}
+
+
+static void
+on_render_end (PhocBenchStats *stats, PhocOutput *output)
+{
+  gint64 wall, cpu;
+  gsize heap;
+
+  if (stats->render_start == 0)
+    return;
+
+  wall = g_get_monotonic_time () - stats->render_start;
+  cpu = bench_get_thread_cpu_time () - stats->render_start_cpu;
+  g_array_append_val (stats->frame_time, wall);
+  g_array_append_val (stats->frame_cpu, cpu);
+  stats->render_start = 0;
+  stats->software_cursor_frames = output->software_cursor.frames;
+
+  heap = bench_get_heap_in_use ();
+  stats->heap_peak = MAX (stats->heap_peak, heap);
+  stats->heap_delta = heap - stats->heap_start;
+}
+
+
+static gboolean
+bench_server_prepare (PhocServer *server, gpointer data)
+{
+  PhocBenchRun *run = data;
+  PhocRenderer *renderer = phoc_server_get_renderer (server);
+
+  run->renderer = g_strdup (phoc_renderer_get_name (renderer));
+  run->stats.heap_start = bench_get_heap_in_use ();
+  run->stats.heap_peak = run->stats.heap_start;
+
+  g_signal_connect_swapped (renderer, "render-start", G_CALLBACK (on_render_start), &run->stats);
+  g_signal_connect_swapped (renderer, "render-end", G_CALLBACK (on_render_end), &run->stats);
+
+  return TRUE;
+}
+
+/* Client side */
+
+static void
+bench_dispatch_until (PhocTestClientGlobals *globals, gint64 deadline)
+{
+  struct pollfd pfd = {
+    .fd = wl_display_get_fd (globals->display),
+    .events = POLLIN,
+  };
+
+  while (TRUE) {
+    gint64 now = g_get_monotonic_time ();
+    int ret;
+
+    if (now >= deadline)
+      break;
+
+    while (wl_display_prepare_read (globals->display) != 0)
+      wl_display_dispatch_pending (globals->display);
+    wl_display_flush (globals->display);
+
+    ret = poll (&pfd, 1, MAX ((deadline - now) / 1000, 1));
+    if (ret > 0) {
+      wl_display_read_events (globals->display);
+      wl_display_dispatch_pending (globals->display);
+    } else {
+      wl_display_cancel_read (globals->display);
+    }
+  }
+}
+
+
+static void
+bench_surface_handle_frame_done (void *data, struct wl_callback *callback, uint32_t time)
+{
+  PhocBenchSurface *surface = data;
+  gint64 latency = g_get_monotonic_time () - surface->commit_time;
+
+  g_array_append_val (surface->stats->latency, latency);
+  wl_callback_destroy (callback);
+  surface->frame_callback = NULL;
+}
+
+static const struct wl_callback_listener bench_frame_listener = {
+  .done = bench_surface_handle_frame_done,
+};
+
+
+static void
+bench_surface_commit (PhocBenchSurface *surface, guint frame)
+{
+  PhocTestBuffer *buffer = surface->buffer;
+  guint32 color = 0xFF000000 | (frame * 0x010203);
+
+  /* Client didn't get the last frame yet, skip like a real client would */
+  if (surface->frame_callback)
+    return;
+
+  for (int i = 0; i < buffer->height * buffer->stride; i += 4)
+    *(guint32 *)(buffer->shm_data + i) = color;
+
+  wl_surface_attach (surface->wl_surface, buffer->wl_buffer, 0, 0);
+  wl_surface_damage (surface->wl_surface, 0, 0, buffer->width, buffer->height);
+  surface->frame_callback = wl_surface_frame (surface->wl_surface);
+  wl_callback_add_listener (surface->frame_callback, &bench_frame_listener, surface);
+  surface->commit_time = g_get_monotonic_time ();
+  wl_surface_commit (surface->wl_surface);
+  surface->stats->commits++;
+}
+
+
+static void
+bench_surface_clear (PhocBenchSurface *surface)
+{
+  g_clear_pointer (&surface->frame_callback, wl_callback_destroy);
+}
+
+
+static void
+xdg_surface_handle_configure (void *data, struct xdg_surface *xdg_surface, uint32_t serial)
+{
+  PhocBenchToplevel *toplevel = data;
+
+  xdg_surface_ack_configure (xdg_surface, serial);
+  toplevel->configured = TRUE;
+}
+
+static const struct xdg_surface_listener xdg_surface_listener = {
+  xdg_surface_handle_configure,
+};
+
+
+static void
+xdg_toplevel_handle_configure (void *data, struct xdg_toplevel *xdg_toplevel,
+                               int32_t width, int32_t height, struct wl_array *states)
+{
+  PhocBenchToplevel *toplevel = data;
+
+  toplevel->width = width ?: 320;
+  toplevel->height = height ?: 240;
+}
+
+
+static void
+xdg_toplevel_handle_close (void *data, struct xdg_toplevel *xdg_toplevel)
+{
+}
+
+static const struct xdg_toplevel_listener xdg_toplevel_listener = {
+  xdg_toplevel_handle_configure,
+  xdg_toplevel_handle_close,
+};
+
+
+static PhocBenchToplevel *
+bench_toplevel_new (PhocTestClientGlobals *globals, PhocBenchStats *stats, guint num, gboolean resize)
+{
+  PhocBenchToplevel *toplevel = g_new0 (PhocBenchToplevel, 1);
+
+  toplevel->title = g_strdup_printf (BENCH_TOPLEVEL_TITLE, num);
+  toplevel->surface.stats = stats;
+  toplevel->surface.buffer = &toplevel->buffer;
+  toplevel->surface.wl_surface = wl_compositor_create_surface (globals->compositor);
+  toplevel->xdg_surface = xdg_wm_base_get_xdg_surface (globals->xdg_shell,
+                                                       toplevel->surface.wl_surface);
+  xdg_surface_add_listener (toplevel->xdg_surface, &xdg_surface_listener, toplevel);
+  toplevel->xdg_toplevel = xdg_surface_get_toplevel (toplevel->xdg_surface);
+  xdg_toplevel_add_listener (toplevel->xdg_toplevel, &xdg_toplevel_listener, toplevel);
+  xdg_toplevel_set_title (toplevel->xdg_toplevel, toplevel->title);
+  wl_surface_commit (toplevel->surface.wl_surface);
+  wl_display_roundtrip (globals->display);
+  g_assert_true (toplevel->configured);
+
+  phoc_test_client_create_shm_buffer (globals, &toplevel->buffer,
+                                      toplevel->width, toplevel->height,
+                                      WL_SHM_FORMAT_XRGB8888);
+  if (resize) {
+    phoc_test_client_create_shm_buffer (globals, &toplevel->resize_buffer,
+                                        toplevel->width * 3 / 4, toplevel->height * 3 / 4,
+                                        WL_SHM_FORMAT_XRGB8888);
+  }
+  bench_surface_commit (&toplevel->surface, 0);
+  wl_display_roundtrip (globals->display);
+
+  toplevel->foreign_toplevel = phoc_test_client_get_foreign_toplevel_handle (globals,
+                                                                             toplevel->title);
+  return toplevel;
+}
+
+
+static void
+bench_toplevel_free (PhocBenchToplevel *toplevel)
+{
+  bench_surface_clear (&toplevel->surface);
+  xdg_toplevel_destroy (toplevel->xdg_toplevel);
+  xdg_surface_destroy (toplevel->xdg_surface);
+  wl_surface_destroy (toplevel->surface.wl_surface);
+  phoc_test_buffer_free (&toplevel->buffer);
+  if (toplevel->resize_buffer.wl_buffer)
+    phoc_test_buffer_free (&toplevel->resize_buffer);
+  g_free (toplevel->title);
+  g_free (toplevel);
+}
+
+
+static void
+bench_request_thumbnail (PhocTestClientGlobals *globals,
+                         PhocBenchToplevel     *toplevel,
+                         PhocBenchStats        *stats)
+{
+  PhocTestScreencopyFrame frame = { 0 };
+  struct zwlr_screencopy_frame_v1 *handle;
+  gint64 start, latency;
+
+  if (toplevel->foreign_toplevel == NULL)
+    return;
+
+  start = g_get_monotonic_time ();
+  handle = phosh_private_get_thumbnail (globals->phosh,
+                                        toplevel->foreign_toplevel->handle,
+                                        BENCH_THUMBNAIL_SIZE,
+                                        BENCH_THUMBNAIL_SIZE);
+  phoc_test_client_capture_frame (globals, &frame, handle);
+  latency = g_get_monotonic_time () - start;
+  g_array_append_val (stats->thumbnail_latency, latency);
+
+  phoc_test_buffer_free (&frame.buffer);
+  zwlr_screencopy_frame_v1_destroy (handle);
+}
+
+
+static void
+bench_move_pointer (struct zwlr_virtual_pointer_v1 *pointer,
+                    PhocTestClientGlobals          *globals,
+                    guint                           frame,
+                    PhocBenchStats                 *stats)
+{
+  guint32 width = globals->output.width, height = globals->output.height;
+  guint32 time = g_get_monotonic_time () / 1000;
+
+  /* Several motion events per frame like a high rate mouse would send */
+  for (int i = 0; i < 4; i++) {
+    guint32 x = (frame * 4 + i) * 7 % width;
+    guint32 y = (frame * 4 + i) * 5 % height;
+
+    zwlr_virtual_pointer_v1_motion_absolute (pointer, time, x, y, width, height);
+    zwlr_virtual_pointer_v1_frame (pointer);
+    stats->pointer_events++;
+  }
+}
+
+
+static void
+bench_flood (PhocBenchToplevel *toplevel, guint n_requests)
+{
+  /* Cheap requests the compositor has to process nevertheless. Keep it
+   * below the size of the wire buffer as we only flush once per tick. */
+  for (guint i = 0; i < n_requests; i++)
+    wl_surface_damage_buffer (toplevel->surface.wl_surface, 0, 0, 1, 1);
+}
+
+
+static gboolean
+bench_client_run (PhocTestClientGlobals *globals, gpointer data)
+{
+  PhocBenchRun *run = data;
+  const PhocBenchScenario *scenario = run->scenario;
+  PhocBenchStats *stats = &run->stats;
+  g_autoptr (GPtrArray) toplevels = g_ptr_array_new_with_free_func ((GDestroyNotify)bench_toplevel_free);
+  g_autoptr (GPtrArray) panels = g_ptr_array_new_with_free_func ((GDestroyNotify)phoc_test_layer_surface_free);
+  g_autofree PhocBenchSurface *panel_surfaces = g_new0 (PhocBenchSurface, scenario->n_panels);
+  struct zwlr_virtual_pointer_v1 *pointer = NULL;
+  gint64 interval, deadline;
+
+  for (guint i = 0; i < scenario->n_toplevels; i++)
+    g_ptr_array_add (toplevels, bench_toplevel_new (globals, stats, i, scenario->resize));
+
+  for (guint i = 0; i < scenario->n_panels; i++) {
+    guint32 anchor = ZWLR_LAYER_SURFACE_V1_ANCHOR_LEFT | ZWLR_LAYER_SURFACE_V1_ANCHOR_RIGHT;
+    PhocTestLayerSurface *panel;
+
+    anchor |= (i % 2) ? ZWLR_LAYER_SURFACE_V1_ANCHOR_BOTTOM : ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP;
+    panel = phoc_test_layer_surface_new (globals, 0, BENCH_PANEL_HEIGHT, 0xFF202020,
+                                         anchor, BENCH_PANEL_HEIGHT);
+    g_ptr_array_add (panels, panel);
+    panel_surfaces[i].wl_surface = panel->wl_surface;
+    panel_surfaces[i].buffer = &panel->buffer;
+    panel_surfaces[i].stats = stats;
+  }
+
+  if (scenario->pointer) {
+    g_assert_nonnull (globals->virtual_pointer_manager);
+    pointer = zwlr_virtual_pointer_manager_v1_create_virtual_pointer (globals->virtual_pointer_manager,
+                                                                      NULL);
+  }
+
+  /* Only measure the steady state */
+  wl_display_roundtrip (globals->display);
+  g_array_set_size (stats->latency, 0);
+  stats->commits = 0;
+
+  interval = G_USEC_PER_SEC / scenario->rate;
+  deadline = g_get_monotonic_time ();
+  for (guint frame = 1; frame <= run->frames; frame++) {
+    if (scenario->flood && toplevels->len)
+      bench_flood (g_ptr_array_index (toplevels, 0), scenario->flood);
+
+    for (guint i = 0; i < toplevels->len; i++) {
+      PhocBenchToplevel *toplevel = g_ptr_array_index (toplevels, i);
+
+      /* Every commit changes the view's size */
+      if (scenario->resize)
+        toplevel->surface.buffer = (frame % 2) ? &toplevel->resize_buffer : &toplevel->buffer;
+
+      bench_surface_commit (&toplevel->surface, frame);
+    }
+
+    for (guint i = 0; i < scenario->n_panels; i++)
+      bench_surface_commit (&panel_surfaces[i], frame);
+
+    if (pointer)
+      bench_move_pointer (pointer, globals, frame, stats);
+
+    if (scenario->thumbnails) {
+      for (guint i = 0; i < toplevels->len; i++)
+        bench_request_thumbnail (globals, g_ptr_array_index (toplevels, i), stats);
+    }
+
+    deadline += interval;
+    bench_dispatch_until (globals, deadline);
+  }
+
+  /* Give outstanding frame callbacks a chance to arrive */
+  bench_dispatch_until (globals, g_get_monotonic_time () + G_USEC_PER_SEC / 10);
+
+  for (guint i = 0; i < scenario->n_panels; i++)
+    bench_surface_clear (&panel_surfaces[i]);
+  g_clear_pointer (&pointer, zwlr_virtual_pointer_v1_destroy);
+  wl_display_roundtrip (globals->display);
+
+  return TRUE;
+}
+
+/* Reporting */
+
+static int
+compare_gint64 (gconstpointer a, gconstpointer b)
+{
+  gint64 l = *(const gint64 *)a, r = *(const gint64 *)b;
+
+  return (l > r) - (l < r);
+}
+
+
+static void
+bench_append_distribution (GString *json, const char *name, GArray *values)
+{
+  gint64 sum = 0;
+
+  g_string_append_printf (json, ", \"%s\": {\"count\": %u", name, values->len);
+  if (values->len) {
+    g_array_sort (values, compare_gint64);
+    for (guint i = 0; i < values->len; i++)
+      sum += g_array_index (values, gint64, i);
+
+    g_string_append_printf (json,
+                            ", \"mean\": %" G_GINT64_FORMAT
+                            ", \"p50\": %" G_GINT64_FORMAT
+                            ", \"p95\": %" G_GINT64_FORMAT
+                            ", \"max\": %" G_GINT64_FORMAT,
+                            sum / values->len,
+                            g_array_index (values, gint64, values->len / 2),
+                            g_array_index (values, gint64, values->len * 95 / 100),
+                            g_array_index (values, gint64, values->len - 1));
+  }
+  g_string_append (json, "}");
+}
+
+
+static void
+bench_report (PhocBenchRun *run)
+{
+  const PhocBenchScenario *scenario = run->scenario;
+  PhocBenchStats *stats = &run->stats;
+  g_autoptr (GString) json = g_string_new (NULL);
+  const char *path = g_getenv ("PHOC_BENCH_OUTPUT") ?: BENCH_DEFAULT_OUTPUT;
+  FILE *out;
+
+  g_string_append_printf (json,
+                          "{\"scenario\": \"%s\", \"renderer\": \"%s\", "
+                          "\"toplevels\": %u, \"panels\": %u, \"rate\": %u, "
+                          "\"commits\": %u, \"pointer_events\": %u, "
+                          "\"software_cursor_frames\": %" G_GUINT64_FORMAT ", "
+                          "\"heap_delta_bytes\": %" G_GSSIZE_FORMAT ", "
+                          "\"heap_peak_bytes\": %" G_GSIZE_FORMAT,
+                          scenario->name,
+                          run->renderer ?: "unknown",
+                          scenario->n_toplevels,
+                          scenario->n_panels,
+                          scenario->rate,
+                          stats->commits,
+                          stats->pointer_events,
+                          stats->software_cursor_frames,
+                          stats->heap_delta,
+                          stats->heap_peak);
+  bench_append_distribution (json, "frame_time_us", stats->frame_time);
+  bench_append_distribution (json, "frame_cpu_us", stats->frame_cpu);
+  bench_append_distribution (json, "damage_px", stats->damage_area);
+  bench_append_distribution (json, "latency_us", stats->latency);
+  bench_append_distribution (json, "thumbnail_latency_us", stats->thumbnail_latency);
+  g_string_append (json, "}\n");
+
+  g_test_message ("%s", json->str);
+
+  out = fopen (path, "a");
+  if (out == NULL) {
+    g_warning ("Failed to open %s: %s", path, g_strerror (errno));
+    return;
+  }
+  fputs (json->str, out);
+  fclose (out);
+}
+
+
+static void
+bench_run_scenario (gconstpointer data)
+{
+  const PhocBenchScenario *scenario = data;
+  PhocTestClientIface iface = {
+    .server_prepare = bench_server_prepare,
+    .client_run = bench_client_run,
+  };
+  const char *frames_env = g_getenv ("PHOC_BENCH_FRAMES");
+  const char *duration_env = g_getenv ("PHOC_BENCH_DURATION");
+  guint64 duration = duration_env ? g_ascii_strtoull (duration_env, NULL, 10) : BENCH_DEFAULT_DURATION;
+  PhocBenchRun run = {
+    .scenario = scenario,
+    .frames = frames_env ? g_ascii_strtoull (frames_env, NULL, 10) : BENCH_DEFAULT_FRAMES,
+    .stats = {
+      .frame_time = g_array_new (FALSE, FALSE, sizeof (gint64)),
+      .frame_cpu = g_array_new (FALSE, FALSE, sizeof (gint64)),
+      .damage_area = g_array_new (FALSE, FALSE, sizeof (gint64)),
+      .latency = g_array_new (FALSE, FALSE, sizeof (gint64)),
+      .thumbnail_latency = g_array_new (FALSE, FALSE, sizeof (gint64)),
+    },
+  };
+
+  run.frames = MAX (MIN (run.frames, duration * scenario->rate), 1);
+  phoc_test_client_run (run.frames / scenario->rate + 10, &iface, &run);
+  bench_report (&run);
+
+  g_array_unref (run.stats.frame_time);
+  g_array_unref (run.stats.frame_cpu);
+  g_array_unref (run.stats.damage_area);
+  g_array_unref (run.stats.latency);
+  g_array_unref (run.stats.thumbnail_latency);
+  g_free (run.renderer);
+}
+
+
+static const PhocBenchScenario scenarios[] = {
+  { .name = "idle",       .n_toplevels = 0, .n_panels = 2, .rate = 1 },
+  { .name = "toplevels",  .n_toplevels = 4, .n_panels = 0, .rate = 60 },
+  { .name = "panels",     .n_toplevels = 1, .n_panels = 2, .rate = 60 },
+  { .name = "pointer",    .n_toplevels = 1, .n_panels = 2, .rate = 60, .pointer = TRUE },
+  { .name = "thumbnails", .n_toplevels = 4, .n_panels = 0, .rate = 10, .thumbnails = TRUE },
+  { .name = "flood",      .n_toplevels = 2, .n_panels = 1, .rate = 60, .pointer = TRUE, .flood = 128 },
+  { .name = "resize",     .n_toplevels = 1, .n_panels = 0, .rate = 60, .resize = TRUE },
+};
+
+
+gint
+main (gint argc, gchar *argv[])
+{
+  /* Default to headless and software rendering, allow to override from the environment */
+  g_setenv ("WLR_BACKENDS", "headless", TRUE);
+  g_setenv ("WLR_HEADLESS_OUTPUTS", "1", FALSE);
+  g_setenv ("PHOC_RENDERER", "pixman", FALSE);
+  g_setenv ("WLR_RENDERER_ALLOW_SOFTWARE", "1", FALSE);
+
+  g_test_init (&argc, &argv, NULL);
+
+  for (guint i = 0; i < G_N_ELEMENTS (scenarios); i++) {
+    g_autofree char *path = g_strdup_printf ("/phoc/bench/%s", scenarios[i].name);
+
+    g_test_add_data_func (path, &scenarios[i], bench_run_scenario);
+  }
+
+  return g_test_run ();
+}
@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2022 Purism SPC
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+#include "server.h"
+
+static void
+flush_main_context (void)
+{
+  while (g_main_context_iteration (NULL, FALSE))
+    ;
+}
+
+static void
+test_phoc_desktop_settings_propagate (void)
+{
+  g_autoptr(PhocServer) server = phoc_server_get_default ();
+  g_autoptr(GSettings) settings = g_settings_new ("sm.puri.phoc");
+  PhocDesktop *desktop;
+
+  g_assert_true (PHOC_IS_SERVER (server));
+  g_assert_true (phoc_server_setup(server, TEST_PHOC_INI, NULL, NULL,
+                                   PHOC_SERVER_FLAG_NONE,
+                                   PHOC_SERVER_DEBUG_FLAG_NONE));
+  desktop = server->desktop;
+  g_assert_true (PHOC_IS_DESKTOP (desktop));
+
+  /* Initial values are picked up */
+  g_assert_cmpint (phoc_desktop_get_scale_to_fit (desktop), ==,
+                   g_settings_get_boolean (settings, "scale-to-fit"));
+  g_assert_cmpint (phoc_desktop_get_auto_maximize (desktop), ==,
+                   g_settings_get_boolean (settings, "auto-maximize"));
+
+  /* Changes end up in the cached values */
+  g_settings_set_boolean (settings, "scale-to-fit", TRUE);
+  flush_main_context ();
+  g_assert_true (phoc_desktop_get_scale_to_fit (desktop));
+
+  g_settings_set_boolean (settings, "scale-to-fit", FALSE);
+  flush_main_context ();
+  g_assert_false (phoc_desktop_get_scale_to_fit (desktop));
+
+  g_settings_set_boolean (settings, "auto-maximize", FALSE);
+  flush_main_context ();
+  g_assert_false (phoc_desktop_get_auto_maximize (desktop));
+
+  g_settings_set_boolean (settings, "auto-maximize", TRUE);
+  flush_main_context ();
+  g_assert_true (phoc_desktop_get_auto_maximize (desktop));
+
+  g_settings_reset (settings, "scale-to-fit");
+  g_settings_reset (settings, "auto-maximize");
+}
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func("/phoc/desktop/settings-propagate", test_phoc_desktop_settings_propagate);
+
+  return g_test_run();
+}
@@ -0,0 +1,205 @@
+/*
+ * Copyright (C) 2022 Purism SPC
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+#include "testlib.h"
+
+#define WIDTH 100
+#define HEIGHT 200
+
+typedef struct _PhocTestFractionalScale {
+  struct wl_surface *wl_surface;
+  struct xdg_surface *xdg_surface;
+  struct xdg_toplevel *xdg_toplevel;
+  struct wp_fractional_scale_v1 *fractional_scale;
+  PhocTestBuffer buffer;
+  gboolean configured;
+  guint32 preferred_scale;
+  guint n_preferred_scale;
+} PhocTestFractionalScale;
+
+
+static void
+xdg_surface_handle_configure (void *data, struct xdg_surface *xdg_surface, uint32_t serial)
+{
+  PhocTestFractionalScale *fs = data;
+
+  xdg_surface_ack_configure (fs->xdg_surface, serial);
+  fs->configured = TRUE;
+}
+
+static const struct xdg_surface_listener xdg_surface_listener = {
+  xdg_surface_handle_configure,
+};
+
+
+static void
+xdg_toplevel_handle_configure (void *data, struct xdg_toplevel *xdg_toplevel,
+                               int32_t width, int32_t height, struct wl_array *states)
+{
+}
+
+static void
+xdg_toplevel_handle_close (void *data, struct xdg_toplevel *xdg_toplevel)
+{
+}
+
+static const struct xdg_toplevel_listener xdg_toplevel_listener = {
+  xdg_toplevel_handle_configure,
+  xdg_toplevel_handle_close,
+};
+
+
+static void
+fractional_scale_handle_preferred_scale (void *data,
+                                         struct wp_fractional_scale_v1 *fractional_scale,
+                                         uint32_t scale)
+{
+  PhocTestFractionalScale *fs = data;
+
+  fs->preferred_scale = scale;
+  fs->n_preferred_scale++;
+}
+
+static const struct wp_fractional_scale_v1_listener fractional_scale_listener = {
+  .preferred_scale = fractional_scale_handle_preferred_scale,
+};
+
+
+static PhocTestFractionalScale *
+phoc_test_fractional_scale_new (PhocTestClientGlobals *globals)
+{
+  PhocTestFractionalScale *fs = g_new0 (PhocTestFractionalScale, 1);
+
+  g_assert_nonnull (globals->fractional_scale_manager);
+
+  fs->wl_surface = wl_compositor_create_surface (globals->compositor);
+  fs->fractional_scale =
+    wp_fractional_scale_manager_v1_get_fractional_scale (globals->fractional_scale_manager,
+                                                         fs->wl_surface);
+  wp_fractional_scale_v1_add_listener (fs->fractional_scale, &fractional_scale_listener, fs);
+
+  fs->xdg_surface = xdg_wm_base_get_xdg_surface (globals->xdg_shell, fs->wl_surface);
+  xdg_surface_add_listener (fs->xdg_surface, &xdg_surface_listener, fs);
+  fs->xdg_toplevel = xdg_surface_get_toplevel (fs->xdg_surface);
+  xdg_toplevel_add_listener (fs->xdg_toplevel, &xdg_toplevel_listener, fs);
+  wl_surface_commit (fs->wl_surface);
+  while (!fs->configured)
+    wl_display_dispatch (globals->display);
+
+  return fs;
+}
+
+
+static void
+phoc_test_fractional_scale_map (PhocTestClientGlobals *globals, PhocTestFractionalScale *fs)
+{
+  phoc_test_client_create_shm_buffer (globals, &fs->buffer, WIDTH, HEIGHT, WL_SHM_FORMAT_XRGB8888);
+  wl_surface_attach (fs->wl_surface, fs->buffer.wl_buffer, 0, 0);
+  wl_surface_damage (fs->wl_surface, 0, 0, G_MAXINT32, G_MAXINT32);
+  wl_surface_commit (fs->wl_surface);
+  wl_display_roundtrip (globals->display);
+}
+
+
+static void
+phoc_test_fractional_scale_free (PhocTestFractionalScale *fs)
+{
+  wp_fractional_scale_v1_destroy (fs->fractional_scale);
+  xdg_toplevel_destroy (fs->xdg_toplevel);
+  xdg_surface_destroy (fs->xdg_surface);
+  wl_surface_destroy (fs->wl_surface);
+  phoc_test_buffer_free (&fs->buffer);
+  g_free (fs);
+}
+
+
+static gboolean
+test_client_fractional_scale_preferred (PhocTestClientGlobals *globals, gpointer data)
+{
+  PhocTestFractionalScale *fs = phoc_test_fractional_scale_new (globals);
+
+  /* Not on any output yet */
+  g_assert_cmpint (fs->n_preferred_scale, ==, 0);
+
+  /* Mapping puts the surface on the (unscaled) output */
+  phoc_test_fractional_scale_map (globals, fs);
+  g_assert_cmpint (fs->n_preferred_scale, ==, 1);
+  g_assert_cmpint (fs->preferred_scale, ==, 120);
+
+  /* Unchanged scales aren't resent */
+  wl_surface_damage (fs->wl_surface, 0, 0, G_MAXINT32, G_MAXINT32);
+  wl_surface_commit (fs->wl_surface);
+  wl_display_roundtrip (globals->display);
+  g_assert_cmpint (fs->n_preferred_scale, ==, 1);
+
+  phoc_test_fractional_scale_free (fs);
+
+  return TRUE;
+}
+
+static void
+test_fractional_scale_preferred (void)
+{
+  PhocTestClientIface iface = {
+    .client_run = test_client_fractional_scale_preferred,
+  };
+
+  phoc_test_client_run (3, &iface, NULL);
+}
+
+
+static gboolean
+test_client_fractional_scale_non_integer (PhocTestClientGlobals *globals, gpointer data)
+{
+  PhocTestFractionalScale *fs = phoc_test_fractional_scale_new (globals);
+  guint32 scale = GPOINTER_TO_UINT (data);
+
+  phoc_test_fractional_scale_map (globals, fs);
+  g_assert_cmpint (fs->n_preferred_scale, ==, 1);
+  g_assert_cmpint (fs->preferred_scale, ==, scale);
+
+  phoc_test_fractional_scale_free (fs);
+
+  return TRUE;
+}
+
+static gboolean
+test_fractional_scale_non_integer_prepare (PhocServer *server, gpointer data)
+{
+  PhocOutput *output;
+
+  g_assert_false (wl_list_empty (&server->desktop->outputs));
+  output = wl_container_of (server->desktop->outputs.next, output, link);
+
+  wlr_output_set_scale (output->wlr_output, GPOINTER_TO_UINT (data) / 120.0);
+  g_assert_true (wlr_output_commit (output->wlr_output));
+
+  return TRUE;
+}
+
+static void
+test_fractional_scale_non_integer (gconstpointer data)
+{
+  PhocTestClientIface iface = {
+    .server_prepare = test_fractional_scale_non_integer_prepare,
+    .client_run     = test_client_fractional_scale_non_integer,
+  };
+
+  phoc_test_client_run (3, &iface, (gpointer) data);
+}
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/phoc/fractional-scale/preferred", test_fractional_scale_preferred);
+  g_test_add_data_func ("/phoc/fractional-scale/non-integer/150", GUINT_TO_POINTER (180),
+                        test_fractional_scale_non_integer);
+  g_test_add_data_func ("/phoc/fractional-scale/non-integer/175", GUINT_TO_POINTER (210),
+                        test_fractional_scale_non_integer);
+
+  return g_test_run ();
+}
@@ -0,0 +1,214 @@
+/*
+ * Copyright (C) 2022 Purism SPC
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+#include "testlib.h"
+
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+/* Keep in sync with PHOC_SEAT_ACTIVITY_INTERVAL */
+#define ACTIVITY_INTERVAL 250 /* ms */
+#define N_EVENTS 500
+
+typedef struct _IdleTestState {
+  gboolean idle;
+  gboolean resumed;
+  gint64   idle_ts;
+} IdleTestState;
+
+/* The idle timeout whose timerfd we count re-arms for */
+static gint watch_timeout;
+static gint watch_fd = -1;
+static gint n_rearms;
+
+/*
+ * Interpose libc's timerfd_settime so we see every time libwayland-server
+ * re-arms the idle timer. The timer is identified by its (unique) initial
+ * timeout.
+ */
+int
+timerfd_settime (int fd, int flags, const struct itimerspec *new_value, struct itimerspec *old_value)
+{
+  gint64 ms = new_value->it_value.tv_sec * 1000 + new_value->it_value.tv_nsec / 1000000;
+
+  if (g_atomic_int_get (&watch_fd) == fd)
+    g_atomic_int_inc (&n_rearms);
+  else if (ms && ms == g_atomic_int_get (&watch_timeout))
+    g_atomic_int_set (&watch_fd, fd);
+
+  return syscall (SYS_timerfd_settime, fd, flags, new_value, old_value);
+}
+
+
+static void
+watch_idle_timer (guint timeout)
+{
+  g_atomic_int_set (&watch_fd, -1);
+  g_atomic_int_set (&n_rearms, 0);
+  g_atomic_int_set (&watch_timeout, timeout);
+}
+
+
+static void
+idle_timeout_handle_idle (void *data, struct org_kde_kwin_idle_timeout *timeout)
+{
+  IdleTestState *state = data;
+
+  state->idle = TRUE;
+  state->idle_ts = g_get_monotonic_time ();
+}
+
+
+static void
+idle_timeout_handle_resumed (void *data, struct org_kde_kwin_idle_timeout *timeout)
+{
+  IdleTestState *state = data;
+
+  state->resumed = TRUE;
+}
+
+
+static const struct org_kde_kwin_idle_timeout_listener idle_timeout_listener = {
+  .idle = idle_timeout_handle_idle,
+  .resumed = idle_timeout_handle_resumed,
+};
+
+
+static struct org_kde_kwin_idle_timeout *
+create_idle_timeout (PhocTestClientGlobals *globals, guint timeout, IdleTestState *state)
+{
+  struct org_kde_kwin_idle_timeout *idle_timeout;
+
+  g_assert_nonnull (globals->idle);
+  idle_timeout = org_kde_kwin_idle_get_idle_timeout (globals->idle, globals->seat, timeout);
+  org_kde_kwin_idle_timeout_add_listener (idle_timeout, &idle_timeout_listener, state);
+
+  return idle_timeout;
+}
+
+/* Like a 1000Hz mouse */
+static void
+move_pointer (PhocTestClientGlobals *globals, struct zwlr_virtual_pointer_v1 *pointer, guint n)
+{
+  for (int i = 0; i < n; i++) {
+    zwlr_virtual_pointer_v1_motion (pointer, g_get_monotonic_time () / 1000,
+                                    wl_fixed_from_int (i % 2 ? 1 : -1), 0);
+    zwlr_virtual_pointer_v1_frame (pointer);
+    wl_display_flush (globals->display);
+    g_usleep (1000);
+  }
+  wl_display_roundtrip (globals->display);
+}
+
+
+static gboolean
+test_client_idle_rearm (PhocTestClientGlobals *globals, gpointer data)
+{
+  IdleTestState state = { 0 };
+  struct org_kde_kwin_idle_timeout *idle_timeout;
+  struct zwlr_virtual_pointer_v1 *pointer;
+  guint timeout = 123456;
+  gint64 start, elapsed;
+  gint rearms;
+
+  watch_idle_timer (timeout);
+  idle_timeout = create_idle_timeout (globals, timeout, &state);
+  pointer = zwlr_virtual_pointer_manager_v1_create_virtual_pointer (globals->virtual_pointer_manager,
+                                                                    NULL);
+  wl_display_roundtrip (globals->display);
+  g_assert_cmpint (g_atomic_int_get (&watch_fd), >=, 0);
+
+  start = g_get_monotonic_time ();
+  move_pointer (globals, pointer, N_EVENTS);
+  /* Let the last coalesced notification happen */
+  g_usleep (2 * ACTIVITY_INTERVAL * 1000);
+  wl_display_roundtrip (globals->display);
+  elapsed = (g_get_monotonic_time () - start) / 1000;
+
+  /*
+   * Without coalescing every motion and frame re-arms the timer. Now
+   * it's at most once per interval plus the leading notification.
+   */
+  rearms = g_atomic_int_get (&n_rearms);
+  g_test_message ("%d timer re-arms for %d events in %" G_GINT64_FORMAT "ms",
+                  rearms, 2 * N_EVENTS, elapsed);
+  g_assert_cmpint (rearms, >=, 1);
+  g_assert_cmpint (rearms, <=, elapsed / ACTIVITY_INTERVAL + 2);
+  g_assert_false (state.idle);
+
+  watch_idle_timer (0);
+  zwlr_virtual_pointer_v1_destroy (pointer);
+  org_kde_kwin_idle_timeout_release (idle_timeout);
+  wl_display_roundtrip (globals->display);
+
+  return TRUE;
+}
+
+
+static void
+test_idle_rearm (void)
+{
+  PhocTestClientIface iface = { .client_run = test_client_idle_rearm };
+
+  phoc_test_client_run (5, &iface, NULL);
+}
+
+
+static gboolean
+test_client_idle_exact (PhocTestClientGlobals *globals, gpointer data)
+{
+  IdleTestState state = { 0 };
+  struct org_kde_kwin_idle_timeout *idle_timeout;
+  struct zwlr_virtual_pointer_v1 *pointer;
+  guint timeout = 4 * ACTIVITY_INTERVAL;
+  gint64 last_activity;
+
+  idle_timeout = create_idle_timeout (globals, timeout, &state);
+  pointer = zwlr_virtual_pointer_manager_v1_create_virtual_pointer (globals->virtual_pointer_manager,
+                                                                    NULL);
+  wl_display_roundtrip (globals->display);
+
+  /* Coalesced activity must still count, deferred by at most one interval */
+  move_pointer (globals, pointer, 300);
+  last_activity = g_get_monotonic_time ();
+  while (!state.idle)
+    g_assert_cmpint (wl_display_dispatch (globals->display), >=, 0);
+  /* Not early since activity got dropped and not later than the interval */
+  g_assert_cmpint ((state.idle_ts - last_activity) / 1000, >=, timeout - ACTIVITY_INTERVAL / 10);
+  g_assert_cmpint ((state.idle_ts - last_activity) / 1000, <, timeout + 3 * ACTIVITY_INTERVAL / 2);
+
+  /* Resuming isn't delayed */
+  g_assert_false (state.resumed);
+  move_pointer (globals, pointer, 1);
+  g_assert_true (state.resumed);
+
+  zwlr_virtual_pointer_v1_destroy (pointer);
+  org_kde_kwin_idle_timeout_release (idle_timeout);
+  wl_display_roundtrip (globals->display);
+
+  return TRUE;
+}
+
+
+static void
+test_idle_exact (void)
+{
+  PhocTestClientIface iface = { .client_run = test_client_idle_exact };
+
+  phoc_test_client_run (5, &iface, NULL);
+}
+
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/phoc/idle/rearm", test_idle_rearm);
+  g_test_add_func ("/phoc/idle/exact", test_idle_exact);
+
+  return g_test_run ();
+}
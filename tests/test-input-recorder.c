@@ -0,0 +1,304 @@
+/*
+ * Copyright (C) 2022 Purism SPC
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+#include "input-replay.h"
+#include "server.h"
+
+#include <glib/gstdio.h>
+#include <linux/input-event-codes.h>
+#include <string.h>
+#include <unistd.h>
+#include <wlr/types/wlr_keyboard.h>
+#include <wlr/types/wlr_pointer.h>
+#include <wlr/types/wlr_switch.h>
+#include <wlr/types/wlr_touch.h>
+
+#define TIMEOUT (5 * G_USEC_PER_SEC)
+
+
+static char *
+get_tmp_file (void)
+{
+  g_autoptr(GError) err = NULL;
+  char *path = NULL;
+  int fd;
+
+  fd = g_file_open_tmp ("phoc-test-input-XXXXXX.rec", &path, &err);
+  g_assert_no_error (err);
+  close (fd);
+
+  return path;
+}
+
+/* A short session as it would come from a device */
+static guint
+write_trace (const char *path)
+{
+  g_autoptr(PhocInputRecorder) recorder = NULL;
+  g_autoptr(GError) err = NULL;
+  struct wlr_input_device pointer = { .type = WLR_INPUT_DEVICE_POINTER, .name = "test pointer" };
+  struct wlr_input_device touch = { .type = WLR_INPUT_DEVICE_TOUCH, .name = "test touch" };
+  struct wlr_input_device keyboard = { .type = WLR_INPUT_DEVICE_KEYBOARD, .name = "test keyboard" };
+  struct wlr_input_device tablet_mode = { .type = WLR_INPUT_DEVICE_SWITCH, .name = "test switch" };
+  guint32 t = 1000;
+
+  wl_signal_init (&pointer.events.destroy);
+  wl_signal_init (&touch.events.destroy);
+  wl_signal_init (&keyboard.events.destroy);
+  wl_signal_init (&tablet_mode.events.destroy);
+
+  recorder = phoc_input_recorder_new (path, &err);
+  g_assert_no_error (err);
+
+  for (int i = 0; i < 10; i++) {
+    struct wlr_event_pointer_motion motion = {
+      .device = &pointer, .time_msec = t += 8,
+      .delta_x = 3.5, .delta_y = -1.25, .unaccel_dx = 3, .unaccel_dy = -1,
+    };
+
+    phoc_input_recorder_record (recorder, PHOC_INPUT_RECORD_POINTER_MOTION, &pointer, &motion);
+    phoc_input_recorder_record (recorder, PHOC_INPUT_RECORD_POINTER_FRAME, NULL, NULL);
+  }
+
+  for (int state = WLR_BUTTON_PRESSED; state >= WLR_BUTTON_RELEASED; state--) {
+    struct wlr_event_pointer_button button = {
+      .device = &pointer, .time_msec = t += 40, .button = BTN_LEFT, .state = state,
+    };
+
+    phoc_input_recorder_record (recorder, PHOC_INPUT_RECORD_POINTER_BUTTON, &pointer, &button);
+    phoc_input_recorder_record (recorder, PHOC_INPUT_RECORD_POINTER_FRAME, NULL, NULL);
+  }
+
+  {
+    struct wlr_event_pointer_axis axis = {
+      .device = &pointer, .time_msec = t += 16, .source = WLR_AXIS_SOURCE_WHEEL,
+      .orientation = WLR_AXIS_ORIENTATION_VERTICAL, .delta = 15, .delta_discrete = 1,
+    };
+    struct wlr_event_touch_down down = {
+      .device = &touch, .time_msec = t += 100, .touch_id = 0, .x = 0.5, .y = 0.9,
+    };
+    struct wlr_event_touch_up up = { .device = &touch, .touch_id = 0 };
+
+    phoc_input_recorder_record (recorder, PHOC_INPUT_RECORD_POINTER_AXIS, &pointer, &axis);
+    phoc_input_recorder_record (recorder, PHOC_INPUT_RECORD_POINTER_FRAME, NULL, NULL);
+
+    phoc_input_recorder_record (recorder, PHOC_INPUT_RECORD_TOUCH_DOWN, &touch, &down);
+    phoc_input_recorder_record (recorder, PHOC_INPUT_RECORD_TOUCH_FRAME, NULL, NULL);
+    for (int i = 0; i < 10; i++) {
+      struct wlr_event_touch_motion motion = {
+        .device = &touch, .time_msec = t += 8, .touch_id = 0, .x = 0.5, .y = 0.9 - i * 0.05,
+      };
+
+      phoc_input_recorder_record (recorder, PHOC_INPUT_RECORD_TOUCH_MOTION, &touch, &motion);
+      phoc_input_recorder_record (recorder, PHOC_INPUT_RECORD_TOUCH_FRAME, NULL, NULL);
+    }
+    up.time_msec = t += 8;
+    phoc_input_recorder_record (recorder, PHOC_INPUT_RECORD_TOUCH_UP, &touch, &up);
+    phoc_input_recorder_record (recorder, PHOC_INPUT_RECORD_TOUCH_FRAME, NULL, NULL);
+  }
+
+  {
+    struct wlr_event_pointer_swipe_begin swipe_begin = {
+      .device = &pointer, .time_msec = t += 100, .fingers = 3,
+    };
+    struct wlr_event_pointer_swipe_end swipe_end = { .device = &pointer };
+    struct wlr_event_pointer_pinch_begin pinch_begin = { .device = &pointer, .fingers = 2 };
+    struct wlr_event_pointer_pinch_update pinch_update = {
+      .device = &pointer, .fingers = 2, .dx = 1.5, .dy = -2, .scale = 1.25, .rotation = 10,
+    };
+    struct wlr_event_pointer_pinch_end pinch_end = { .device = &pointer, .cancelled = true };
+
+    phoc_input_recorder_record (recorder, PHOC_INPUT_RECORD_SWIPE_BEGIN, &pointer, &swipe_begin);
+    for (int i = 0; i < 5; i++) {
+      struct wlr_event_pointer_swipe_update swipe_update = {
+        .device = &pointer, .time_msec = t += 8, .fingers = 3, .dx = 0, .dy = 12.5,
+      };
+
+      phoc_input_recorder_record (recorder, PHOC_INPUT_RECORD_SWIPE_UPDATE, &pointer, &swipe_update);
+    }
+    swipe_end.time_msec = t += 8;
+    phoc_input_recorder_record (recorder, PHOC_INPUT_RECORD_SWIPE_END, &pointer, &swipe_end);
+
+    pinch_begin.time_msec = t += 100;
+    phoc_input_recorder_record (recorder, PHOC_INPUT_RECORD_PINCH_BEGIN, &pointer, &pinch_begin);
+    pinch_update.time_msec = t += 8;
+    phoc_input_recorder_record (recorder, PHOC_INPUT_RECORD_PINCH_UPDATE, &pointer, &pinch_update);
+    pinch_end.time_msec = t += 8;
+    phoc_input_recorder_record (recorder, PHOC_INPUT_RECORD_PINCH_END, &pointer, &pinch_end);
+  }
+
+  for (int state = WLR_SWITCH_STATE_ON; state >= WLR_SWITCH_STATE_OFF; state--) {
+    struct wlr_event_switch_toggle toggle = {
+      .device = &tablet_mode, .time_msec = t += 50,
+      .switch_type = WLR_SWITCH_TYPE_TABLET_MODE, .switch_state = state,
+    };
+
+    phoc_input_recorder_record (recorder, PHOC_INPUT_RECORD_SWITCH_TOGGLE, &tablet_mode, &toggle);
+  }
+
+  for (int state = WL_KEYBOARD_KEY_STATE_PRESSED; state >= WL_KEYBOARD_KEY_STATE_RELEASED; state--) {
+    struct wlr_event_keyboard_key key = {
+      .time_msec = t += 50, .keycode = KEY_A, .state = state,
+    };
+
+    phoc_input_recorder_record (recorder, PHOC_INPUT_RECORD_KEY, &keyboard, &key);
+  }
+
+  return phoc_input_recorder_get_n_events (recorder);
+}
+
+/*
+ * Replaying a trace while recording must result in the very same
+ * recording since the replayed events go through the same handlers.
+ */
+static void
+test_phoc_input_recorder_roundtrip (void)
+{
+  g_autoptr(PhocServer) server = phoc_server_get_default ();
+  g_autoptr(PhocInputReplay) replay = NULL;
+  g_autoptr(GError) err = NULL;
+  g_autofree char *trace = get_tmp_file ();
+  g_autofree char *rerecorded = get_tmp_file ();
+  g_autofree char *expected = NULL, *contents = NULL;
+  gsize expected_len, len;
+  guint n_events;
+  PhocSeat *seat;
+  gint64 end;
+
+  n_events = write_trace (trace);
+  g_assert_cmpint (n_events, >, 0);
+
+  g_assert_true (phoc_server_setup (server, TEST_PHOC_INI, NULL, NULL,
+                                    PHOC_SERVER_FLAG_NONE,
+                                    PHOC_SERVER_DEBUG_FLAG_NONE));
+  seat = phoc_input_get_seat (server->input, PHOC_CONFIG_DEFAULT_SEAT_NAME);
+
+  replay = phoc_input_replay_new (trace, &err);
+  g_assert_no_error (err);
+  g_assert_true (phoc_input_start_recording (server->input, rerecorded, &err));
+  g_assert_no_error (err);
+
+  phoc_input_replay_start (replay, seat, 0);
+  end = g_get_monotonic_time () + TIMEOUT;
+  while (!phoc_input_replay_is_done (replay) && g_get_monotonic_time () < end)
+    g_main_context_iteration (NULL, FALSE);
+  g_assert_true (phoc_input_replay_is_done (replay));
+  g_assert_cmpint (phoc_input_replay_get_n_events (replay), ==, n_events);
+  phoc_input_stop_recording (server->input);
+
+  g_file_get_contents (trace, &expected, &expected_len, &err);
+  g_assert_no_error (err);
+  g_file_get_contents (rerecorded, &contents, &len, &err);
+  g_assert_no_error (err);
+  g_assert_cmpmem (contents, len, expected, expected_len);
+
+  g_unlink (trace);
+  g_unlink (rerecorded);
+}
+
+
+static void
+test_phoc_input_recorder_invalid (void)
+{
+  g_autoptr(PhocInputReplay) replay = NULL;
+  g_autoptr(GError) err = NULL;
+  g_autofree char *trace = get_tmp_file ();
+  g_autofree char *contents = NULL;
+  gsize len;
+
+  write_trace (trace);
+  g_file_get_contents (trace, &contents, &len, &err);
+  g_assert_no_error (err);
+
+  /* Truncated */
+  g_file_set_contents (trace, contents, len - 1, &err);
+  g_assert_no_error (err);
+  replay = phoc_input_replay_new (trace, &err);
+  g_assert_error (err, G_IO_ERROR, G_IO_ERROR_INVALID_DATA);
+  g_assert_null (replay);
+  g_clear_error (&err);
+
+  /* Not a recording at all */
+  g_file_set_contents (trace, "[core]\n", -1, &err);
+  g_assert_no_error (err);
+  replay = phoc_input_replay_new (trace, &err);
+  g_assert_error (err, G_IO_ERROR, G_IO_ERROR_INVALID_DATA);
+  g_assert_null (replay);
+
+  g_unlink (trace);
+}
+
+
+static guint
+count_device_records (const char *path)
+{
+  g_autoptr(GError) err = NULL;
+  g_autofree char *contents = NULL;
+  gsize len, pos;
+  guint n = 0;
+
+  g_file_get_contents (path, &contents, &len, &err);
+  g_assert_no_error (err);
+
+  pos = sizeof (PHOC_INPUT_RECORDING_MAGIC) + sizeof (guint32);
+  while (pos + sizeof (PhocInputRecordHeader) <= len) {
+    PhocInputRecordHeader header;
+
+    memcpy (&header, contents + pos, sizeof (header));
+    if (header.type == PHOC_INPUT_RECORD_DEVICE)
+      n++;
+    pos += sizeof (header) + header.size;
+  }
+  g_assert_cmpint (pos, ==, len);
+
+  return n;
+}
+
+/* A destroyed device's address can get reused by the next one */
+static void
+test_phoc_input_recorder_device_reuse (void)
+{
+  g_autoptr(PhocInputRecorder) recorder = NULL;
+  g_autoptr(GError) err = NULL;
+  g_autofree char *trace = get_tmp_file ();
+  struct wlr_input_device device = { .type = WLR_INPUT_DEVICE_POINTER, .name = "test pointer" };
+  struct wlr_event_pointer_motion motion = { .device = &device, .time_msec = 1000 };
+  struct wlr_event_touch_motion touch_motion = { .device = &device, .time_msec = 1008 };
+
+  wl_signal_init (&device.events.destroy);
+  recorder = phoc_input_recorder_new (trace, &err);
+  g_assert_no_error (err);
+
+  phoc_input_recorder_record (recorder, PHOC_INPUT_RECORD_POINTER_MOTION, &device, &motion);
+  phoc_input_recorder_record (recorder, PHOC_INPUT_RECORD_POINTER_MOTION, &device, &motion);
+  g_assert_cmpint (phoc_input_recorder_get_n_events (recorder), ==, 2);
+
+  wl_signal_emit (&device.events.destroy, &device);
+  device = (struct wlr_input_device){ .type = WLR_INPUT_DEVICE_TOUCH, .name = "test touch" };
+  wl_signal_init (&device.events.destroy);
+  phoc_input_recorder_record (recorder, PHOC_INPUT_RECORD_TOUCH_MOTION, &device, &touch_motion);
+
+  g_clear_pointer (&recorder, phoc_input_recorder_free);
+  g_assert_cmpint (count_device_records (trace), ==, 2);
+
+  g_unlink (trace);
+}
+
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_setenv ("WLR_BACKENDS", "headless", TRUE);
+  g_setenv ("WLR_RENDERER", "pixman", FALSE);
+  g_setenv ("WLR_RENDERER_ALLOW_SOFTWARE", "1", FALSE);
+
+  g_test_add_func ("/phoc/input-recorder/roundtrip", test_phoc_input_recorder_roundtrip);
+  g_test_add_func ("/phoc/input-recorder/invalid", test_phoc_input_recorder_invalid);
+  g_test_add_func ("/phoc/input-recorder/device-reuse", test_phoc_input_recorder_device_reuse);
+
+  return g_test_run ();
+}
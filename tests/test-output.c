@@ -0,0 +1,567 @@
+/*
+ * Copyright (C) 2022 Purism SPC
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+#include "server.h"
+#include "input.h"
+#include "seat.h"
+
+#include <glib/gstdio.h>
+#include <math.h>
+#include <unistd.h>
+#include <wlr/types/wlr_output_management_v1.h>
+
+#define IDLE_REFRESH 30000
+#define IDLE_TIMEOUT 50 /* ms */
+#define TIMEOUT (2 * G_USEC_PER_SEC)
+/* Keep in sync with PHOC_OUTPUT_ROTATION_DURATION */
+#define ROTATION_DURATION 300 /* ms */
+
+static const char *idle_refresh_ini =
+  "[core]\n"
+  "xwayland=false\n"
+  "\n"
+  "[output:HEADLESS-1]\n"
+  "mode=1024x768\n"
+  "idle-refresh=30\n"
+  "idle-timeout=50\n";
+
+static const char *idle_refresh_config_ini =
+  "[core]\n"
+  "xwayland=false\n"
+  "\n"
+  "[output:HEADLESS-1]\n"
+  "mode=1024x768\n"
+  "idle-refresh=30\n"
+  "idle-timeout=50\n"
+  "\n"
+  "[output:HEADLESS-2]\n"
+  "x=1024\n"
+  "y=0\n"
+  "mode=800x600\n";
+
+static const char *mirror_ini =
+  "[core]\n"
+  "xwayland=false\n"
+  "\n"
+  "[output:HEADLESS-1]\n"
+  "mode=1024x768\n"
+  "\n"
+  "[output:HEADLESS-2]\n"
+  "mode=800x600\n"
+  "mirror=HEADLESS-1\n";
+
+static const char *mirror_direct_ini =
+  "[core]\n"
+  "xwayland=false\n"
+  "\n"
+  "[output:HEADLESS-1]\n"
+  "mode=1024x768\n"
+  "\n"
+  "[output:HEADLESS-2]\n"
+  "mode=1024x768\n"
+  "mirror=HEADLESS-1\n";
+
+typedef struct {
+  struct wl_listener commit;
+  guint              commits;
+} CommitCounter;
+
+
+static gboolean
+wait_for_refresh (struct wlr_output *wlr_output, int refresh)
+{
+  gint64 end = g_get_monotonic_time () + TIMEOUT;
+
+  while (wlr_output->refresh != refresh) {
+    if (g_get_monotonic_time () > end)
+      return FALSE;
+
+    g_main_context_iteration (NULL, FALSE);
+    g_usleep (1000);
+  }
+
+  return TRUE;
+}
+
+
+/* Make sure the refresh rate doesn't change on its own */
+static gboolean
+keeps_refresh (struct wlr_output *wlr_output, int refresh, guint ms)
+{
+  gint64 end = g_get_monotonic_time () + ms * 1000;
+
+  while (g_get_monotonic_time () < end) {
+    if (wlr_output->refresh != refresh)
+      return FALSE;
+
+    g_main_context_iteration (NULL, FALSE);
+    g_usleep (1000);
+  }
+
+  return wlr_output->refresh == refresh;
+}
+
+
+static void
+test_phoc_output_idle_refresh (void)
+{
+  g_autoptr(PhocServer) server = phoc_server_get_default ();
+  g_autoptr(GError) err = NULL;
+  g_autofree char *ini = NULL;
+  struct wlr_output *wlr_output;
+  PhocOutput *output;
+  PhocSeat *seat;
+  int full_refresh;
+  int fd;
+
+  fd = g_file_open_tmp ("phoc-test-output-XXXXXX.ini", &ini, &err);
+  g_assert_no_error (err);
+  close (fd);
+  g_file_set_contents (ini, idle_refresh_ini, -1, &err);
+  g_assert_no_error (err);
+
+  g_assert_true (phoc_server_setup (server, ini, NULL, NULL,
+                                    PHOC_SERVER_FLAG_NONE,
+                                    PHOC_SERVER_DEBUG_FLAG_NONE));
+  g_assert_false (wl_list_empty (&server->desktop->outputs));
+  output = wl_container_of (server->desktop->outputs.next, output, link);
+  wlr_output = output->wlr_output;
+  g_assert_cmpstr (wlr_output->name, ==, "HEADLESS-1");
+
+  full_refresh = wlr_output->refresh;
+  g_assert_cmpint (full_refresh, >, IDLE_REFRESH);
+
+  /* Nothing gets damaged so the output gets downclocked */
+  g_assert_true (wait_for_refresh (wlr_output, IDLE_REFRESH));
+  g_assert_cmpint (wlr_output->width, ==, 1024);
+  g_assert_cmpint (wlr_output->height, ==, 768);
+  /* The damage from the mode switch itself doesn't bring the full rate back */
+  g_assert_true (keeps_refresh (wlr_output, IDLE_REFRESH, 4 * IDLE_TIMEOUT));
+
+  /* Damage restores the full rate */
+  phoc_output_damage_whole (output);
+  g_assert_true (wait_for_refresh (wlr_output, full_refresh));
+  g_assert_true (wait_for_refresh (wlr_output, IDLE_REFRESH));
+  g_assert_true (keeps_refresh (wlr_output, IDLE_REFRESH, 4 * IDLE_TIMEOUT));
+
+  /* So does input */
+  seat = phoc_input_get_seat (server->input, PHOC_CONFIG_DEFAULT_SEAT_NAME);
+  wlr_idle_notify_activity (server->desktop->idle, seat->seat);
+  g_assert_true (wait_for_refresh (wlr_output, full_refresh));
+  g_assert_true (wait_for_refresh (wlr_output, IDLE_REFRESH));
+  g_assert_true (keeps_refresh (wlr_output, IDLE_REFRESH, 4 * IDLE_TIMEOUT));
+
+  g_unlink (ini);
+}
+
+
+static PhocOutput *
+find_output (PhocServer *server, const char *name)
+{
+  PhocOutput *output;
+
+  wl_list_for_each (output, &server->desktop->outputs, link) {
+    if (g_strcmp0 (output->wlr_output->name, name) == 0)
+      return output;
+  }
+
+  return NULL;
+}
+
+
+static struct wlr_output_configuration_head_v1 *
+config_add_head (struct wlr_output_configuration_v1 *config, PhocServer *server, PhocOutput *output)
+{
+  struct wlr_output_configuration_head_v1 *head;
+  struct wlr_box *box;
+
+  head = wlr_output_configuration_head_v1_create (config, output->wlr_output);
+  box = wlr_output_layout_get_box (server->desktop->layout, output->wlr_output);
+  g_assert_nonnull (box);
+  head->state.x = box->x;
+  head->state.y = box->y;
+
+  return head;
+}
+
+
+/* Downclock and stage restoring the full rate without committing it yet */
+static void
+stage_full_refresh (PhocServer *server, PhocOutput *output)
+{
+  PhocSeat *seat = phoc_input_get_seat (server->input, PHOC_CONFIG_DEFAULT_SEAT_NAME);
+
+  g_assert_true (wait_for_refresh (output->wlr_output, IDLE_REFRESH));
+  wlr_idle_notify_activity (server->desktop->idle, seat->seat);
+  g_assert_true (output->idle_refresh.switching);
+  g_assert_true (output->wlr_output->pending.committed & WLR_OUTPUT_STATE_MODE);
+}
+
+
+static void
+test_phoc_output_idle_refresh_config (void)
+{
+  g_autoptr(PhocServer) server = phoc_server_get_default ();
+  g_autoptr(GError) err = NULL;
+  g_autofree char *ini = NULL;
+  struct wlr_output_configuration_v1 *config;
+  struct wlr_output_configuration_head_v1 *head, *other_head;
+  struct wlr_output_manager_v1 *manager;
+  PhocOutput *output, *other;
+  int full_refresh;
+  int fd;
+
+  fd = g_file_open_tmp ("phoc-test-output-XXXXXX.ini", &ini, &err);
+  g_assert_no_error (err);
+  close (fd);
+  g_file_set_contents (ini, idle_refresh_config_ini, -1, &err);
+  g_assert_no_error (err);
+
+  g_setenv ("WLR_HEADLESS_OUTPUTS", "2", TRUE);
+  g_assert_true (phoc_server_setup (server, ini, NULL, NULL,
+                                    PHOC_SERVER_FLAG_NONE,
+                                    PHOC_SERVER_DEBUG_FLAG_NONE));
+  manager = server->desktop->output_manager_v1;
+  output = find_output (server, "HEADLESS-1");
+  other = find_output (server, "HEADLESS-2");
+  g_assert_nonnull (output);
+  g_assert_nonnull (other);
+  full_refresh = output->wlr_output->refresh;
+
+  /* Testing a configuration neither commits nor loses the staged switch */
+  stage_full_refresh (server, output);
+  config = wlr_output_configuration_v1_create ();
+  head = config_add_head (config, server, output);
+  head->state.enabled = false;
+  config_add_head (config, server, other);
+  wl_signal_emit (&manager->events.test, config);
+  g_assert_true (output->wlr_output->enabled);
+  g_assert_true (wait_for_refresh (output->wlr_output, full_refresh));
+
+  /* A failing head rolls back the whole configuration, the switch still happens */
+  stage_full_refresh (server, output);
+  config = wlr_output_configuration_v1_create ();
+  head = config_add_head (config, server, output);
+  head->state.transform = WL_OUTPUT_TRANSFORM_90;
+  other_head = config_add_head (config, server, other);
+  other_head->state.custom_mode.width = 0;
+  wl_signal_emit (&manager->events.apply, config);
+  g_assert_cmpint (output->wlr_output->transform, ==, WL_OUTPUT_TRANSFORM_NORMAL);
+  g_assert_cmpint (other->wlr_output->width, ==, 800);
+  g_assert_false (output->wlr_output->pending.committed & WLR_OUTPUT_STATE_TRANSFORM);
+  g_assert_true (wait_for_refresh (output->wlr_output, full_refresh));
+
+  /* Applying a mode replaces the staged one and becomes the new full rate */
+  stage_full_refresh (server, output);
+  config = wlr_output_configuration_v1_create ();
+  head = config_add_head (config, server, output);
+  head->state.custom_mode.refresh = 40000;
+  config_add_head (config, server, other);
+  wl_signal_emit (&manager->events.apply, config);
+  g_assert_cmpint (output->wlr_output->refresh, ==, 40000);
+  g_assert_false (output->idle_refresh.switching);
+  g_assert_cmpint (output->idle_refresh.full_refresh, ==, 0);
+  g_assert_true (wait_for_refresh (output->wlr_output, IDLE_REFRESH));
+  phoc_output_damage_whole (output);
+  g_assert_true (wait_for_refresh (output->wlr_output, 40000));
+
+  /* Applying other properties keeps the staged switch */
+  stage_full_refresh (server, output);
+  config = wlr_output_configuration_v1_create ();
+  head = config_add_head (config, server, output);
+  head->state.scale = 2.0;
+  config_add_head (config, server, other);
+  wl_signal_emit (&manager->events.apply, config);
+  g_assert_cmpfloat (output->wlr_output->scale, ==, 2.0);
+  g_assert_cmpint (output->wlr_output->refresh, ==, IDLE_REFRESH);
+  g_assert_true (wait_for_refresh (output->wlr_output, 40000));
+
+  g_setenv ("WLR_HEADLESS_OUTPUTS", "1", TRUE);
+  g_unlink (ini);
+}
+
+
+static void
+test_phoc_output_blank (void)
+{
+  g_autoptr(PhocServer) server = phoc_server_get_default ();
+  struct wlr_output *wlr_output;
+  PhocOutput *output;
+  int width, height, refresh;
+
+  g_assert_true (phoc_server_setup (server, TEST_PHOC_INI, NULL, NULL,
+                                    PHOC_SERVER_FLAG_NONE,
+                                    PHOC_SERVER_DEBUG_FLAG_NONE));
+  g_assert_false (wl_list_empty (&server->desktop->outputs));
+  output = wl_container_of (server->desktop->outputs.next, output, link);
+  wlr_output = output->wlr_output;
+  width = wlr_output->width;
+  height = wlr_output->height;
+  refresh = wlr_output->refresh;
+
+  g_assert_true (phoc_output_set_blank (output, TRUE));
+  g_assert_false (wlr_output->enabled);
+  g_assert_true (phoc_output_is_blanked (output));
+  /* Blanking twice is fine */
+  g_assert_true (phoc_output_set_blank (output, TRUE));
+
+  /* Unblanking commits the first frame right away using the old mode */
+  g_assert_true (phoc_output_set_blank (output, FALSE));
+  g_assert_true (wlr_output->enabled);
+  g_assert_false (phoc_output_is_blanked (output));
+  g_assert_cmpint (wlr_output->width, ==, width);
+  g_assert_cmpint (wlr_output->height, ==, height);
+  g_assert_cmpint (wlr_output->refresh, ==, refresh);
+  g_assert_cmpint (output->blank.unblank_ts, ==, 0);
+  g_assert_cmpint (output->blank.resume_time, >, 0);
+}
+
+
+/* The snapshot's angle close to the end of the animation */
+static float
+rotation_final_angle (PhocOutput *output, enum wl_output_transform from,
+                      enum wl_output_transform to, float *scale)
+{
+  struct wlr_output *wlr_output = output->wlr_output;
+  float angle;
+
+  wlr_output_set_transform (wlr_output, from);
+  g_assert_true (wlr_output_commit (wlr_output));
+
+  phoc_output_rotation_begin (output);
+  g_assert_nonnull (output->rotation.texture);
+  wlr_output_set_transform (wlr_output, to);
+  g_assert_true (wlr_output_commit (wlr_output));
+
+  output->rotation.start = g_get_monotonic_time () - 0.9 * ROTATION_DURATION * 1000;
+  g_assert_true (phoc_output_rotation_get_state (output, &angle, scale));
+  phoc_output_rotation_clear (output);
+  g_assert_null (output->rotation.texture);
+
+  return angle;
+}
+
+
+static void
+test_phoc_output_rotation (void)
+{
+  g_autoptr(PhocServer) server = phoc_server_get_default ();
+  PhocOutput *output;
+  float angle, scale;
+
+  g_assert_true (phoc_server_setup (server, TEST_PHOC_INI, NULL, NULL,
+                                    PHOC_SERVER_FLAG_NONE,
+                                    PHOC_SERVER_DEBUG_FLAG_NONE));
+  g_assert_false (wl_list_empty (&server->desktop->outputs));
+  output = wl_container_of (server->desktop->outputs.next, output, link);
+  g_assert_cmpint (output->wlr_output->width, !=, output->wlr_output->height);
+
+  /* Transforms turn the content counter-clockwise, the snapshot has to follow */
+  angle = rotation_final_angle (output, WL_OUTPUT_TRANSFORM_NORMAL, WL_OUTPUT_TRANSFORM_90, &scale);
+  g_assert_cmpfloat_with_epsilon (angle, -M_PI_2, 0.01);
+  g_assert_cmpfloat (scale, <, 1.0);
+
+  angle = rotation_final_angle (output, WL_OUTPUT_TRANSFORM_NORMAL, WL_OUTPUT_TRANSFORM_270, &scale);
+  g_assert_cmpfloat_with_epsilon (angle, M_PI_2, 0.01);
+  g_assert_cmpfloat (scale, <, 1.0);
+
+  /* Relative to the previous transform */
+  angle = rotation_final_angle (output, WL_OUTPUT_TRANSFORM_90, WL_OUTPUT_TRANSFORM_180, &scale);
+  g_assert_cmpfloat_with_epsilon (angle, -M_PI_2, 0.01);
+  angle = rotation_final_angle (output, WL_OUTPUT_TRANSFORM_270, WL_OUTPUT_TRANSFORM_NORMAL, &scale);
+  g_assert_cmpfloat_with_epsilon (angle, -M_PI_2, 0.01);
+
+  /* Between flipped transforms */
+  angle = rotation_final_angle (output, WL_OUTPUT_TRANSFORM_FLIPPED,
+                                WL_OUTPUT_TRANSFORM_FLIPPED_90, &scale);
+  g_assert_cmpfloat_with_epsilon (angle, -M_PI_2, 0.01);
+  angle = rotation_final_angle (output, WL_OUTPUT_TRANSFORM_FLIPPED_90,
+                                WL_OUTPUT_TRANSFORM_FLIPPED, &scale);
+  g_assert_cmpfloat_with_epsilon (angle, M_PI_2, 0.01);
+
+  /* Flips aren't animated */
+  angle = rotation_final_angle (output, WL_OUTPUT_TRANSFORM_NORMAL,
+                                WL_OUTPUT_TRANSFORM_FLIPPED_90, &scale);
+  g_assert_cmpfloat (angle, ==, 0.0);
+  g_assert_cmpfloat (scale, ==, 1.0);
+}
+
+
+static void
+handle_commit (struct wl_listener *listener, void *data)
+{
+  CommitCounter *counter = wl_container_of (listener, counter, commit);
+
+  counter->commits++;
+}
+
+
+static void
+iterate (guint ms)
+{
+  gint64 end = g_get_monotonic_time () + ms * 1000;
+
+  while (g_get_monotonic_time () < end) {
+    g_main_context_iteration (NULL, FALSE);
+    g_usleep (1000);
+  }
+}
+
+
+static gboolean
+wait_for_commits (CommitCounter *counter, guint commits)
+{
+  gint64 end = g_get_monotonic_time () + TIMEOUT;
+
+  while (counter->commits < commits) {
+    if (g_get_monotonic_time () > end)
+      return FALSE;
+
+    g_main_context_iteration (NULL, FALSE);
+    g_usleep (1000);
+  }
+
+  return TRUE;
+}
+
+
+static PhocServer *
+mirror_setup (const char *ini_contents, char **ini, PhocOutput **source, PhocOutput **mirror)
+{
+  PhocServer *server = phoc_server_get_default ();
+  g_autoptr(GError) err = NULL;
+  int fd;
+
+  fd = g_file_open_tmp ("phoc-test-output-XXXXXX.ini", ini, &err);
+  g_assert_no_error (err);
+  close (fd);
+  g_file_set_contents (*ini, ini_contents, -1, &err);
+  g_assert_no_error (err);
+
+  g_setenv ("WLR_HEADLESS_OUTPUTS", "2", TRUE);
+  g_assert_true (phoc_server_setup (server, *ini, NULL, NULL,
+                                    PHOC_SERVER_FLAG_NONE,
+                                    PHOC_SERVER_DEBUG_FLAG_NONE));
+  *source = find_output (server, "HEADLESS-1");
+  *mirror = find_output (server, "HEADLESS-2");
+  g_assert_nonnull (*source);
+  g_assert_nonnull (*mirror);
+  g_assert_true ((*mirror)->mirror.source == *source);
+
+  return server;
+}
+
+
+/* Source damage reaches the mirror but an idle source doesn't cause commits */
+static void
+mirror_check_commits (PhocOutput *source, PhocOutput *mirror)
+{
+  CommitCounter counter = { .commit.notify = handle_commit };
+  pixman_region32_t damage;
+  guint commits;
+
+  wl_signal_add (&mirror->wlr_output->events.commit, &counter.commit);
+
+  /* Let the initial frames settle */
+  phoc_output_damage_whole (source);
+  g_assert_true (wait_for_commits (&counter, 1));
+  iterate (100);
+
+  commits = counter.commits;
+  iterate (200);
+  g_assert_cmpint (counter.commits, ==, commits);
+  g_assert_false (mirror->mirror.needs_commit);
+
+  pixman_region32_init_rect (&damage, 10, 10, 20, 20);
+  wlr_output_damage_add (source->damage, &damage);
+  pixman_region32_fini (&damage);
+  g_assert_true (wait_for_commits (&counter, commits + 1));
+  g_assert_nonnull (mirror->mirror.buffer);
+
+  commits = counter.commits;
+  iterate (200);
+  g_assert_cmpint (counter.commits, ==, commits);
+
+  wl_list_remove (&counter.commit.link);
+}
+
+
+static void
+test_phoc_output_mirror (void)
+{
+  g_autoptr(PhocServer) server = NULL;
+  g_autofree char *ini = NULL;
+  struct wlr_output_layout *layout;
+  PhocOutput *source, *mirror;
+  struct wlr_box box;
+
+  server = mirror_setup (mirror_ini, &ini, &source, &mirror);
+  layout = server->desktop->layout;
+
+  /* The mirror isn't part of the layout */
+  g_assert_nonnull (g_slist_find (source->mirror.mirrors, mirror));
+  g_assert_null (wlr_output_layout_get (layout, mirror->wlr_output));
+
+  /* The source is scaled to fit */
+  phoc_output_mirror_get_box (mirror, &box);
+  g_assert_cmpint (box.x, ==, 0);
+  g_assert_cmpint (box.y, ==, 0);
+  g_assert_cmpint (box.width, ==, 800);
+  g_assert_cmpint (box.height, ==, 600);
+
+  /* The source's frames are handed to the mirror */
+  mirror_check_commits (source, mirror);
+  /* The imported frame is kept around for the next mirror frame */
+  g_assert_nonnull (mirror->mirror.texture);
+
+  phoc_output_set_mirror_source (mirror, NULL);
+  g_assert_null (mirror->mirror.buffer);
+  g_assert_null (mirror->mirror.texture);
+  g_assert_null (source->mirror.mirrors);
+  g_assert_nonnull (wlr_output_layout_get (layout, mirror->wlr_output));
+
+  g_setenv ("WLR_HEADLESS_OUTPUTS", "1", TRUE);
+  g_unlink (ini);
+}
+
+
+static void
+test_phoc_output_mirror_direct (void)
+{
+  g_autoptr(PhocServer) server = NULL;
+  g_autofree char *ini = NULL;
+  PhocOutput *source, *mirror;
+
+  /* Same size and transform, so the source's buffers can be shown as is */
+  server = mirror_setup (mirror_direct_ini, &ini, &source, &mirror);
+  mirror_check_commits (source, mirror);
+
+  phoc_output_set_mirror_source (mirror, NULL);
+  g_assert_null (mirror->mirror.buffer);
+
+  g_setenv ("WLR_HEADLESS_OUTPUTS", "1", TRUE);
+  g_unlink (ini);
+}
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  /* Custom modes with arbitrary refresh rates need the headless backend */
+  g_setenv ("WLR_BACKENDS", "headless", TRUE);
+  g_setenv ("WLR_HEADLESS_OUTPUTS", "1", TRUE);
+  g_setenv ("WLR_RENDERER", "pixman", FALSE);
+  g_setenv ("WLR_RENDERER_ALLOW_SOFTWARE", "1", FALSE);
+
+  g_test_add_func ("/phoc/output/idle-refresh", test_phoc_output_idle_refresh);
+  g_test_add_func ("/phoc/output/idle-refresh-config", test_phoc_output_idle_refresh_config);
+  g_test_add_func ("/phoc/output/blank", test_phoc_output_blank);
+  g_test_add_func ("/phoc/output/rotation", test_phoc_output_rotation);
+  g_test_add_func ("/phoc/output/mirror", test_phoc_output_mirror);
+  g_test_add_func ("/phoc/output/mirror-direct", test_phoc_output_mirror_direct);
+
+  return g_test_run ();
+}
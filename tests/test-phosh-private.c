@@ -27,6 +27,15 @@ typedef struct _PhocTestThumbnail
   guint32 width, height;
 } PhocTestThumbnail;
 
+typedef struct _PhocTestThumbnailAtlas
+{
+  struct phosh_private_thumbnail_atlas *atlas;
+  PhocTestBuffer buffer;
+  guint32 flags;
+  gboolean done;
+  gboolean failed;
+} PhocTestThumbnailAtlas;
+
 typedef enum {
   GRAB_STATUS_FAILED = -1,
   GRAB_STATUS_UNKNOWN = 0,
@@ -196,6 +205,209 @@ test_phosh_private_thumbnail_simple (void)
   phoc_test_client_run (3, &iface, GINT_TO_POINTER (FALSE));
 }
 
+static void
+assert_thumbnail_color (PhocTestScreencopyFrame *thumbnail, guint32 color)
+{
+  PhocTestBuffer *buffer = &thumbnail->buffer;
+
+  for (guint32 y = 0; y < buffer->height; y++) {
+    for (guint32 x = 0; x < buffer->width; x++)
+      g_assert_cmphex (*(guint32 *)(buffer->shm_data + y * buffer->stride + x * 4), ==, color);
+  }
+}
+
+static gboolean
+test_client_phosh_private_thumbnail_downscale (PhocTestClientGlobals *globals, gpointer data)
+{
+  PhocTestXdgToplevelSurface *toplevel_green;
+  PhocTestScreencopyFrame *thumbnail;
+
+  toplevel_green = phoc_test_xdg_surface_new (globals, WIDTH, HEIGHT, "green", 0xFF00FF00);
+
+  /* Large ratios are downscaled in several steps */
+  thumbnail = phoc_test_get_thumbnail (globals, toplevel_green->width / 5, toplevel_green->height / 5,
+                                       toplevel_green->foreign_toplevel);
+  g_assert_cmpint (thumbnail->buffer.width, ==, toplevel_green->width / 5);
+  assert_thumbnail_color (thumbnail, 0xFF00FF00);
+  phoc_test_thumbnail_free (thumbnail);
+
+  /* Same size again hits the cache */
+  thumbnail = phoc_test_get_thumbnail (globals, toplevel_green->width / 5, toplevel_green->height / 5,
+                                       toplevel_green->foreign_toplevel);
+  assert_thumbnail_color (thumbnail, 0xFF00FF00);
+  phoc_test_thumbnail_free (thumbnail);
+
+  phoc_test_xdg_surface_free (toplevel_green);
+
+  return TRUE;
+}
+
+static void
+test_phosh_private_thumbnail_downscale (void)
+{
+  PhocTestClientIface iface = {
+   .client_run = test_client_phosh_private_thumbnail_downscale,
+  };
+
+  if (g_getenv ("PHOC_TEST_HAVE_DRM") == NULL) {
+    g_test_skip ("PHOC_TEST_HAVE_DRM unsed");
+    return;
+  }
+
+  phoc_test_client_run (3, &iface, NULL);
+}
+
+static void
+thumbnail_atlas_handle_flags (void                                 *data,
+                              struct phosh_private_thumbnail_atlas *atlas,
+                              uint32_t                              flags)
+{
+  PhocTestThumbnailAtlas *ta = data;
+
+  ta->flags = flags;
+}
+
+static void
+thumbnail_atlas_handle_ready (void                                 *data,
+                              struct phosh_private_thumbnail_atlas *atlas,
+                              uint32_t                              tv_sec_hi,
+                              uint32_t                              tv_sec_lo,
+                              uint32_t                              tv_nsec)
+{
+  PhocTestThumbnailAtlas *ta = data;
+
+  ta->done = TRUE;
+}
+
+static void
+thumbnail_atlas_handle_failed (void                                 *data,
+                               struct phosh_private_thumbnail_atlas *atlas)
+{
+  PhocTestThumbnailAtlas *ta = data;
+
+  ta->failed = TRUE;
+}
+
+static const struct phosh_private_thumbnail_atlas_listener thumbnail_atlas_listener = {
+  .flags = thumbnail_atlas_handle_flags,
+  .ready = thumbnail_atlas_handle_ready,
+  .failed = thumbnail_atlas_handle_failed,
+};
+
+static guint32
+atlas_pixel (PhocTestThumbnailAtlas *ta, guint32 x, guint32 y)
+{
+  if (ta->flags & PHOSH_PRIVATE_THUMBNAIL_ATLAS_FLAGS_Y_INVERT)
+    y = ta->buffer.height - 1 - y;
+
+  return *(guint32 *)(ta->buffer.shm_data + y * ta->buffer.stride + x * 4);
+}
+
+static gboolean
+test_client_phosh_private_thumbnail_atlas (PhocTestClientGlobals *globals, gpointer data)
+{
+  PhocTestXdgToplevelSurface *toplevel_green, *toplevel_red;
+  PhocTestThumbnailAtlas ta = { 0 };
+  guint32 w, h;
+
+  g_assert_cmpint (phosh_private_get_version (globals->phosh), >=, 7);
+
+  toplevel_green = phoc_test_xdg_surface_new (globals, WIDTH, HEIGHT, "green", 0xFF00FF00);
+  toplevel_red = phoc_test_xdg_surface_new (globals, WIDTH, HEIGHT, "red", 0xFFFF0000);
+  w = toplevel_green->width / 2;
+  h = toplevel_green->height / 2;
+
+  /* Two half sized thumbnails side by side plus some unused space */
+  phoc_test_client_create_shm_buffer (globals, &ta.buffer, 2 * w + 10, h,
+                                      WL_SHM_FORMAT_ARGB8888);
+  memset (ta.buffer.shm_data, 0xFF, ta.buffer.stride * ta.buffer.height);
+
+  ta.atlas = phosh_private_get_thumbnail_atlas (globals->phosh);
+  phosh_private_thumbnail_atlas_add_listener (ta.atlas, &thumbnail_atlas_listener, &ta);
+  phosh_private_thumbnail_atlas_add_toplevel (ta.atlas, toplevel_green->foreign_toplevel->handle,
+                                              0, 0, w, h);
+  phosh_private_thumbnail_atlas_add_toplevel (ta.atlas, toplevel_red->foreign_toplevel->handle,
+                                              w, 0, w, h);
+  phosh_private_thumbnail_atlas_capture (ta.atlas, ta.buffer.wl_buffer);
+  while (!ta.done && !ta.failed && wl_display_dispatch (globals->display) != -1) {
+  }
+  g_assert_true (ta.done);
+  g_assert_false (ta.failed);
+
+  for (guint32 y = 0; y < h; y++) {
+    g_assert_cmphex (atlas_pixel (&ta, 0, y), ==, 0xFF00FF00);
+    g_assert_cmphex (atlas_pixel (&ta, w - 1, y), ==, 0xFF00FF00);
+    g_assert_cmphex (atlas_pixel (&ta, w, y), ==, 0xFFFF0000);
+    g_assert_cmphex (atlas_pixel (&ta, 2 * w - 1, y), ==, 0xFFFF0000);
+    /* Uncovered parts get cleared */
+    g_assert_cmphex (atlas_pixel (&ta, 2 * w + 5, y), ==, 0);
+  }
+
+  phosh_private_thumbnail_atlas_destroy (ta.atlas);
+  phoc_test_buffer_free (&ta.buffer);
+  phoc_test_xdg_surface_free (toplevel_red);
+  phoc_test_xdg_surface_free (toplevel_green);
+
+  return TRUE;
+}
+
+static gboolean
+test_client_phosh_private_thumbnail_atlas_overflow (PhocTestClientGlobals *globals, gpointer data)
+{
+  PhocTestXdgToplevelSurface *toplevel_green;
+  PhocTestThumbnailAtlas ta = { 0 };
+  const struct wl_interface *interface;
+  guint32 id;
+
+  toplevel_green = phoc_test_xdg_surface_new (globals, WIDTH, HEIGHT, "green", 0xFF00FF00);
+  phoc_test_client_create_shm_buffer (globals, &ta.buffer, WIDTH, HEIGHT,
+                                      WL_SHM_FORMAT_ARGB8888);
+
+  /* x + width wraps around and must not pass the bounds check */
+  ta.atlas = phosh_private_get_thumbnail_atlas (globals->phosh);
+  phosh_private_thumbnail_atlas_add_listener (ta.atlas, &thumbnail_atlas_listener, &ta);
+  phosh_private_thumbnail_atlas_add_toplevel (ta.atlas, toplevel_green->foreign_toplevel->handle,
+                                              G_MAXINT32 - 10, 0, 100, HEIGHT);
+  phosh_private_thumbnail_atlas_capture (ta.atlas, ta.buffer.wl_buffer);
+  g_assert_cmpint (wl_display_roundtrip (globals->display), ==, -1);
+  g_assert_false (ta.done);
+
+  g_assert_cmpint (wl_display_get_protocol_error (globals->display, &interface, &id), ==,
+                   PHOSH_PRIVATE_THUMBNAIL_ATLAS_ERROR_INVALID_RECT);
+  g_assert_true (interface == &phosh_private_thumbnail_atlas_interface);
+
+  phosh_private_thumbnail_atlas_destroy (ta.atlas);
+  phoc_test_buffer_free (&ta.buffer);
+  phoc_test_xdg_surface_free (toplevel_green);
+
+  return TRUE;
+}
+
+static void
+test_phosh_private_thumbnail_atlas_overflow (void)
+{
+  PhocTestClientIface iface = {
+   .client_run = test_client_phosh_private_thumbnail_atlas_overflow,
+  };
+
+  phoc_test_client_run (3, &iface, NULL);
+}
+
+static void
+test_phosh_private_thumbnail_atlas (void)
+{
+  PhocTestClientIface iface = {
+   .client_run = test_client_phosh_private_thumbnail_atlas,
+  };
+
+  if (g_getenv ("PHOC_TEST_HAVE_DRM") == NULL) {
+    g_test_skip ("PHOC_TEST_HAVE_DRM unsed");
+    return;
+  }
+
+  phoc_test_client_run (3, &iface, NULL);
+}
+
 static void
 keyboard_event_handle_grab_failed (void *data,
                                    struct phosh_private_keyboard_event *kbevent,
@@ -401,6 +613,9 @@ main (gint argc, gchar *argv[])
   g_test_init (&argc, &argv, NULL);
 
   g_test_add_func ("/phoc/phosh/thumbnail/simple", test_phosh_private_thumbnail_simple);
+  g_test_add_func ("/phoc/phosh/thumbnail/downscale", test_phosh_private_thumbnail_downscale);
+  g_test_add_func ("/phoc/phosh/thumbnail/atlas", test_phosh_private_thumbnail_atlas);
+  g_test_add_func ("/phoc/phosh/thumbnail/atlas-overflow", test_phosh_private_thumbnail_atlas_overflow);
   g_test_add_func ("/phoc/phosh/kbevents/simple", test_phosh_private_kbevents_simple);
   g_test_add_func ("/phoc/phosh/startup-tracker/simple", test_phosh_private_startup_tracker_simple);
   return g_test_run ();
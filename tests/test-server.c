@@ -4,6 +4,7 @@
  * Author: Guido Günther <agx@sigxcpu.org>
  */
 
+#include "render.h"
 #include "server.h"
 
 static void
@@ -44,6 +45,22 @@ test_phoc_server_setup_args (void)
   g_assert_cmpstr (server->session, ==, "/bin/bash");
 }
 
+static void
+test_phoc_server_setup_renderer (void)
+{
+  g_autoptr(PhocServer) server = phoc_server_get_default ();
+  PhocRenderer *renderer;
+
+  g_setenv ("PHOC_RENDERER", "pixman", TRUE);
+  g_assert_true (phoc_server_setup(server, TEST_PHOC_INI, NULL, NULL,
+                                   PHOC_SERVER_FLAG_NONE,
+                                   PHOC_SERVER_DEBUG_FLAG_NONE));
+  g_unsetenv ("PHOC_RENDERER");
+
+  renderer = phoc_server_get_renderer (server);
+  g_assert_cmpstr (phoc_renderer_get_name (renderer), ==, "pixman");
+}
+
 gint
 main (gint argc, gchar *argv[])
 {
@@ -52,6 +69,7 @@ main (gint argc, gchar *argv[])
   g_test_add_func("/phoc/server/get_default", test_phoc_server_get_default);
   g_test_add_func("/phoc/server/setup", test_phoc_server_setup);
   g_test_add_func("/phoc/server/setup-args", test_phoc_server_setup_args);
+  g_test_add_func("/phoc/server/setup-renderer", test_phoc_server_setup_renderer);
 
   return g_test_run();
 }
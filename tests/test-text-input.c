@@ -0,0 +1,298 @@
+/*
+ * Copyright (C) 2022 Purism SPC
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+#include "testlib.h"
+
+#define WIDTH 100
+#define HEIGHT 200
+
+typedef struct _PhocTestTextInput {
+  struct wl_surface *wl_surface;
+  struct xdg_surface *xdg_surface;
+  struct xdg_toplevel *xdg_toplevel;
+  PhocTestBuffer buffer;
+  gboolean configured;
+
+  struct zwp_text_input_v3 *text_input;
+  gboolean entered;
+
+  struct zwp_input_method_v2 *input_method;
+  gboolean active;
+  guint n_done;
+  guint n_surrounding_text;
+  gsize surrounding_text_bytes;
+  guint n_text_change_cause;
+  guint n_content_type;
+} PhocTestTextInput;
+
+
+static void
+xdg_surface_handle_configure (void *data, struct xdg_surface *xdg_surface, uint32_t serial)
+{
+  PhocTestTextInput *ti = data;
+
+  xdg_surface_ack_configure (ti->xdg_surface, serial);
+  ti->configured = TRUE;
+}
+
+static const struct xdg_surface_listener xdg_surface_listener = {
+  xdg_surface_handle_configure,
+};
+
+
+static void
+xdg_toplevel_handle_configure (void *data, struct xdg_toplevel *xdg_toplevel,
+                               int32_t width, int32_t height, struct wl_array *states)
+{
+}
+
+static void
+xdg_toplevel_handle_close (void *data, struct xdg_toplevel *xdg_toplevel)
+{
+}
+
+static const struct xdg_toplevel_listener xdg_toplevel_listener = {
+  xdg_toplevel_handle_configure,
+  xdg_toplevel_handle_close,
+};
+
+
+static void
+text_input_handle_enter (void *data, struct zwp_text_input_v3 *text_input, struct wl_surface *surface)
+{
+  PhocTestTextInput *ti = data;
+
+  ti->entered = TRUE;
+}
+
+static void
+text_input_handle_leave (void *data, struct zwp_text_input_v3 *text_input, struct wl_surface *surface)
+{
+  PhocTestTextInput *ti = data;
+
+  ti->entered = FALSE;
+}
+
+static void
+text_input_handle_preedit_string (void *data, struct zwp_text_input_v3 *text_input,
+                                  const char *text, int32_t cursor_begin, int32_t cursor_end)
+{
+}
+
+static void
+text_input_handle_commit_string (void *data, struct zwp_text_input_v3 *text_input, const char *text)
+{
+}
+
+static void
+text_input_handle_delete_surrounding_text (void *data, struct zwp_text_input_v3 *text_input,
+                                           uint32_t before_length, uint32_t after_length)
+{
+}
+
+static void
+text_input_handle_done (void *data, struct zwp_text_input_v3 *text_input, uint32_t serial)
+{
+}
+
+static const struct zwp_text_input_v3_listener text_input_listener = {
+  .enter = text_input_handle_enter,
+  .leave = text_input_handle_leave,
+  .preedit_string = text_input_handle_preedit_string,
+  .commit_string = text_input_handle_commit_string,
+  .delete_surrounding_text = text_input_handle_delete_surrounding_text,
+  .done = text_input_handle_done,
+};
+
+
+static void
+input_method_handle_activate (void *data, struct zwp_input_method_v2 *input_method)
+{
+  PhocTestTextInput *ti = data;
+
+  ti->active = TRUE;
+}
+
+static void
+input_method_handle_deactivate (void *data, struct zwp_input_method_v2 *input_method)
+{
+  PhocTestTextInput *ti = data;
+
+  ti->active = FALSE;
+}
+
+static void
+input_method_handle_surrounding_text (void *data, struct zwp_input_method_v2 *input_method,
+                                      const char *text, uint32_t cursor, uint32_t anchor)
+{
+  PhocTestTextInput *ti = data;
+
+  ti->n_surrounding_text++;
+  ti->surrounding_text_bytes += strlen (text);
+}
+
+static void
+input_method_handle_text_change_cause (void *data, struct zwp_input_method_v2 *input_method,
+                                       uint32_t cause)
+{
+  PhocTestTextInput *ti = data;
+
+  ti->n_text_change_cause++;
+}
+
+static void
+input_method_handle_content_type (void *data, struct zwp_input_method_v2 *input_method,
+                                  uint32_t hint, uint32_t purpose)
+{
+  PhocTestTextInput *ti = data;
+
+  ti->n_content_type++;
+}
+
+static void
+input_method_handle_done (void *data, struct zwp_input_method_v2 *input_method)
+{
+  PhocTestTextInput *ti = data;
+
+  ti->n_done++;
+}
+
+static void
+input_method_handle_unavailable (void *data, struct zwp_input_method_v2 *input_method)
+{
+  g_assert_not_reached ();
+}
+
+static const struct zwp_input_method_v2_listener input_method_listener = {
+  .activate = input_method_handle_activate,
+  .deactivate = input_method_handle_deactivate,
+  .surrounding_text = input_method_handle_surrounding_text,
+  .text_change_cause = input_method_handle_text_change_cause,
+  .content_type = input_method_handle_content_type,
+  .done = input_method_handle_done,
+  .unavailable = input_method_handle_unavailable,
+};
+
+
+static void
+text_input_commit (PhocTestClientGlobals *globals, PhocTestTextInput *ti, const char *text)
+{
+  zwp_text_input_v3_set_surrounding_text (ti->text_input, text, 0, 0);
+  zwp_text_input_v3_set_text_change_cause (ti->text_input,
+                                           ZWP_TEXT_INPUT_V3_CHANGE_CAUSE_OTHER);
+  zwp_text_input_v3_set_content_type (ti->text_input,
+                                      ZWP_TEXT_INPUT_V3_CONTENT_HINT_NONE,
+                                      ZWP_TEXT_INPUT_V3_CONTENT_PURPOSE_NORMAL);
+  zwp_text_input_v3_commit (ti->text_input);
+  wl_display_roundtrip (globals->display);
+}
+
+
+static gboolean
+test_client_text_input_state (PhocTestClientGlobals *globals, gpointer data)
+{
+  PhocTestTextInput *ti = g_new0 (PhocTestTextInput, 1);
+  g_autofree char *text1 = g_strnfill (2000, 'a');
+  g_autofree char *text2 = g_strnfill (2000, 'b');
+
+  g_assert_nonnull (globals->seat);
+  g_assert_nonnull (globals->text_input_manager);
+  g_assert_nonnull (globals->input_method_manager);
+
+  ti->input_method = zwp_input_method_manager_v2_get_input_method (globals->input_method_manager,
+                                                                   globals->seat);
+  zwp_input_method_v2_add_listener (ti->input_method, &input_method_listener, ti);
+
+  /* A mapped toplevel gets keyboard and hence text input focus */
+  ti->wl_surface = wl_compositor_create_surface (globals->compositor);
+  ti->xdg_surface = xdg_wm_base_get_xdg_surface (globals->xdg_shell, ti->wl_surface);
+  xdg_surface_add_listener (ti->xdg_surface, &xdg_surface_listener, ti);
+  ti->xdg_toplevel = xdg_surface_get_toplevel (ti->xdg_surface);
+  xdg_toplevel_add_listener (ti->xdg_toplevel, &xdg_toplevel_listener, ti);
+  wl_surface_commit (ti->wl_surface);
+  while (!ti->configured)
+    wl_display_dispatch (globals->display);
+
+  phoc_test_client_create_shm_buffer (globals, &ti->buffer, WIDTH, HEIGHT, WL_SHM_FORMAT_XRGB8888);
+  wl_surface_attach (ti->wl_surface, ti->buffer.wl_buffer, 0, 0);
+  wl_surface_damage (ti->wl_surface, 0, 0, G_MAXINT32, G_MAXINT32);
+  wl_surface_commit (ti->wl_surface);
+  wl_display_roundtrip (globals->display);
+
+  ti->text_input = zwp_text_input_manager_v3_get_text_input (globals->text_input_manager,
+                                                             globals->seat);
+  zwp_text_input_v3_add_listener (ti->text_input, &text_input_listener, ti);
+  wl_display_roundtrip (globals->display);
+  g_assert_true (ti->entered);
+
+  /* Enabling sends the full state */
+  zwp_text_input_v3_enable (ti->text_input);
+  text_input_commit (globals, ti, text1);
+  g_assert_true (ti->active);
+  g_assert_cmpint (ti->n_done, ==, 1);
+  g_assert_cmpint (ti->n_surrounding_text, ==, 1);
+  g_assert_cmpint (ti->n_text_change_cause, ==, 1);
+  g_assert_cmpint (ti->n_content_type, ==, 1);
+  g_assert_cmpint (ti->surrounding_text_bytes, ==, strlen (text1));
+
+  /* The input method's state is reset on done so unchanged state is resent too */
+  text_input_commit (globals, ti, text1);
+  g_assert_cmpint (ti->n_done, ==, 2);
+  g_assert_cmpint (ti->n_surrounding_text, ==, 2);
+  g_assert_cmpint (ti->n_text_change_cause, ==, 2);
+  g_assert_cmpint (ti->n_content_type, ==, 2);
+  g_assert_cmpint (ti->surrounding_text_bytes, ==, 2 * strlen (text1));
+
+  /* Changed surrounding text is forwarded */
+  text_input_commit (globals, ti, text2);
+  g_assert_cmpint (ti->n_done, ==, 3);
+  g_assert_cmpint (ti->n_surrounding_text, ==, 3);
+  g_assert_cmpint (ti->n_text_change_cause, ==, 3);
+  g_assert_cmpint (ti->n_content_type, ==, 3);
+  g_assert_cmpint (ti->surrounding_text_bytes, ==, 2 * strlen (text1) + strlen (text2));
+
+  /* Reenabling sends the full state again */
+  zwp_text_input_v3_disable (ti->text_input);
+  zwp_text_input_v3_commit (ti->text_input);
+  wl_display_roundtrip (globals->display);
+  g_assert_false (ti->active);
+
+  zwp_text_input_v3_enable (ti->text_input);
+  text_input_commit (globals, ti, text2);
+  g_assert_true (ti->active);
+  g_assert_cmpint (ti->n_surrounding_text, ==, 4);
+  g_assert_cmpint (ti->n_content_type, ==, 4);
+  g_assert_cmpint (ti->surrounding_text_bytes, ==, 2 * strlen (text1) + 2 * strlen (text2));
+
+  zwp_text_input_v3_destroy (ti->text_input);
+  zwp_input_method_v2_destroy (ti->input_method);
+  xdg_toplevel_destroy (ti->xdg_toplevel);
+  xdg_surface_destroy (ti->xdg_surface);
+  wl_surface_destroy (ti->wl_surface);
+  phoc_test_buffer_free (&ti->buffer);
+  g_free (ti);
+
+  return TRUE;
+}
+
+static void
+test_text_input_state (void)
+{
+  PhocTestClientIface iface = {
+    .client_run = test_client_text_input_state,
+  };
+
+  phoc_test_client_run (3, &iface, NULL);
+}
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/phoc/text-input/state", test_text_input_state);
+
+  return g_test_run ();
+}
@@ -0,0 +1,150 @@
+/*
+ * Copyright (C) 2022 Purism SPC
+ * SPDX-License-Identifier: GPL-3.0+
+ */
+
+#include "touch-resampler.h"
+
+#include <math.h>
+
+#define FRAME_INTERVAL_US 16667
+#define MAX_PREDICTION_MS 8
+
+typedef struct {
+  gint64 time_ms;
+  double x;
+  double y;
+} TraceSample;
+
+/*
+ * A decelerating upward swipe as reported by a ~120Hz digitizer:
+ * timestamps jitter and coordinates are quantized.
+ */
+static const TraceSample swipe_trace[] = {
+  {   0, 360, 1400 },
+  {   9, 361, 1383 },
+  {  16, 362, 1370 },
+  {  24, 364, 1355 },
+  {  33, 365, 1341 },
+  {  41, 366, 1328 },
+  {  51, 368, 1314 },
+  {  59, 368, 1303 },
+  {  66, 370, 1294 },
+  {  75, 372, 1283 },
+  {  83, 373, 1275 },
+  {  92, 373, 1266 },
+  {  99, 375, 1261 },
+  { 108, 376, 1254 },
+  { 116, 378, 1249 },
+  { 124, 379, 1244 },
+  { 134, 380, 1240 },
+  { 143, 381, 1237 },
+  { 150, 382, 1235 },
+  { 157, 384, 1234 },
+};
+
+/* The path the finger actually took */
+static void
+swipe_ideal (double t_ms, double *x, double *y)
+{
+  *x = 360 + 0.15 * t_ms;
+  *y = 1400 - 2.0 * t_ms + 0.006 * t_ms * t_ms;
+}
+
+/*
+ * Replay the trace and compare the position shown at each frame's
+ * presentation time (one frame after rendering) with the ideal path,
+ * once using the latest sample and once using the resampler.
+ */
+static void
+test_phoc_touch_resampler_replay (void)
+{
+  g_autoptr (PhocTouchResampler) resampler = phoc_touch_resampler_new (MAX_PREDICTION_MS);
+  gint64 end = swipe_trace[G_N_ELEMENTS (swipe_trace) - 1].time_ms * 1000;
+  double raw_sum = 0, resampled_sum = 0;
+  guint next = 0, n_frames = 0;
+
+  for (gint64 frame = 4000; frame <= end; frame += FRAME_INTERVAL_US) {
+    gint64 presented = frame + FRAME_INTERVAL_US;
+    double ix, iy, x, y, raw_err, resampled_err;
+    const TraceSample *last;
+
+    while (next < G_N_ELEMENTS (swipe_trace) && swipe_trace[next].time_ms * 1000 <= frame) {
+      phoc_touch_resampler_add_sample (resampler, swipe_trace[next].time_ms * 1000,
+                                       swipe_trace[next].x, swipe_trace[next].y);
+      next++;
+    }
+    g_assert_cmpint (next, >, 0);
+    last = &swipe_trace[next - 1];
+
+    swipe_ideal (presented / 1000.0, &ix, &iy);
+    raw_err = hypot (last->x - ix, last->y - iy);
+
+    g_assert_true (phoc_touch_resampler_get_position (resampler, presented, &x, &y));
+    resampled_err = hypot (x - ix, y - iy);
+
+    g_test_message ("frame %3" G_GINT64_FORMAT " ms: latest sample error %5.1f px, "
+                    "resampled error %5.1f px",
+                    presented / 1000, raw_err, resampled_err);
+
+    /* Prediction must not overshoot the finger by more than it lagged */
+    g_assert_cmpfloat (resampled_err, <=, raw_err + 1.0);
+
+    raw_sum += raw_err;
+    resampled_sum += resampled_err;
+    n_frames++;
+  }
+
+  g_test_message ("mean error: latest sample %.1f px, resampled %.1f px",
+                  raw_sum / n_frames, resampled_sum / n_frames);
+  g_assert_cmpfloat (resampled_sum, <, raw_sum * 0.75);
+}
+
+
+static void
+test_phoc_touch_resampler_interpolate (void)
+{
+  g_autoptr (PhocTouchResampler) resampler = phoc_touch_resampler_new (MAX_PREDICTION_MS);
+  double x, y;
+
+  g_assert_false (phoc_touch_resampler_get_position (resampler, 0, &x, &y));
+
+  phoc_touch_resampler_add_sample (resampler, 10000, 0, 100);
+  phoc_touch_resampler_add_sample (resampler, 20000, 10, 0);
+
+  /* Between samples */
+  g_assert_true (phoc_touch_resampler_get_position (resampler, 15000, &x, &y));
+  g_assert_cmpfloat_with_epsilon (x, 5, 0.001);
+  g_assert_cmpfloat_with_epsilon (y, 50, 0.001);
+
+  /* Extrapolation is capped */
+  g_assert_true (phoc_touch_resampler_get_position (resampler, 100000, &x, &y));
+  g_assert_cmpfloat_with_epsilon (x, 10 + MAX_PREDICTION_MS, 0.001);
+  g_assert_cmpfloat_with_epsilon (y, -10 * MAX_PREDICTION_MS, 0.001);
+
+  /* Times before the first sample use the latest one */
+  g_assert_true (phoc_touch_resampler_get_position (resampler, 0, &x, &y));
+  g_assert_cmpfloat (x, ==, 10);
+  g_assert_cmpfloat (y, ==, 0);
+
+  /* Out of order samples replace newer ones */
+  phoc_touch_resampler_add_sample (resampler, 15000, 20, 20);
+  g_assert_true (phoc_touch_resampler_get_position (resampler, 15000, &x, &y));
+  g_assert_cmpfloat (x, ==, 20);
+  g_assert_cmpfloat (y, ==, 20);
+
+  phoc_touch_resampler_reset (resampler);
+  g_assert_false (phoc_touch_resampler_get_position (resampler, 0, &x, &y));
+}
+
+
+gint
+main (gint argc, gchar *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/phoc/touch-resampler/interpolate", test_phoc_touch_resampler_interpolate);
+  g_test_add_func ("/phoc/touch-resampler/replay", test_phoc_touch_resampler_replay);
+
+  return g_test_run ();
+}
@@ -40,12 +40,59 @@ test_phoc_utils_compute_scale (void)
   g_assert_cmpfloat (scale, ==, 1.25);
 }
 
+/*
+ * Surfaces using fractional scaling at odd sizes end up a pixel off
+ * from their buffer on the output.
+ */
+static void
+test_phoc_utils_snap_to_buffer_size (void)
+{
+  struct wlr_box box;
+  struct wlr_fbox src = { .width = 177, .height = 352 };
+
+  /* 101x201 at 1.75 */
+  box = (struct wlr_box){ .x = 10, .y = 20, .width = 176, .height = 351 };
+  phoc_utils_snap_to_buffer_size (&box, &src, WL_OUTPUT_TRANSFORM_NORMAL);
+  g_assert_cmpint (box.x, ==, 10);
+  g_assert_cmpint (box.y, ==, 20);
+  g_assert_cmpint (box.width, ==, 177);
+  g_assert_cmpint (box.height, ==, 352);
+
+  /* Rounding up works as well */
+  box = (struct wlr_box){ .width = 178, .height = 353 };
+  phoc_utils_snap_to_buffer_size (&box, &src, WL_OUTPUT_TRANSFORM_NORMAL);
+  g_assert_cmpint (box.width, ==, 177);
+  g_assert_cmpint (box.height, ==, 352);
+
+  /* 101x201 at 1.5 with a fractional source box from the viewport */
+  src = (struct wlr_fbox){ .width = 151.5, .height = 301.5 };
+  box = (struct wlr_box){ .width = 151, .height = 301 };
+  phoc_utils_snap_to_buffer_size (&box, &src, WL_OUTPUT_TRANSFORM_NORMAL);
+  g_assert_cmpint (box.width, ==, 152);
+  g_assert_cmpint (box.height, ==, 302);
+
+  /* Rotated buffers swap width and height */
+  src = (struct wlr_fbox){ .width = 352, .height = 177 };
+  box = (struct wlr_box){ .width = 176, .height = 351 };
+  phoc_utils_snap_to_buffer_size (&box, &src, WL_OUTPUT_TRANSFORM_90);
+  g_assert_cmpint (box.width, ==, 177);
+  g_assert_cmpint (box.height, ==, 352);
+
+  /* Real size differences are left alone */
+  src = (struct wlr_fbox){ .width = 177, .height = 352 };
+  box = (struct wlr_box){ .width = 175, .height = 351 };
+  phoc_utils_snap_to_buffer_size (&box, &src, WL_OUTPUT_TRANSFORM_NORMAL);
+  g_assert_cmpint (box.width, ==, 175);
+  g_assert_cmpint (box.height, ==, 351);
+}
+
 gint
 main (gint argc, gchar *argv[])
 {
   g_test_init (&argc, &argv, NULL);
 
   g_test_add_func ("/phoc/utils/compute_scale", test_phoc_utils_compute_scale);
+  g_test_add_func ("/phoc/utils/snap_to_buffer_size", test_phoc_utils_snap_to_buffer_size);
 
   return g_test_run ();
 }
@@ -5,6 +5,7 @@
  */
 
 #include "testlib.h"
+#include "view.h"
 
 typedef struct _PhocTestXdgToplevelSurface
 {
@@ -154,6 +155,272 @@ test_client_xdg_shell_server_prepare (PhocServer *server, gpointer data)
   return TRUE;
 }
 
+#define BACKGROUND_FRAME_RATE 4
+
+static gboolean
+send_background_frames (gpointer unused)
+{
+  PhocServer *server = phoc_server_get_default ();
+  PhocView *view;
+
+  /* Like sending a configure to every view */
+  wl_list_for_each (view, &server->desktop->views, link)
+    view_send_frame_done_if_not_visible (view);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+frame_handle_done (void *data, struct wl_callback *callback, uint32_t time)
+{
+  gboolean *done = data;
+
+  *done = TRUE;
+  wl_callback_destroy (callback);
+}
+
+static const struct wl_callback_listener frame_listener = {
+  .done = frame_handle_done,
+};
+
+static gboolean
+test_client_xdg_shell_background_frames (PhocTestClientGlobals *globals, gpointer data)
+{
+  PhocTestXdgToplevelSurface *ls_green, *ls_red;
+  gint64 start, elapsed;
+
+  ls_green = phoc_test_xdg_surface_new (globals, WIDTH, HEIGHT, 0xFF00FF00);
+  /* Maximized on top so green isn't visible anymore */
+  ls_red = phoc_test_xdg_surface_new (globals, WIDTH, HEIGHT, 0xFFFF0000);
+
+  start = g_get_monotonic_time ();
+  for (int i = 0; i < 3; i++) {
+    struct wl_callback *callback;
+    gboolean done = FALSE;
+
+    callback = wl_surface_frame (ls_green->wl_surface);
+    wl_callback_add_listener (callback, &frame_listener, &done);
+    wl_surface_commit (ls_green->wl_surface);
+    wl_display_roundtrip (globals->display);
+
+    g_idle_add (send_background_frames, NULL);
+    /* Callbacks exceeding the budget are deferred, not dropped */
+    while (!done)
+      g_assert_cmpint (wl_display_dispatch (globals->display), >=, 0);
+  }
+  elapsed = (g_get_monotonic_time () - start) / 1000;
+
+  /* Only the first callback fits into the budget right away */
+  g_assert_cmpint (elapsed, >=, 2 * 1000 / BACKGROUND_FRAME_RATE - 10);
+
+  phoc_test_xdg_surface_free (ls_red);
+  phoc_test_xdg_surface_free (ls_green);
+  return TRUE;
+}
+
+static gboolean
+test_client_xdg_shell_background_frames_prepare (PhocServer *server, gpointer data)
+{
+  phoc_desktop_set_auto_maximize (server->desktop, TRUE);
+  phoc_client_stats_set_budgets (server->client_stats, 0, BACKGROUND_FRAME_RATE);
+  return TRUE;
+}
+
+static gboolean
+toggle_scale_to_fit (gpointer data)
+{
+  PhocServer *server = phoc_server_get_default ();
+  PhocDesktop *desktop = server->desktop;
+  gint *done = data;
+  PhocView *view;
+
+  g_assert_false (wl_list_empty (&desktop->views));
+  view = wl_container_of (desktop->views.next, view, link);
+  g_assert_cmpfloat (view->scale, ==, 1.0);
+
+  phoc_desktop_set_scale_to_fit (desktop, TRUE);
+  g_assert_cmpfloat (view->scale, <, 1.0);
+
+  /* Turning it off restores the original scale */
+  phoc_desktop_set_scale_to_fit (desktop, FALSE);
+  g_assert_cmpfloat (view->scale, ==, 1.0);
+
+  phoc_desktop_set_scale_to_fit (desktop, TRUE);
+  g_assert_cmpfloat (view->scale, <, 1.0);
+
+  phoc_desktop_set_scale_to_fit (desktop, FALSE);
+  g_atomic_int_set (done, TRUE);
+
+  return G_SOURCE_REMOVE;
+}
+
+static gboolean
+test_client_xdg_shell_scale_to_fit (PhocTestClientGlobals *globals, gpointer data)
+{
+  PhocTestXdgToplevelSurface *ls_green;
+  PhocTestBuffer buffer = { 0 };
+  gint done = FALSE;
+
+  ls_green = phoc_test_xdg_surface_new (globals, WIDTH, HEIGHT, 0xFF00FF00);
+
+  /* Grow beyond the output so the view needs scaling */
+  phoc_test_client_create_shm_buffer (globals, &buffer,
+                                      globals->output.width * 2, globals->output.height * 2,
+                                      WL_SHM_FORMAT_XRGB8888);
+  wl_surface_attach (ls_green->wl_surface, buffer.wl_buffer, 0, 0);
+  wl_surface_damage (ls_green->wl_surface, 0, 0, buffer.width, buffer.height);
+  wl_surface_commit (ls_green->wl_surface);
+  wl_display_roundtrip (globals->display);
+
+  g_idle_add (toggle_scale_to_fit, &done);
+  while (!g_atomic_int_get (&done))
+    g_usleep (1000);
+
+  phoc_test_xdg_surface_free (ls_green);
+  phoc_test_buffer_free (&buffer);
+  return TRUE;
+}
+
+#define SCALE_TO_FIT_APP_ID "sm.puri.Phoc.TestScaleToFit"
+
+typedef struct {
+  GSettings *settings;
+  gint       step;
+  gint       done;
+} AppScaleToFitState;
+
+static gboolean
+toggle_app_scale_to_fit (gpointer data)
+{
+  PhocServer *server = phoc_server_get_default ();
+  PhocDesktop *desktop = server->desktop;
+  AppScaleToFitState *state = data;
+  PhocView *view;
+
+  g_assert_false (wl_list_empty (&desktop->views));
+  view = wl_container_of (desktop->views.next, view, link);
+  g_assert_false (phoc_desktop_get_scale_to_fit (desktop));
+
+  /* Let the settings change notification run before checking the view */
+  switch (state->step++) {
+  case 0:
+    g_assert_cmpfloat (view->scale, ==, 1.0);
+    g_settings_set_boolean (state->settings, "scale-to-fit", TRUE);
+    return G_SOURCE_CONTINUE;
+  case 1:
+    g_assert_cmpfloat (view->scale, <, 1.0);
+    g_settings_set_boolean (state->settings, "scale-to-fit", FALSE);
+    return G_SOURCE_CONTINUE;
+  case 2:
+    g_assert_cmpfloat (view->scale, ==, 1.0);
+    break;
+  default:
+    g_assert_not_reached ();
+  }
+
+  g_settings_reset (state->settings, "scale-to-fit");
+  g_atomic_int_set (&state->done, TRUE);
+  return G_SOURCE_REMOVE;
+}
+
+static gboolean
+test_client_xdg_shell_app_scale_to_fit (PhocTestClientGlobals *globals, gpointer data)
+{
+  PhocTestXdgToplevelSurface *ls_green;
+  PhocTestBuffer buffer = { 0 };
+  AppScaleToFitState state = { 0 };
+
+  ls_green = phoc_test_xdg_surface_new (globals, WIDTH, HEIGHT, 0xFF00FF00);
+  xdg_toplevel_set_app_id (ls_green->xdg_toplevel, SCALE_TO_FIT_APP_ID);
+
+  /* Grow beyond the output so the view needs scaling */
+  phoc_test_client_create_shm_buffer (globals, &buffer,
+                                      globals->output.width * 2, globals->output.height * 2,
+                                      WL_SHM_FORMAT_XRGB8888);
+  wl_surface_attach (ls_green->wl_surface, buffer.wl_buffer, 0, 0);
+  wl_surface_damage (ls_green->wl_surface, 0, 0, buffer.width, buffer.height);
+  wl_surface_commit (ls_green->wl_surface);
+  wl_display_roundtrip (globals->display);
+
+  /* Same path the view uses for the munged app id */
+  state.settings = g_settings_new_with_path ("sm.puri.phoc.application",
+                                             "/sm/puri/phoc/application/sm-puri-phoc-testscaletofit/");
+  g_idle_add (toggle_app_scale_to_fit, &state);
+  while (!g_atomic_int_get (&state.done))
+    g_usleep (1000);
+
+  g_object_unref (state.settings);
+  phoc_test_xdg_surface_free (ls_green);
+  phoc_test_buffer_free (&buffer);
+  return TRUE;
+}
+
+static void
+fill_buffer (PhocTestBuffer *buffer, guint32 color)
+{
+  for (int i = 0; i < buffer->width * buffer->height * 4; i += 4)
+    *(guint32*)(buffer->shm_data + i) = color;
+}
+
+static guint32
+output_center_pixel (PhocTestClientGlobals *globals)
+{
+  PhocTestBuffer *screenshot = phoc_test_client_capture_output (globals, &globals->output);
+  guint32 pixel;
+
+  pixel = *(guint32*)(screenshot->shm_data + screenshot->height / 2 * screenshot->stride +
+                      screenshot->width / 2 * 4);
+  phoc_test_buffer_free (screenshot);
+
+  return pixel & 0x00FFFFFF;
+}
+
+static gboolean
+test_client_xdg_shell_scale_to_fit_cache (PhocTestClientGlobals *globals, gpointer data)
+{
+  PhocTestXdgToplevelSurface *ls;
+  PhocTestBuffer buffer = { 0 };
+  struct wl_callback *callback;
+  gboolean done = FALSE;
+
+  ls = phoc_test_xdg_surface_new (globals, WIDTH, HEIGHT, 0xFF00FF00);
+
+  /* Grow beyond the output so the view gets shrunk and rendered from the cache */
+  phoc_test_client_create_shm_buffer (globals, &buffer,
+                                      globals->output.width * 2, globals->output.height * 2,
+                                      WL_SHM_FORMAT_XRGB8888);
+  fill_buffer (&buffer, 0xFF00FF00);
+  wl_surface_attach (ls->wl_surface, buffer.wl_buffer, 0, 0);
+  wl_surface_damage (ls->wl_surface, 0, 0, buffer.width, buffer.height);
+  wl_surface_commit (ls->wl_surface);
+  wl_display_roundtrip (globals->display);
+  g_assert_cmphex (output_center_pixel (globals), ==, 0x0000FF00);
+
+  /* The damaged frame renders the updated cache into the output's buffer */
+  fill_buffer (&buffer, 0xFFFF0000);
+  callback = wl_surface_frame (ls->wl_surface);
+  wl_callback_add_listener (callback, &frame_listener, &done);
+  wl_surface_attach (ls->wl_surface, buffer.wl_buffer, 0, 0);
+  wl_surface_damage (ls->wl_surface, 0, 0, buffer.width, buffer.height);
+  wl_surface_commit (ls->wl_surface);
+  while (!done)
+    g_assert_cmpint (wl_display_dispatch (globals->display), >=, 0);
+  g_assert_cmphex (output_center_pixel (globals), ==, 0x00FF0000);
+
+  phoc_test_xdg_surface_free (ls);
+  phoc_test_buffer_free (&buffer);
+  return TRUE;
+}
+
+static gboolean
+test_client_xdg_shell_scale_to_fit_cache_prepare (PhocServer *server, gpointer data)
+{
+  server->config->scale_to_fit_cache = true;
+  phoc_desktop_set_auto_maximize (server->desktop, FALSE);
+  phoc_desktop_set_scale_to_fit (server->desktop, TRUE);
+  return TRUE;
+}
+
 static void
 test_xdg_shell_normal (void)
 {
@@ -176,6 +443,50 @@ test_xdg_shell_maximized (void)
   phoc_test_client_run (3, &iface, GINT_TO_POINTER (TRUE));
 }
 
+static void
+test_xdg_shell_scale_to_fit (void)
+{
+  PhocTestClientIface iface = {
+   .server_prepare = test_client_xdg_shell_server_prepare,
+   .client_run     = test_client_xdg_shell_scale_to_fit,
+  };
+
+  phoc_test_client_run (3, &iface, GINT_TO_POINTER (FALSE));
+}
+
+static void
+test_xdg_shell_app_scale_to_fit (void)
+{
+  PhocTestClientIface iface = {
+   .server_prepare = test_client_xdg_shell_server_prepare,
+   .client_run     = test_client_xdg_shell_app_scale_to_fit,
+  };
+
+  phoc_test_client_run (3, &iface, GINT_TO_POINTER (FALSE));
+}
+
+static void
+test_xdg_shell_scale_to_fit_cache (void)
+{
+  PhocTestClientIface iface = {
+   .server_prepare = test_client_xdg_shell_scale_to_fit_cache_prepare,
+   .client_run     = test_client_xdg_shell_scale_to_fit_cache,
+  };
+
+  phoc_test_client_run (3, &iface, NULL);
+}
+
+static void
+test_xdg_shell_background_frames (void)
+{
+  PhocTestClientIface iface = {
+   .server_prepare = test_client_xdg_shell_background_frames_prepare,
+   .client_run     = test_client_xdg_shell_background_frames,
+  };
+
+  phoc_test_client_run (3, &iface, NULL);
+}
+
 gint
 main (gint argc, gchar *argv[])
 {
@@ -183,5 +494,9 @@ main (gint argc, gchar *argv[])
 
   g_test_add_func("/phoc/xdg-shell/simple", test_xdg_shell_normal);
   g_test_add_func("/phoc/xdg-shell/maximize", test_xdg_shell_maximized);
+  g_test_add_func("/phoc/xdg-shell/background-frames", test_xdg_shell_background_frames);
+  g_test_add_func("/phoc/xdg-shell/scale-to-fit", test_xdg_shell_scale_to_fit);
+  g_test_add_func("/phoc/xdg-shell/app-scale-to-fit", test_xdg_shell_app_scale_to_fit);
+  g_test_add_func("/phoc/xdg-shell/scale-to-fit-cache", test_xdg_shell_scale_to_fit_cache);
   return g_test_run();
 }
@@ -297,6 +297,8 @@ static void registry_handle_global(void *data, struct wl_registry *registry,
   } else if (!g_strcmp0 (interface, wl_shm_interface.name)) {
     globals->shm = wl_registry_bind (registry, name, &wl_shm_interface, 1);
     wl_shm_add_listener (globals->shm, &shm_listener, globals);
+  } else if (!g_strcmp0 (interface, wl_seat_interface.name)) {
+    globals->seat = wl_registry_bind (registry, name, &wl_seat_interface, 1);
   } else if (!g_strcmp0 (interface, wl_output_interface.name)) {
     /* TODO: only one output atm */
     g_assert_null (globals->output.output);
@@ -318,13 +320,27 @@ static void registry_handle_global(void *data, struct wl_registry *registry,
 							  &zwlr_foreign_toplevel_manager_v1_interface, 2);
     zwlr_foreign_toplevel_manager_v1_add_listener (globals->foreign_toplevel_manager,
 						   &foreign_toplevel_manager_listener, globals);
+  } else if (!g_strcmp0 (interface, zwlr_virtual_pointer_manager_v1_interface.name)) {
+    globals->virtual_pointer_manager = wl_registry_bind (registry, name,
+                                                         &zwlr_virtual_pointer_manager_v1_interface, 1);
+  } else if (!g_strcmp0 (interface, zwp_text_input_manager_v3_interface.name)) {
+    globals->text_input_manager = wl_registry_bind (registry, name,
+                                                    &zwp_text_input_manager_v3_interface, 1);
+  } else if (!g_strcmp0 (interface, zwp_input_method_manager_v2_interface.name)) {
+    globals->input_method_manager = wl_registry_bind (registry, name,
+                                                      &zwp_input_method_manager_v2_interface, 1);
   } else if (!g_strcmp0 (interface, phosh_private_interface.name)) {
-    globals->phosh = wl_registry_bind (registry, name, &phosh_private_interface, 6);
+    globals->phosh = wl_registry_bind (registry, name, &phosh_private_interface, 7);
   } else if (!g_strcmp0 (interface, gtk_shell1_interface.name)) {
     globals->gtk_shell1 = wl_registry_bind (registry, name, &gtk_shell1_interface, 3);
   } else if (!g_strcmp0 (interface, zphoc_layer_shell_effects_v1_interface.name)) {
     globals->layer_shell_effects = wl_registry_bind (registry, name,
                                                      &zphoc_layer_shell_effects_v1_interface, 1);
+  } else if (!g_strcmp0 (interface, wp_fractional_scale_manager_v1_interface.name)) {
+    globals->fractional_scale_manager = wl_registry_bind (registry, name,
+                                                          &wp_fractional_scale_manager_v1_interface, 1);
+  } else if (!g_strcmp0 (interface, org_kde_kwin_idle_interface.name)) {
+    globals->idle = wl_registry_bind (registry, name, &org_kde_kwin_idle_interface, 1);
   }
 }
 
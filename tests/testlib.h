@@ -6,11 +6,16 @@
 #include "server.h"
 
 #include <glib.h>
+#include "fractional-scale-v1-client-protocol.h"
 #include "gtk-shell-client-protocol.h"
+#include "idle-client-protocol.h"
 #include "xdg-shell-client-protocol.h"
 #include "wlr-foreign-toplevel-management-unstable-v1-client-protocol.h"
 #include "wlr-layer-shell-unstable-v1-client-protocol.h"
 #include "wlr-screencopy-unstable-v1-client-protocol.h"
+#include "wlr-virtual-pointer-unstable-v1-client-protocol.h"
+#include "text-input-unstable-v3-client-protocol.h"
+#include "input-method-unstable-v2-client-protocol.h"
 #include "phosh-private-client-protocol.h"
 #include "phoc-layer-shell-effects-unstable-v1-client-protocol.h"
 
@@ -46,11 +51,17 @@ typedef struct _PhocTestWlGlobals {
   struct wl_display *display;
   struct wl_compositor *compositor;
   struct wl_shm *shm;
+  struct wl_seat *seat;
   struct xdg_wm_base *xdg_shell;
   struct zwlr_layer_shell_v1 *layer_shell;
   struct zphoc_layer_shell_effects_v1 *layer_shell_effects;
   struct zwlr_screencopy_manager_v1 *screencopy_manager;
   struct zwlr_foreign_toplevel_manager_v1 *foreign_toplevel_manager;
+  struct zwlr_virtual_pointer_manager_v1 *virtual_pointer_manager;
+  struct zwp_text_input_manager_v3 *text_input_manager;
+  struct zwp_input_method_manager_v2 *input_method_manager;
+  struct wp_fractional_scale_manager_v1 *fractional_scale_manager;
+  struct org_kde_kwin_idle *idle;
   GSList *foreign_toplevels;
   struct phosh_private *phosh;
   struct gtk_shell1 *gtk_shell1;